@@ -181,6 +181,13 @@ _rb_define_module_function(VALUE module, const char *name, RubyMethod func)
 	rb_define_module_function(module, name, RUBY_METHOD_FUNC(func), -1);
 }
 
+/* Sets hash[:key] = value */
+static inline void
+hashSetInt(VALUE hash, const char *key, size_t value)
+{
+	rb_hash_aset(hash, ID2SYM(rb_intern(key)), SIZET2NUM(value));
+}
+
 #define GUARD_EXC(exp) \
 { try { exp } catch (const Exception &exc) { raiseRbExc(exc); } }
 
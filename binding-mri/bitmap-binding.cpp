@@ -23,6 +23,7 @@
 #include "font.h"
 #include "exception.h"
 #include "sharedstate.h"
+#include "imagedecoder.h"
 #include "disposable-binding.h"
 #include "binding-util.h"
 #include "binding-types.h"
@@ -73,6 +74,38 @@ RB_METHOD(bitmapInitialize)
 	return self;
 }
 
+RB_METHOD(bitmapPreload)
+{
+	RB_UNUSED_PARAM;
+
+	VALUE paths;
+	rb_get_args(argc, argv, "o", &paths RB_ARG_END);
+
+	ImageDecoder &decoder = shState->imageDecoder();
+
+	if (!RB_TYPE_P(paths, RUBY_T_ARRAY))
+	{
+		decoder.preload(objAsStringPtr(paths));
+
+		return Qnil;
+	}
+
+	for (long i = 0; i < RARRAY_LEN(paths); ++i)
+		decoder.preload(objAsStringPtr(rb_ary_entry(paths, i)));
+
+	return Qnil;
+}
+
+RB_METHOD(bitmapLoadAsync)
+{
+	RB_UNUSED_PARAM;
+
+	char *filename;
+	rb_get_args(argc, argv, "z", &filename RB_ARG_END);
+
+	return rb_bool_new(shState->imageDecoder().preload(filename));
+}
+
 RB_METHOD(bitmapWidth)
 {
 	RB_UNUSED_PARAM;
@@ -234,6 +267,33 @@ RB_METHOD(bitmapSetPixel)
 	return self;
 }
 
+RB_METHOD(bitmapPrefetchPixels)
+{
+	Bitmap *b = getPrivateData<Bitmap>(self);
+
+	if (argc == 1)
+	{
+		VALUE rectObj;
+		Rect *rect;
+
+		rb_get_args(argc, argv, "o", &rectObj RB_ARG_END);
+
+		rect = getPrivateDataCheck<Rect>(rectObj, RectType);
+
+		GUARD_EXC( b->prefetchPixels(rect->toIntRect()); );
+	}
+	else
+	{
+		int x, y, width, height;
+
+		rb_get_args(argc, argv, "iiii", &x, &y, &width, &height RB_ARG_END);
+
+		GUARD_EXC( b->prefetchPixels(IntRect(x, y, width, height)); );
+	}
+
+	return self;
+}
+
 RB_METHOD(bitmapHueChange)
 {
 	Bitmap *b = getPrivateData<Bitmap>(self);
@@ -442,6 +502,9 @@ bitmapBindingInit()
 
 	disposableBindingInit<Bitmap>(klass);
 
+	rb_define_class_method(klass, "preload",    bitmapPreload);
+	rb_define_class_method(klass, "load_async", bitmapLoadAsync);
+
 	_rb_define_method(klass, "initialize",      bitmapInitialize);
 	_rb_define_method(klass, "initialize_copy", bitmapInitializeCopy);
 
@@ -454,6 +517,7 @@ bitmapBindingInit()
 	_rb_define_method(klass, "clear",       bitmapClear);
 	_rb_define_method(klass, "get_pixel",   bitmapGetPixel);
 	_rb_define_method(klass, "set_pixel",   bitmapSetPixel);
+	_rb_define_method(klass, "prefetch_pixels", bitmapPrefetchPixels);
 	_rb_define_method(klass, "hue_change",  bitmapHueChange);
 	_rb_define_method(klass, "draw_text",   bitmapDrawText);
 	_rb_define_method(klass, "text_size",   bitmapTextSize);
@@ -46,6 +46,34 @@ RB_METHOD(fontDoesExist)
 
 RB_METHOD(FontSetName);
 
+/* Measures every string in the passed array, returning
+ * an array of widths as Bitmap#text_size would */
+RB_METHOD(fontTextSizeMany)
+{
+	Font *f = getPrivateData<Font>(self);
+
+	VALUE strings;
+	rb_get_args(argc, argv, "o", &strings RB_ARG_END);
+
+	Check_Type(strings, T_ARRAY);
+
+	long count = RARRAY_LEN(strings);
+	VALUE result = rb_ary_new2(count);
+
+	for (long i = 0; i < count; ++i)
+	{
+		VALUE str = rb_ary_entry(strings, i);
+		const char *cstr = rb_string_value_cstr(&str);
+
+		IntRect size;
+		GUARD_EXC( size = f->textSize(cstr); );
+
+		rb_ary_push(result, rb_fix_new(size.w));
+	}
+
+	return result;
+}
+
 RB_METHOD(fontInitialize)
 {
 	VALUE name = Qnil;
@@ -253,6 +281,22 @@ RB_METHOD(FontSetDefaultColor)
 	return colorObj;
 }
 
+RB_METHOD(fontTextCacheStats)
+{
+	RB_UNUSED_PARAM;
+
+	TextCacheStats stats = shState->fontState().textCacheStats();
+
+	VALUE hash = rb_hash_new();
+	hashSetInt(hash, "hits",    stats.hits);
+	hashSetInt(hash, "misses",  stats.misses);
+	hashSetInt(hash, "entries", stats.entries);
+	hashSetInt(hash, "bytes",   stats.bytes);
+	hashSetInt(hash, "budget",  stats.budget);
+
+	return hash;
+}
+
 #define INIT_KLASS_PROP_BIND(Klass, PropName, prop_name_s) \
 { \
 	rb_define_class_method(klass, prop_name_s, Klass##Get##PropName); \
@@ -290,9 +334,11 @@ fontBindingInit()
 	}
 
 	rb_define_class_method(klass, "exist?", fontDoesExist);
+	rb_define_class_method(klass, "text_cache_stats", fontTextCacheStats);
 
 	_rb_define_method(klass, "initialize",      fontInitialize);
 	_rb_define_method(klass, "initialize_copy", fontInitializeCopy);
+	_rb_define_method(klass, "text_size_many",  fontTextSizeMany);
 
 	INIT_PROP_BIND(Font, Name, "name");
 	INIT_PROP_BIND(Font, Size, "size");
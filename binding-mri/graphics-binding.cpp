@@ -24,6 +24,9 @@
 #include "binding-util.h"
 #include "binding-types.h"
 #include "exception.h"
+#include "gl-meta.h"
+#include "texpool.h"
+#include "scene.h"
 
 RB_METHOD(graphicsUpdate)
 {
@@ -67,6 +70,50 @@ RB_METHOD(graphicsFrameReset)
 	return Qnil;
 }
 
+RB_METHOD(graphicsUploadStats)
+{
+	RB_UNUSED_PARAM;
+
+	const GLMeta::UploadStats &stats = GLMeta::uploadStats();
+
+	VALUE hash = rb_hash_new();
+	hashSetInt(hash, "bytes",          stats.bytes);
+	hashSetInt(hash, "streamed",       stats.streamed);
+	hashSetInt(hash, "direct",         stats.direct);
+	hashSetInt(hash, "stalls_avoided", stats.stallsAvoided);
+
+	return hash;
+}
+
+RB_METHOD(graphicsTexpoolStats)
+{
+	RB_UNUSED_PARAM;
+
+	const TexPool::Stats &stats = shState->texPool().getStats();
+
+	VALUE hash = rb_hash_new();
+	hashSetInt(hash, "hits",           stats.hits);
+	hashSetInt(hash, "misses",         stats.misses);
+	hashSetInt(hash, "evictions",      stats.evictions);
+	hashSetInt(hash, "resident_bytes", stats.residentBytes);
+	hashSetInt(hash, "budget",         stats.budget);
+
+	return hash;
+}
+
+RB_METHOD(graphicsCullStats)
+{
+	RB_UNUSED_PARAM;
+
+	const CullStats &stats = Scene::cullStats();
+
+	VALUE hash = rb_hash_new();
+	hashSetInt(hash, "visited", stats.visited);
+	hashSetInt(hash, "culled",  stats.culled);
+
+	return hash;
+}
+
 #define DEF_GRA_PROP_I(PropName) \
 	RB_METHOD(graphics##Get##PropName) \
 	{ \
@@ -207,6 +254,10 @@ void graphicsBindingInit()
 
 	_rb_define_module_function(module, "__reset__", graphicsReset);
 
+	_rb_define_module_function(module, "upload_stats", graphicsUploadStats);
+	_rb_define_module_function(module, "texpool_stats", graphicsTexpoolStats);
+	_rb_define_module_function(module, "cull_stats", graphicsCullStats);
+
 	INIT_GRA_PROP_BIND( FrameRate,  "frame_rate"  );
 	INIT_GRA_PROP_BIND( FrameCount, "frame_count" );
 
@@ -135,7 +135,17 @@ HEADERS += \
 	src/tileatlasvx.h \
 	src/sharedmidistate.h \
 	src/fluid-fun.h \
-	src/sdl-util.h
+	src/sdl-util.h \
+	src/glyphatlas.h \
+	src/imagedecoder.h \
+	src/surface-ops.h \
+	src/bitmapatlas.h \
+	src/spritebatch.h \
+	src/framedigest.h \
+	src/renderthread.h \
+	src/frameprofiler.h \
+	src/workerpool.h \
+	src/tileatlascache.h
 
 SOURCES += \
 	src/main.cpp \
@@ -180,15 +190,26 @@ SOURCES += \
 	src/tileatlasvx.cpp \
 	src/autotilesvx.cpp \
 	src/midisource.cpp \
-	src/fluid-fun.cpp
+	src/fluid-fun.cpp \
+	src/glyphatlas.cpp \
+	src/imagedecoder.cpp \
+	src/surface-ops.cpp \
+	src/bitmapatlas.cpp \
+	src/spritebatch.cpp \
+	src/renderthread.cpp \
+	src/frameprofiler.cpp \
+	src/workerpool.cpp \
+	src/tileatlascache.cpp
 
 EMBED = \
 	shader/transSimple.frag \
 	shader/trans.frag \
 	shader/hue.frag \
 	shader/sprite.frag \
+	shader/spriteBatch.frag \
 	shader/plane.frag \
 	shader/bitmapBlit.frag \
+	shader/text.frag \
 	shader/simple.frag \
 	shader/simpleColor.frag \
 	shader/simpleAlpha.frag \
@@ -196,6 +217,9 @@ EMBED = \
 	shader/simple.vert \
 	shader/simpleColor.vert \
 	shader/sprite.vert \
+	shader/spriteBatch.vert \
+	shader/spriteInstanced.vert \
+	shader/spriteWave.vert \
 	shader/tilemap.vert \
 	shader/blur.frag \
 	shader/blurH.vert \
@@ -4,6 +4,7 @@ uniform mat4 projMat;
 uniform mat4 spriteMat;
 
 uniform vec2 texSizeInv;
+uniform vec2 texOffset;
 
 attribute vec2 position;
 attribute vec2 texCoord;
@@ -13,5 +14,5 @@ varying vec2 v_texCoord;
 void main()
 {
 	gl_Position = projMat * spriteMat * vec4(position, 0, 1);
-	v_texCoord = texCoord * texSizeInv;
+	v_texCoord = (texCoord + texOffset) * texSizeInv;
 }
@@ -0,0 +1,38 @@
+/* Same as sprite.frag, with the
+ * parameters passed per vertex */
+
+uniform sampler2D texture;
+
+varying vec2 v_texCoord;
+varying vec4 v_color;
+varying vec4 v_tone;
+
+/* Opacity, bush depth, bush opacity */
+varying vec3 v_effect;
+
+const vec3 lumaF = vec3(.299, .587, .114);
+
+void main()
+{
+	/* Sample source color */
+	vec4 frag = texture2D(texture, v_texCoord);
+
+	/* Apply gray */
+	float luma = dot(frag.rgb, lumaF);
+	frag.rgb = mix(frag.rgb, vec3(luma), v_tone.w);
+
+	/* Apply tone */
+	frag.rgb += v_tone.rgb;
+
+	/* Apply opacity */
+	frag.a *= v_effect.x;
+
+	/* Apply color */
+	frag.rgb = mix(frag.rgb, v_color.rgb, v_color.a);
+
+	/* Apply bush alpha by mathematical if */
+	float underBush = float(v_texCoord.y < v_effect.y);
+	frag.a *= clamp(v_effect.z + underBush, 0.0, 1.0);
+
+	gl_FragColor = frag;
+}
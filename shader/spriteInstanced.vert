@@ -0,0 +1,31 @@
+
+uniform mat4 projMat;
+
+uniform vec2 texSizeInv;
+
+/* Unit quad corner, (0, 0) to (1, 1) */
+attribute vec2 position;
+
+/* Per instance */
+attribute vec2 origin;
+attribute vec4 edges;
+attribute vec4 texCoord;
+attribute vec4 color;
+attribute vec4 tone;
+attribute vec4 effect;
+
+varying vec2 v_texCoord;
+varying vec4 v_color;
+varying vec4 v_tone;
+varying vec3 v_effect;
+
+void main()
+{
+	vec2 pos = origin + position.x * edges.xy + position.y * edges.zw;
+	gl_Position = projMat * vec4(pos, 0, 1);
+
+	v_texCoord = (texCoord.xy + position * texCoord.zw) * texSizeInv;
+	v_color = color;
+	v_tone = tone;
+	v_effect = effect.xyz;
+}
@@ -0,0 +1,50 @@
+
+uniform mat4 projMat;
+
+uniform mat4 spriteMat;
+
+uniform vec2 texSizeInv;
+uniform vec2 texOffset;
+
+/* Source rect x, y, vertical zoom */
+uniform vec4 waveSource;
+/* Part of the source rect inside the bitmap (relative
+ * to it): left, right, top, bottom */
+uniform vec4 waveClip;
+/* Amplitude, radians per pixel, phase */
+uniform vec4 waveParams;
+/* First chunk length, visible height */
+uniform vec2 waveStrip;
+
+/* x: left (0) or right (1) edge, y: chunk boundary index */
+attribute vec2 position;
+/* x: index of the chunk this vertex belongs to */
+attribute vec2 texCoord;
+
+varying vec2 v_texCoord;
+
+/* Screen space offset of a chunk boundary from the sprite top;
+ * all chunks but the first are 8 pixels long */
+float boundary(float index)
+{
+	return clamp(waveStrip.x + (index - 1.0) * 8.0, 0.0, waveStrip.y);
+}
+
+void main()
+{
+	float chunkY = boundary(texCoord.x);
+
+	/* Chunk edges outside of the bitmap are moved onto it, so the
+	 * strip never samples neighbouring pixels on an atlas page */
+	float screenY = clamp(boundary(position.y),
+	                      waveClip.z * waveSource.z, waveClip.w * waveSource.z);
+	float localY = screenY / waveSource.z;
+
+	float shift = sin(waveParams.z + chunkY * waveParams.y) * waveParams.x;
+	float localX = mix(waveClip.x, waveClip.y, position.x);
+
+	gl_Position = projMat * spriteMat * vec4(localX + shift, localY, 0, 1);
+
+	vec2 tex = waveSource.xy + vec2(localX, localY);
+	v_texCoord = (tex + texOffset) * texSizeInv;
+}
@@ -0,0 +1,56 @@
+
+uniform sampler2D texture;
+
+uniform vec2 texSizeInv;
+
+uniform vec4 color;
+uniform vec4 outColor;
+
+uniform float shadow;
+uniform float outline;
+
+varying vec2 v_texCoord;
+
+/* Glyph coverage at a pixel offset from the current fragment */
+float coverage(vec2 offset)
+{
+	return texture2D(texture, v_texCoord + offset * texSizeInv).a;
+}
+
+/* Non-premultiplied 'over' operator */
+vec4 over(vec4 top, vec4 bottom)
+{
+	float a = top.a + bottom.a * (1.0 - top.a);
+
+	if (a == 0.0)
+		return vec4(top.rgb, 0.0);
+
+	vec3 rgb = (top.rgb * top.a + bottom.rgb * bottom.a * (1.0 - top.a)) / a;
+
+	return vec4(rgb, a);
+}
+
+void main()
+{
+	float text = min(coverage(vec2(0.0, 0.0)), 1.0);
+
+	/* Outline: text coverage dilated by one pixel */
+	float dil = text;
+	dil = max(dil, coverage(vec2(-1.0, -1.0)));
+	dil = max(dil, coverage(vec2( 0.0, -1.0)));
+	dil = max(dil, coverage(vec2( 1.0, -1.0)));
+	dil = max(dil, coverage(vec2(-1.0,  0.0)));
+	dil = max(dil, coverage(vec2( 1.0,  0.0)));
+	dil = max(dil, coverage(vec2(-1.0,  1.0)));
+	dil = max(dil, coverage(vec2( 0.0,  1.0)));
+	dil = max(dil, coverage(vec2( 1.0,  1.0)));
+
+	/* Shadow: black text coverage offset by one pixel */
+	float shd = coverage(vec2(-1.0, -1.0));
+
+	vec4 frag = vec4(outColor.rgb, min(dil, 1.0) * outline);
+	frag = over(vec4(0.0, 0.0, 0.0, min(shd, 1.0) * shadow), frag);
+	frag = over(vec4(color.rgb, text), frag);
+
+	gl_FragColor = frag;
+}
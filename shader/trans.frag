@@ -7,12 +7,14 @@ uniform sampler2D transMap;
 uniform float prog;
 /* Vague [0, 512] normalized */
 uniform float vague;
+/* Used part of the transMap texture */
+uniform vec2 transMapScale;
 
 varying vec2 v_texCoord;
 
 void main()
 {
-    float transV = texture2D(transMap, v_texCoord).r;
+    float transV = texture2D(transMap, v_texCoord * transMapScale).r;
     float cTransV = clamp(transV, prog, prog+vague);
     float alpha = (cTransV - prog) / vague;
     
@@ -28,6 +28,11 @@
 #include <SDL_surface.h>
 
 #include <pixman.h>
+#include <sigc++/connection.h>
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
 
 #include "gl-util.h"
 #include "gl-meta.h"
@@ -39,10 +44,13 @@
 #include "sharedstate.h"
 #include "glstate.h"
 #include "texpool.h"
+#include "bitmapatlas.h"
 #include "shader.h"
 #include "filesystem.h"
 #include "font.h"
 #include "eventthread.h"
+#include "imagedecoder.h"
+#include "surface-ops.h"
 
 #define GUARD_MEGA \
 	{ \
@@ -51,7 +59,9 @@
                             "Operation not supported for mega surfaces"); \
 	}
 
-#define OUTLINE_SIZE 1
+/* Recorded commands are flushed once this many are pending,
+ * keeping a flush within reach of the 16 bit index buffer */
+#define MAX_QUEUED_COMMANDS 8192
 
 /* Normalize (= ensure width and
  * height are positive) */
@@ -74,25 +84,103 @@ static IntRect normalizedRect(const IntRect &rect)
 	return norm;
 }
 
+/* Pooled textures come rounded up in size; clear the
+ * padding so sampling past the bitmap edges yields
+ * transparency rather than stale contents */
+static TEXFBO requestTex(int width, int height)
+{
+	TEXFBO tex = shState->texPool().request(width, height);
+
+	if (tex.width != width || tex.height != height)
+	{
+		FBO::bind(tex.fbo);
+
+		glState.clearColor.pushSet(Vec4());
+		FBO::clear();
+		glState.clearColor.pop();
+	}
+
+	return tex;
+}
+
+/* Edge length of the square blocks the client side
+ * pixel cache is read back and invalidated in */
+static const int READBACK_TILE = 64;
+
+/* Upper bound for the edge length of the textures
+ * mega surfaces are split into for drawing */
+static const int MEGA_TILE_MAX = 2048;
+
+/* An asynchronous readback of a tile aligned area,
+ * requested via Bitmap::prefetchPixels() */
+struct PendingRead
+{
+	PackPBO::ID pbo;
+	_GLsync fence;
+	IntRect area;
+};
+
+struct BitmapPrivate;
+
+/* A deferred blit or fill, already in the form of the quad
+ * that will execute it. Fills have no source */
+struct DrawCommand
+{
+	BitmapPrivate *source;
+	Vertex vert[4];
+};
+
 struct BitmapPrivate
 {
 	Bitmap *self;
 
+	/* The texture can be larger than the bitmap;
+	 * 'width' x 'height' is the part in use */
 	TEXFBO gl;
+	int width, height;
+
+	/* Small images loaded from files start out inside a
+	 * shared atlas page instead of 'gl'. It's read only;
+	 * before the first modification, they move out */
+	AtlasEntry *atlas;
 
 	Font *font;
 
-	/* "Mega surfaces" are a hack to allow Tilesets to be used
-	 * whose Bitmaps don't fit into a regular texture. They're
-	 * kept in RAM and will throw an error if they're used in
-	 * any context other than as Tilesets */
+	/* "Mega surfaces" are Bitmaps that don't fit into a regular
+	 * texture. They're kept in RAM and modified on the CPU; Tilemaps
+	 * read them directly, Sprites and Planes draw them from a grid
+	 * of textures which is uploaded lazily, tile by tile */
 	SDL_Surface *megaSurface;
+	std::vector<TEXFBO> megaTiles;
+	std::vector<bool> megaTileStale;
 
 	/* A cached version of the bitmap in client memory, for
-	 * getPixel calls. Is invalidated any time the bitmap
-	 * is modified */
+	 * getPixel calls. It is filled in tile by tile as pixels
+	 * are queried, and modifications only invalidate the
+	 * tiles they touch */
 	SDL_Surface *surface;
 	SDL_PixelFormat *format;
+	std::vector<bool> tileValid;
+	int tilesX, tilesY;
+
+	std::vector<PendingRead> pendingReads;
+
+	/* setPixel writes land in 'surface' first. Per tile, the
+	 * bounding box of written pixels is recorded, and all of
+	 * them are uploaded at once before the texture is used */
+	std::vector<IntRect> tileDirty;
+	std::vector<int> dirtyTiles;
+
+	/* Plain blits and fills are recorded instead of executed
+	 * right away, and run as batched draws once the texture
+	 * is used (or at the latest before the next frame) */
+	std::vector<DrawCommand> commands;
+
+	/* Bitmaps with recorded blits sourcing from this one;
+	 * they are flushed before this one changes */
+	std::vector<BitmapPrivate*> dependents;
+
+	sigc::connection prepareCon;
 
 	/* The 'tainted' area describes which parts of the
 	 * bitmap are not cleared, ie. don't have 0 opacity.
@@ -102,10 +190,18 @@ struct BitmapPrivate
 	 * ourselves the expensive blending calculation */
 	pixman_region16_t tainted;
 
+	/* Taken from the shared modification stamp counter
+	 * on every change, so it's unique across bitmaps */
+	uint64_t modStamp;
+
 	BitmapPrivate(Bitmap *self)
 	    : self(self),
+	      width(0),
+	      height(0),
+	      atlas(0),
 	      megaSurface(0),
-	      surface(0)
+	      surface(0),
+	      modStamp(shState->genModStamp())
 	{
 		format = SDL_AllocFormat(SDL_PIXELFORMAT_ABGR8888);
 
@@ -115,15 +211,432 @@ struct BitmapPrivate
 
 	~BitmapPrivate()
 	{
+		prepareCon.disconnect();
+		discardCommands();
+
+		for (size_t i = 0; i < pendingReads.size(); ++i)
+			discardRead(pendingReads[i]);
+
+		if (surface)
+			SDL_FreeSurface(surface);
+
 		SDL_FreeFormat(format);
 		pixman_region_fini(&tainted);
 	}
 
+	/* The texture holding our pixels, and
+	 * where inside of it they are located */
+	TEXFBO &texture()
+	{
+		return atlas ? *atlas->tex : gl;
+	}
+
+	Vec2i origin() const
+	{
+		return atlas ? Vec2i(atlas->rect.x, atlas->rect.y) : Vec2i();
+	}
+
+	/* Copies our pixels out of the atlas into a texture of our own */
+	void leaveAtlas()
+	{
+		if (!atlas)
+			return;
+
+		TEXFBO tex = requestTex(width, height);
+
+		GLMeta::blitBegin(tex);
+		GLMeta::blitSource(*atlas->tex);
+		GLMeta::blitRectangle(atlas->rect, Vec2i());
+		GLMeta::blitEnd();
+
+		shState->bitmapAtlas().remove(atlas);
+		atlas = 0;
+
+		gl = tex;
+	}
+
 	void allocSurface()
 	{
-		surface = SDL_CreateRGBSurface(0, gl.width, gl.height, format->BitsPerPixel,
+		surface = SDL_CreateRGBSurface(0, width, height, format->BitsPerPixel,
 		                               format->Rmask, format->Gmask,
 		                               format->Bmask, format->Amask);
+
+		tilesX = (width  + READBACK_TILE - 1) / READBACK_TILE;
+		tilesY = (height + READBACK_TILE - 1) / READBACK_TILE;
+		tileValid.assign(tilesX * tilesY, false);
+		tileDirty.assign(tilesX * tilesY, IntRect());
+	}
+
+	/* Clips 'rect' to the bitmap and returns the covered tile
+	 * range [tx1, tx2) x [ty1, ty2). False if nothing is covered */
+	bool tileRange(const IntRect &rect,
+	               int &tx1, int &ty1, int &tx2, int &ty2) const
+	{
+		IntRect norm = normalizedRect(rect);
+
+		int x1 = std::max(norm.x, 0);
+		int y1 = std::max(norm.y, 0);
+		int x2 = std::min(norm.x + norm.w, width);
+		int y2 = std::min(norm.y + norm.h, height);
+
+		if (x1 >= x2 || y1 >= y2)
+			return false;
+
+		tx1 = x1 / READBACK_TILE;
+		ty1 = y1 / READBACK_TILE;
+		tx2 = (x2 - 1) / READBACK_TILE + 1;
+		ty2 = (y2 - 1) / READBACK_TILE + 1;
+
+		return true;
+	}
+
+	IntRect tileRect(int tx1, int ty1, int tx2, int ty2) const
+	{
+		int x = tx1 * READBACK_TILE;
+		int y = ty1 * READBACK_TILE;
+
+		return IntRect(x, y,
+		               std::min(tx2 * READBACK_TILE, width)  - x,
+		               std::min(ty2 * READBACK_TILE, height) - y);
+	}
+
+	void setTilesValid(int tx1, int ty1, int tx2, int ty2, bool value)
+	{
+		for (int ty = ty1; ty < ty2; ++ty)
+			for (int tx = tx1; tx < tx2; ++tx)
+				tileValid[ty*tilesX+tx] = value;
+	}
+
+	/* Copies tightly packed pixel rows into 'surface' */
+	void storePixels(const IntRect &area, const uint8_t *data)
+	{
+		const size_t rowBytes = area.w * 4;
+		uint8_t *dst = static_cast<uint8_t*>(surface->pixels)
+			+ area.y * surface->pitch + area.x * 4;
+
+		for (int i = 0; i < area.h; ++i)
+			memcpy(dst + i*surface->pitch, data + i*rowBytes, rowBytes);
+	}
+
+	/* Makes sure tile (tx, ty) of 'surface' holds the
+	 * current texture contents */
+	void ensureTile(int tx, int ty)
+	{
+		if (tileValid[ty*tilesX+tx])
+			return;
+
+		IntRect area = tileRect(tx, ty, tx+1, ty+1);
+
+		if (!touchesTaintedArea(area))
+		{
+			/* Known to be cleared, nothing to read back */
+			uint8_t *dst = static_cast<uint8_t*>(surface->pixels)
+				+ area.y * surface->pitch + area.x * 4;
+
+			for (int i = 0; i < area.h; ++i)
+				memset(dst + i*surface->pitch, 0, area.w * 4);
+
+			tileValid[ty*tilesX+tx] = true;
+
+			return;
+		}
+
+		if (!resolveRead(tx, ty))
+			readTile(tx, ty);
+	}
+
+	void markDirty(int x, int y)
+	{
+		int i = (y / READBACK_TILE) * tilesX + (x / READBACK_TILE);
+		IntRect &rect = tileDirty[i];
+
+		if (rect.w == 0)
+		{
+			rect = IntRect(x, y, 1, 1);
+			dirtyTiles.push_back(i);
+			schedulePrepare();
+
+			return;
+		}
+
+		int x1 = std::min<int>(rect.x, x);
+		int y1 = std::min<int>(rect.y, y);
+		int x2 = std::max<int>(rect.x + rect.w, x + 1);
+		int y2 = std::max<int>(rect.y + rect.h, y + 1);
+
+		rect = IntRect(x1, y1, x2 - x1, y2 - y1);
+	}
+
+	/* Uploads pending setPixel writes. Has to happen before
+	 * the texture is sampled from or modified on the GPU */
+	void flushPixels()
+	{
+		if (dirtyTiles.empty())
+			return;
+
+		TEX::bind(gl.tex);
+
+		for (size_t i = 0; i < dirtyTiles.size(); ++i)
+		{
+			IntRect &rect = tileDirty[dirtyTiles[i]];
+
+			const uint8_t *src = static_cast<const uint8_t*>(surface->pixels)
+				+ rect.y * surface->pitch + rect.x * 4;
+
+			GLMeta::texSubImage(rect.x, rect.y, rect.w, rect.h,
+			                    src, surface->pitch, GL_RGBA);
+
+			rect = IntRect();
+		}
+
+		dirtyTiles.clear();
+	}
+
+	void schedulePrepare()
+	{
+		if (!prepareCon.connected())
+			prepareCon = shState->prepareDraw.connect
+				(sigc::mem_fun(this, &BitmapPrivate::flush));
+	}
+
+	void removeDependent(BitmapPrivate *bitmap)
+	{
+		dependents.erase(std::remove(dependents.begin(), dependents.end(), bitmap),
+		                 dependents.end());
+	}
+
+	void flushDependents()
+	{
+		/* Flushing unregisters them from us */
+		std::vector<BitmapPrivate*> deps = dependents;
+
+		for (size_t i = 0; i < deps.size(); ++i)
+			deps[i]->flushCommands();
+	}
+
+	void discardCommands()
+	{
+		for (size_t i = 0; i < commands.size(); ++i)
+			if (commands[i].source)
+				commands[i].source->removeDependent(this);
+
+		commands.clear();
+	}
+
+	void pushCommand(const DrawCommand &cmd)
+	{
+		if (commands.size() >= MAX_QUEUED_COMMANDS)
+			flushCommands();
+
+		commands.push_back(cmd);
+		schedulePrepare();
+	}
+
+	void queueFill(const IntRect &rect, const Vec4 &c1, const Vec4 &c2, bool vertical)
+	{
+		DrawCommand cmd;
+		cmd.source = 0;
+		Quad::setPosRect(cmd.vert, rect);
+
+		cmd.vert[0].color = c1;
+		cmd.vert[1].color = vertical ? c1 : c2;
+		cmd.vert[2].color = c2;
+		cmd.vert[3].color = vertical ? c2 : c1;
+
+		pushCommand(cmd);
+	}
+
+	void queueBlit(BitmapPrivate *source, const IntRect &srcRect, const IntRect &dstRect)
+	{
+		DrawCommand cmd;
+		cmd.source = source;
+		Quad::setTexPosRect(cmd.vert, srcRect, dstRect);
+		Quad::setColor(cmd.vert, Vec4(1, 1, 1, 1));
+
+		pushCommand(cmd);
+
+		if (std::find(source->dependents.begin(), source->dependents.end(), this)
+		    == source->dependents.end())
+			source->dependents.push_back(this);
+	}
+
+	/* Executes recorded commands. Runs of consecutive fills,
+	 * or of blits from the same source, become one draw call.
+	 * All of them replace the destination pixels, so blending
+	 * is off and draw order within a run is preserved */
+	void flushCommands()
+	{
+		if (commands.empty())
+			return;
+
+		ColorQuadArray &qArray = shState->gpQuadArray();
+		qArray.resize(commands.size());
+
+		for (size_t i = 0; i < commands.size(); ++i)
+			memcpy(&qArray.vertices[i*4], commands[i].vert, sizeof(commands[i].vert));
+
+		qArray.commit();
+
+		FBO::bind(gl.fbo);
+		glState.blend.pushSet(false);
+		glState.viewport.pushSet(IntRect(0, 0, width, height));
+
+		for (size_t i = 0; i < commands.size();)
+		{
+			BitmapPrivate *source = commands[i].source;
+			size_t j = i + 1;
+
+			while (j < commands.size() && commands[j].source == source)
+				++j;
+
+			if (source)
+			{
+				SimpleShader &shader = shState->shaders().simple;
+				shader.bind();
+				shader.applyViewportProj();
+				shader.setTranslation(Vec2i());
+
+				TEXFBO &tex = source->texture();
+				shader.setTexSize(Vec2i(tex.width, tex.height));
+				shader.setTexOffset(source->origin());
+
+				TEX::bind(tex.tex);
+			}
+			else
+			{
+				SimpleColorShader &shader = shState->shaders().simpleColor;
+				shader.bind();
+				shader.applyViewportProj();
+				shader.setTranslation(Vec2i());
+			}
+
+			qArray.draw(i, j - i);
+			i = j;
+		}
+
+		glState.viewport.pop();
+		glState.blend.pop();
+
+		discardCommands();
+	}
+
+	void flush()
+	{
+		flushCommands();
+		flushPixels();
+
+		prepareCon.disconnect();
+	}
+
+	/* Call before changing the texture contents. Bitmaps
+	 * holding recorded blits from us need the old contents.
+	 * Our own pending work has to land first, except for
+	 * recorded commands when the change is recorded too */
+	void prepareModify(bool deferred = false)
+	{
+		flushDependents();
+		leaveAtlas();
+
+		if (deferred)
+			flushPixels();
+		else
+			flush();
+	}
+
+	void readTile(int tx, int ty)
+	{
+		static uint8_t buffer[READBACK_TILE*READBACK_TILE*4];
+
+		IntRect area = tileRect(tx, ty, tx+1, ty+1);
+
+		flushCommands();
+
+		Vec2i orig = origin();
+
+		FBO::bind(texture().fbo);
+		::gl.ReadPixels(area.x + orig.x, area.y + orig.y, area.w, area.h,
+		                GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+
+		storePixels(area, buffer);
+		tileValid[ty*tilesX+tx] = true;
+	}
+
+	void discardRead(PendingRead &read)
+	{
+		::gl.DeleteSync(read.fence);
+		PackPBO::del(read.pbo);
+	}
+
+	/* If a prefetch covers tile (tx, ty), waits for it to land
+	 * (usually it already has) and stores its whole area */
+	bool resolveRead(int tx, int ty)
+	{
+		IntRect tile = tileRect(tx, ty, tx+1, ty+1);
+
+		for (size_t i = 0; i < pendingReads.size(); ++i)
+		{
+			PendingRead &read = pendingReads[i];
+
+			if (!SDL_HasIntersection(&read.area, &tile))
+				continue;
+
+			::gl.ClientWaitSync(read.fence, GL_SYNC_FLUSH_COMMANDS_BIT, (uint64_t) -1);
+
+			PackPBO::bind(read.pbo);
+			void *data = ::gl.MapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+			                                 read.area.w * read.area.h * 4,
+			                                 GL_MAP_READ_BIT);
+
+			bool success = data != 0;
+
+			if (success)
+			{
+				storePixels(read.area, static_cast<const uint8_t*>(data));
+				::gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+				int tx1, ty1, tx2, ty2;
+				tileRange(read.area, tx1, ty1, tx2, ty2);
+				setTilesValid(tx1, ty1, tx2, ty2, true);
+			}
+
+			PackPBO::unbind();
+
+			discardRead(read);
+			pendingReads.erase(pendingReads.begin() + i);
+
+			return success;
+		}
+
+		return false;
+	}
+
+	void invalidateTiles(const IntRect &rect)
+	{
+		if (!surface)
+			return;
+
+		int tx1, ty1, tx2, ty2;
+
+		if (!tileRange(rect, tx1, ty1, tx2, ty2))
+			return;
+
+		setTilesValid(tx1, ty1, tx2, ty2, false);
+
+		/* Readbacks in flight for this area are stale now */
+		IntRect area = tileRect(tx1, ty1, tx2, ty2);
+
+		for (size_t i = 0; i < pendingReads.size();)
+		{
+			if (SDL_HasIntersection(&pendingReads[i].area, &area))
+			{
+				discardRead(pendingReads[i]);
+				pendingReads.erase(pendingReads.begin() + i);
+			}
+			else
+			{
+				++i;
+			}
+		}
 	}
 
 	void clearTaintedArea()
@@ -168,18 +681,27 @@ struct BitmapPrivate
 
 	void bindTexture(ShaderBase &shader)
 	{
-		TEX::bind(gl.tex);
-		shader.setTexSize(Vec2i(gl.width, gl.height));
+		flush();
+
+		TEXFBO &tex = texture();
+
+		TEX::bind(tex.tex);
+		shader.setTexSize(Vec2i(tex.width, tex.height));
+		shader.setTexOffset(origin());
 	}
 
 	void bindFBO()
 	{
+		flush();
+
 		FBO::bind(gl.fbo);
 	}
 
+	/* Limited to the bitmap area; the texture padding
+	 * past it has to stay transparent */
 	void pushSetViewport(ShaderBase &shader) const
 	{
-		glState.viewport.pushSet(IntRect(0, 0, gl.width, gl.height));
+		glState.viewport.pushSet(IntRect(0, 0, width, height));
 		shader.applyViewportProj();
 	}
 
@@ -188,6 +710,20 @@ struct BitmapPrivate
 		glState.viewport.pop();
 	}
 
+	/* Same for GLMeta blits into 'gl', which
+	 * aren't affected by the viewport */
+	void pushClip() const
+	{
+		glState.scissorTest.pushSet(true);
+		glState.scissorBox.pushSet(IntRect(0, 0, width, height));
+	}
+
+	void popClip() const
+	{
+		glState.scissorBox.pop();
+		glState.scissorTest.pop();
+	}
+
 	void blitQuad(Quad &quad)
 	{
 		glState.blend.pushSet(false);
@@ -195,20 +731,79 @@ struct BitmapPrivate
 		glState.blend.pop();
 	}
 
-	void fillRect(const IntRect &rect,
-	              const Vec4 &color)
+	/* Blends 'srcRect' of 'src' onto 'destRect' through
+	 * the fragment pipeline. Pending work on 'src' has to
+	 * be flushed already */
+	void blendBlit(const TEXFBO &src, const IntRect &srcRect,
+	               const IntRect &destRect, int opacity)
 	{
+		float normOpacity = (float) opacity / 255.0f;
+
+		TEXFBO &gpTex = shState->gpTexFBO(destRect.w, destRect.h);
+
+		GLMeta::blitBegin(gpTex);
+		GLMeta::blitSource(gl);
+		GLMeta::blitRectangle(destRect, Vec2i());
+		GLMeta::blitEnd();
+
+		FloatRect bltSubRect((float) srcRect.x / src.width,
+		                     (float) srcRect.y / src.height,
+		                     ((float) src.width / srcRect.w) * ((float) destRect.w / gpTex.width),
+		                     ((float) src.height / srcRect.h) * ((float) destRect.h / gpTex.height));
+
+		BltShader &shader = shState->shaders().blt;
+		shader.bind();
+		shader.setDestination(gpTex.tex);
+		shader.setSubRect(bltSubRect);
+		shader.setOpacity(normOpacity);
+
+		Quad &quad = shState->gpQuad();
+		quad.setTexPosRect(srcRect, destRect);
+		quad.setColor(Vec4(1, 1, 1, normOpacity));
+
+		TEX::bind(src.tex);
+		shader.setTexSize(Vec2i(src.width, src.height));
+
 		bindFBO();
+		pushSetViewport(shader);
 
-		glState.scissorTest.pushSet(true);
-		glState.scissorBox.pushSet(normalizedRect(rect));
-		glState.clearColor.pushSet(color);
+		blitQuad(quad);
 
-		FBO::clear();
+		popViewport();
+	}
 
-		glState.clearColor.pop();
-		glState.scissorBox.pop();
-		glState.scissorTest.pop();
+	/* Copies the bitmap into a scratch texture, repeating its
+	 * last column and row once past the edges. Filters sampling
+	 * there see the same as with clamp-to-edge on an exact size
+	 * texture, instead of the padding of a pooled one */
+	TEXFBO edgeCopy()
+	{
+		TEXFBO tex = shState->texPool().request(width + 1, height + 1);
+
+		GLMeta::blitBegin(tex);
+		GLMeta::blitSource(gl);
+		GLMeta::blitRectangle(IntRect(0, 0, width, height), Vec2i());
+		GLMeta::blitRectangle(IntRect(width - 1, 0, 1, height), Vec2i(width, 0));
+		GLMeta::blitRectangle(IntRect(0, height - 1, width, 1), Vec2i(0, height));
+		GLMeta::blitRectangle(IntRect(width - 1, height - 1, 1, 1), Vec2i(width, height));
+		GLMeta::blitEnd();
+
+		return tex;
+	}
+
+	/* Reads 'area' of the texture back into 'out',
+	 * rows tightly packed */
+	void readPixels(const IntRect &area, std::vector<uint32_t> &out)
+	{
+		flush();
+
+		out.resize(area.w * area.h);
+
+		Vec2i orig = origin();
+
+		FBO::bind(texture().fbo);
+		::gl.ReadPixels(area.x + orig.x, area.y + orig.y, area.w, area.h,
+		                GL_RGBA, GL_UNSIGNED_BYTE, &out[0]);
 	}
 
 	static void ensureFormat(SDL_Surface *&surf, Uint32 format)
@@ -221,30 +816,111 @@ struct BitmapPrivate
 		surf = surfConv;
 	}
 
-	void onModified()
+	int megaTileSize() const
 	{
-		if (surface)
+		return std::min(glState.caps.maxTexSize, MEGA_TILE_MAX);
+	}
+
+	int megaTilesX() const
+	{
+		int size = megaTileSize();
+
+		return (megaSurface->w + size - 1) / size;
+	}
+
+	int megaTileCount() const
+	{
+		int size = megaTileSize();
+
+		return megaTilesX() * ((megaSurface->h + size - 1) / size);
+	}
+
+	IntRect megaTileRect(int i) const
+	{
+		int size = megaTileSize();
+		int x = (i % megaTilesX()) * size;
+		int y = (i / megaTilesX()) * size;
+
+		return IntRect(x, y,
+		               std::min(size, megaSurface->w - x),
+		               std::min(size, megaSurface->h - y));
+	}
+
+	void staleMegaTiles(const IntRect &area)
+	{
+		IntRect norm = normalizedRect(area);
+
+		for (size_t i = 0; i < megaTiles.size(); ++i)
 		{
-			SDL_FreeSurface(surface);
-			surface = 0;
+			IntRect tile = megaTileRect(i);
+
+			if (SDL_HasIntersection(&norm, &tile))
+				megaTileStale[i] = true;
+		}
+	}
+
+	TEXFBO &ensureMegaTile(int i)
+	{
+		if (megaTiles.empty())
+		{
+			megaTiles.resize(megaTileCount());
+			megaTileStale.resize(megaTileCount(), true);
 		}
 
+		TEXFBO &tile = megaTiles[i];
+		IntRect rect = megaTileRect(i);
+
+		if (tile.tex == TEX::ID(0))
+			tile = shState->texPool().request(rect.w, rect.h);
+		else if (!megaTileStale[i])
+			return tile;
+
+		const uint8_t *pixels = static_cast<const uint8_t*>(megaSurface->pixels)
+			+ rect.y * megaSurface->pitch + rect.x * 4;
+
+		TEX::bind(tile.tex);
+		GLMeta::texSubImage(0, 0, rect.w, rect.h, pixels, megaSurface->pitch, GL_RGBA);
+
+		megaTileStale[i] = false;
+
+		return tile;
+	}
+
+	void onModified(const IntRect &area)
+	{
+		if (megaSurface)
+			staleMegaTiles(area);
+		else
+			invalidateTiles(area);
+
+		modStamp = shState->genModStamp();
 		self->modified();
 	}
+
+	void onModified()
+	{
+		onModified(self->rect());
+	}
 };
 
 Bitmap::Bitmap(const char *filename)
 {
-	SDL_RWops ops;
-	const char *extension;
-	shState->fileSystem().openRead(ops, filename, FileSystem::Image, false, &extension);
-	SDL_Surface *imgSurf = IMG_LoadTyped_RW(&ops, 1, extension);
+	SDL_Surface *imgSurf;
+
+	/* Preloaded images arrive already decoded and converted */
+	if (!shState->imageDecoder().take(filename, imgSurf))
+	{
+		SDL_RWops ops;
+		const char *extension;
+		shState->fileSystem().openRead(ops, filename, FileSystem::Image, false, &extension);
+		imgSurf = IMG_LoadTyped_RW(&ops, 1, extension);
 
-	if (!imgSurf)
-		throw Exception(Exception::SDLError, "Error loading image '%s': %s",
-		                filename, SDL_GetError());
+		if (!imgSurf)
+			throw Exception(Exception::SDLError, "Error loading image '%s': %s",
+			                filename, SDL_GetError());
 
-	p->ensureFormat(imgSurf, SDL_PIXELFORMAT_ABGR8888);
+		p->ensureFormat(imgSurf, SDL_PIXELFORMAT_ABGR8888);
+	}
 
 	if (imgSurf->w > glState.caps.maxTexSize || imgSurf->h > glState.caps.maxTexSize)
 	{
@@ -252,6 +928,16 @@ Bitmap::Bitmap(const char *filename)
 		p = new BitmapPrivate(this);
 		p->megaSurface = imgSurf;
 	}
+	else if (AtlasEntry *entry = shState->bitmapAtlas().add(imgSurf))
+	{
+		/* Small surface, shares a texture with others */
+		p = new BitmapPrivate(this);
+		p->atlas = entry;
+		p->width = imgSurf->w;
+		p->height = imgSurf->h;
+
+		SDL_FreeSurface(imgSurf);
+	}
 	else
 	{
 		/* Regular surface */
@@ -259,7 +945,7 @@ Bitmap::Bitmap(const char *filename)
 
 		try
 		{
-			tex = shState->texPool().request(imgSurf->w, imgSurf->h);
+			tex = requestTex(imgSurf->w, imgSurf->h);
 		}
 		catch (const Exception &e)
 		{
@@ -269,9 +955,12 @@ Bitmap::Bitmap(const char *filename)
 
 		p = new BitmapPrivate(this);
 		p->gl = tex;
+		p->width = imgSurf->w;
+		p->height = imgSurf->h;
 
 		TEX::bind(p->gl.tex);
-		TEX::uploadImage(p->gl.width, p->gl.height, imgSurf->pixels, GL_RGBA);
+		GLMeta::texSubImage(0, 0, imgSurf->w, imgSurf->h,
+		                    imgSurf->pixels, imgSurf->pitch, GL_RGBA);
 
 		SDL_FreeSurface(imgSurf);
 	}
@@ -284,21 +973,42 @@ Bitmap::Bitmap(int width, int height)
 	if (width <= 0 || height <= 0)
 		throw Exception(Exception::RGSSError, "failed to create bitmap");
 
-	TEXFBO tex = shState->texPool().request(width, height);
+	TEXFBO tex = requestTex(width, height);
 
 	p = new BitmapPrivate(this);
 	p->gl = tex;
+	p->width = width;
+	p->height = height;
 
 	clear();
 }
 
 Bitmap::Bitmap(const Bitmap &other)
 {
-	other.ensureNonMega();
+	if (other.megaSurface())
+	{
+		SDL_Surface *surf = other.megaSurface();
+
+		p = new BitmapPrivate(this);
+		p->megaSurface = SDL_ConvertSurface(surf, surf->format, 0);
+
+		if (!p->megaSurface)
+		{
+			delete p;
+			throw Exception(Exception::SDLError, "Error copying mega surface: %s",
+			                SDL_GetError());
+		}
+
+		p->addTaintedArea(rect());
+
+		return;
+	}
 
 	p = new BitmapPrivate(this);
 
-	p->gl = shState->texPool().request(other.width(), other.height());
+	p->gl = requestTex(other.width(), other.height());
+	p->width = other.width();
+	p->height = other.height();
 
 	blt(0, 0, other, rect());
 }
@@ -315,7 +1025,7 @@ int Bitmap::width() const
 	if (p->megaSurface)
 		return p->megaSurface->w;
 
-	return p->gl.width;
+	return p->width;
 }
 
 int Bitmap::height() const
@@ -325,7 +1035,7 @@ int Bitmap::height() const
 	if (p->megaSurface)
 		return p->megaSurface->h;
 
-	return p->gl.height;
+	return p->height;
 }
 
 IntRect Bitmap::rect() const
@@ -364,8 +1074,6 @@ void Bitmap::stretchBlt(const IntRect &destRect,
 {
 	guardDisposed();
 
-	GUARD_MEGA;
-
 	if (source.isDisposed())
 		return;
 
@@ -374,102 +1082,139 @@ void Bitmap::stretchBlt(const IntRect &destRect,
 	if (opacity == 0)
 		return;
 
-	if (source.megaSurface())
+	if (p->megaSurface)
 	{
-		/* Don't do transparent blits for now */
-		if (opacity < 255)
-			source.ensureNonMega();
+		/* Mega surfaces are drawn onto entirely on the CPU */
+		SurfaceOps::PixelBuffer dst(p->megaSurface);
 
-		SDL_Surface *srcSurf = source.megaSurface();
+		if (source.megaSurface())
+		{
+			SurfaceOps::blend(SurfaceOps::PixelBuffer(source.megaSurface()),
+			                  sourceRect, dst, destRect, opacity);
+		}
+		else
+		{
+			/* Only read back what the blit samples from */
+			IntRect srcNorm = normalizedRect(sourceRect);
+			SDL_Rect srcBounds = { 0, 0, source.width(), source.height() };
+			IntRect area;
 
-		SDL_Rect srcRect = sourceRect;
-		SDL_Rect dstRect = destRect;
+			if (SDL_IntersectRect(&srcBounds, &srcNorm, &area) != SDL_TRUE)
+				return;
+
+			std::vector<uint32_t> pixels;
+			source.p->readPixels(area, pixels);
+
+			IntRect srcRect = sourceRect;
+			srcRect.x -= area.x;
+			srcRect.y -= area.y;
+
+			SurfaceOps::blend(SurfaceOps::PixelBuffer(&pixels[0], area.w, area.h, area.w*4),
+			                  srcRect, dst, destRect, opacity);
+		}
+
+		p->addTaintedArea(destRect);
+		p->onModified(destRect);
+
+		return;
+	}
+
+	if (source.megaSurface())
+	{
 		SDL_Rect btmRect = { 0, 0, width(), height() };
-		SDL_Rect bltRect;
+		IntRect bltRect;
 
-		if (SDL_IntersectRect(&btmRect, &dstRect, &bltRect) != SDL_TRUE)
+		if (destRect.w <= 0 || destRect.h <= 0 ||
+		    SDL_IntersectRect(&btmRect, &destRect, &bltRect) != SDL_TRUE)
 			return;
 
-		int bpp;
-		Uint32 rMask, gMask, bMask, aMask;
-		SDL_PixelFormatEnumToMasks(SDL_PIXELFORMAT_ABGR8888,
-		                           &bpp, &rMask, &gMask, &bMask, &aMask);
-		SDL_Surface *blitTemp =
-			SDL_CreateRGBSurface(0, destRect.w, destRect.h, bpp, rMask, gMask, bMask, aMask);
+		/* Scale the visible part on the CPU; only that
+		 * much ever needs to fit into a texture */
+		std::vector<uint32_t> pixels(bltRect.w * bltRect.h);
+		SurfaceOps::PixelBuffer scaled(&pixels[0], bltRect.w, bltRect.h, bltRect.w*4);
 
-		// FXIME: This is supposed to be a scaled blit, put SDL2 for some reason
-		// makes the source surface unusable after BlitScaled() is called. Investigate!
-		SDL_BlitSurface(srcSurf, &srcRect, blitTemp, 0);
+		SurfaceOps::scaledCopy(SurfaceOps::PixelBuffer(source.megaSurface()), sourceRect, scaled,
+		                       IntRect(destRect.x - bltRect.x, destRect.y - bltRect.y,
+		                               destRect.w, destRect.h));
 
-		TEX::bind(p->gl.tex);
+		p->prepareModify();
 
-		if (bltRect.w == dstRect.w && bltRect.h == dstRect.h)
+		if (opacity == 255 && !p->touchesTaintedArea(bltRect))
 		{
-			TEX::uploadSubImage(destRect.x, destRect.y,
-			                    destRect.w, destRect.h,
-			                    blitTemp->pixels, GL_RGBA);
+			TEX::bind(p->gl.tex);
+			GLMeta::texSubImage(bltRect.x, bltRect.y, bltRect.w, bltRect.h,
+			                    &pixels[0], bltRect.w*4, GL_RGBA);
 		}
 		else
 		{
-			GLMeta::subRectImageUpload(blitTemp->w, bltRect.x - dstRect.x, bltRect.y - dstRect.y,
-			                           bltRect.x, bltRect.y, bltRect.w, bltRect.h, blitTemp, GL_RGBA);
-			GLMeta::subRectImageEnd();
-		}
+			TEXFBO tmp = shState->texPool().request(bltRect.w, bltRect.h);
 
+			TEX::bind(tmp.tex);
+			GLMeta::texSubImage(0, 0, bltRect.w, bltRect.h,
+			                    &pixels[0], bltRect.w*4, GL_RGBA);
 
-		SDL_FreeSurface(blitTemp);
+			p->blendBlit(tmp, IntRect(0, 0, bltRect.w, bltRect.h), bltRect, opacity);
 
-		p->onModified();
-		return;
-	}
+			shState->texPool().release(tmp);
+		}
 
-	if (opacity == 255 && !p->touchesTaintedArea(destRect))
-	{
-		/* Fast blit */
-		GLMeta::blitBegin(p->gl);
-		GLMeta::blitSource(source.p->gl);
-		GLMeta::blitRectangle(sourceRect, destRect);
-		GLMeta::blitEnd();
-	}
-	else
-	{
-		/* Fragment pipeline */
-		float normOpacity = (float) opacity / 255.0f;
+		p->addTaintedArea(bltRect);
+		p->onModified(bltRect);
 
-		TEXFBO &gpTex = shState->gpTexFBO(destRect.w, destRect.h);
+		return;
+	}
 
-		GLMeta::blitBegin(gpTex);
-		GLMeta::blitSource(p->gl);
-		GLMeta::blitRectangle(destRect, Vec2i());
-		GLMeta::blitEnd();
+	/* Whatever is pending on the source has to be
+	 * in the texture before we read from it */
+	source.p->flush();
 
-		FloatRect bltSubRect((float) sourceRect.x / source.width(),
-		                     (float) sourceRect.y / source.height(),
-		                     ((float) source.width() / sourceRect.w) * ((float) destRect.w / gpTex.width),
-		                     ((float) source.height() / sourceRect.h) * ((float) destRect.h / gpTex.height));
+	/* Sampling outside of an atlased image would pick
+	 * up its neighbours, so such blits need a copy */
+	if (source.p->atlas)
+	{
+		IntRect srcNorm = normalizedRect(sourceRect);
+		IntRect srcBounds = source.rect();
+		IntRect inside;
 
-		BltShader &shader = shState->shaders().blt;
-		shader.bind();
-		shader.setDestination(gpTex.tex);
-		shader.setSubRect(bltSubRect);
-		shader.setOpacity(normOpacity);
+		if (SDL_IntersectRect(&srcNorm, &srcBounds, &inside) != SDL_TRUE ||
+		    !(inside == srcNorm))
+			source.p->leaveAtlas();
+	}
 
-		Quad &quad = shState->gpQuad();
-		quad.setTexPosRect(sourceRect, destRect);
-		quad.setColor(Vec4(1, 1, 1, normOpacity));
+	if (opacity == 255 && !p->touchesTaintedArea(destRect) && source.p != p)
+	{
+		/* Fast blit, recorded for batching */
+		p->prepareModify(true);
+		p->queueBlit(source.p, sourceRect, destRect);
+	}
+	else if (opacity == 255 && !p->touchesTaintedArea(destRect))
+	{
+		/* Fast blit onto ourselves */
+		p->prepareModify();
+		p->pushClip();
 
-		source.p->bindTexture(shader);
-		p->bindFBO();
-		p->pushSetViewport(shader);
+		GLMeta::blitBegin(p->gl);
+		GLMeta::blitSource(source.p->gl);
+		GLMeta::blitRectangle(sourceRect, destRect);
+		GLMeta::blitEnd();
 
-		p->blitQuad(quad);
+		p->popClip();
+	}
+	else
+	{
+		/* Fragment pipeline */
+		p->prepareModify();
 
-		p->popViewport();
+		IntRect srcRect = sourceRect;
+		srcRect.x += source.p->origin().x;
+		srcRect.y += source.p->origin().y;
+
+		p->blendBlit(source.p->texture(), srcRect, destRect, opacity);
 	}
 
 	p->addTaintedArea(destRect);
 
-	p->onModified();
+	p->onModified(destRect);
 }
 
 void Bitmap::fillRect(int x, int y,
@@ -483,9 +1228,16 @@ void Bitmap::fillRect(const IntRect &rect, const Vec4 &color)
 {
 	guardDisposed();
 
-	GUARD_MEGA;
-
-	p->fillRect(rect, color);
+	if (p->megaSurface)
+	{
+		SurfaceOps::PixelBuffer buf(p->megaSurface);
+		SurfaceOps::fill(buf, normalizedRect(rect), SurfaceOps::packColor(color));
+	}
+	else
+	{
+		p->prepareModify(true);
+		p->queueFill(rect, color, color, false);
+	}
 
 	if (color.w == 0)
 		/* Clear op */
@@ -494,7 +1246,7 @@ void Bitmap::fillRect(const IntRect &rect, const Vec4 &color)
 		/* Fill op */
 		p->addTaintedArea(rect);
 
-	p->onModified();
+	p->onModified(rect);
 }
 
 void Bitmap::gradientFillRect(int x, int y,
@@ -513,39 +1265,12 @@ void Bitmap::gradientFillRect(const IntRect &rect,
 
 	GUARD_MEGA;
 
-	SimpleColorShader &shader = shState->shaders().simpleColor;
-	shader.bind();
-	shader.setTranslation(Vec2i());
-
-	Quad &quad = shState->gpQuad();
-
-	if (vertical)
-	{
-		quad.vert[0].color = color1;
-		quad.vert[1].color = color1;
-		quad.vert[2].color = color2;
-		quad.vert[3].color = color2;
-	}
-	else
-	{
-		quad.vert[0].color = color1;
-		quad.vert[3].color = color1;
-		quad.vert[1].color = color2;
-		quad.vert[2].color = color2;
-	}
-
-	quad.setPosRect(rect);
-
-	p->bindFBO();
-	p->pushSetViewport(shader);
-
-	p->blitQuad(quad);
-
-	p->popViewport();
+	p->prepareModify(true);
+	p->queueFill(rect, color1, color2, vertical);
 
 	p->addTaintedArea(rect);
 
-	p->onModified();
+	p->onModified(rect);
 }
 
 void Bitmap::clearRect(int x, int y, int width, int height)
@@ -557,11 +1282,18 @@ void Bitmap::clearRect(const IntRect &rect)
 {
 	guardDisposed();
 
-	GUARD_MEGA;
-
-	p->fillRect(rect, Vec4());
+	if (p->megaSurface)
+	{
+		SurfaceOps::PixelBuffer buf(p->megaSurface);
+		SurfaceOps::fill(buf, normalizedRect(rect), 0);
+	}
+	else
+	{
+		p->prepareModify(true);
+		p->queueFill(rect, Vec4(), Vec4(), false);
+	}
 
-	p->onModified();
+	p->onModified(rect);
 }
 
 void Bitmap::blur()
@@ -570,41 +1302,55 @@ void Bitmap::blur()
 
 	GUARD_MEGA;
 
-	Quad &quad = shState->gpQuad();
-	FloatRect rect(0, 0, width(), height());
-	quad.setTexPosRect(rect, rect);
+	p->prepareModify();
+
+	const int _width = width();
+	const int _height = height();
+
+	/* Pass 1 also covers the row below the bitmap,
+	 * so pass 2 finds the repeated edge there too */
+	TEXFBO srcTex = p->edgeCopy();
+	TEXFBO auxTex = shState->texPool().request(_width, _height + 1);
 
-	TEXFBO auxTex = shState->texPool().request(width(), height());
+	Quad &quad = shState->gpQuad();
+	FloatRect auxRect(0, 0, _width, _height + 1);
+	quad.setTexPosRect(auxRect, auxRect);
 
 	BlurShader &shader = shState->shaders().blur;
 	BlurShader::HPass &pass1 = shader.pass1;
 	BlurShader::VPass &pass2 = shader.pass2;
 
 	glState.blend.pushSet(false);
-	glState.viewport.pushSet(IntRect(0, 0, width(), height()));
+	glState.viewport.pushSet(IntRect(0, 0, _width, _height + 1));
 
-	TEX::bind(p->gl.tex);
+	TEX::bind(srcTex.tex);
 	FBO::bind(auxTex.fbo);
 
 	pass1.bind();
-	pass1.setTexSize(Vec2i(width(), height()));
+	pass1.setTexSize(Vec2i(srcTex.width, srcTex.height));
 	pass1.applyViewportProj();
 
 	quad.draw();
 
+	glState.viewport.pop();
+
+	FloatRect rect(0, 0, _width, _height);
+	quad.setTexPosRect(rect, rect);
+
 	TEX::bind(auxTex.tex);
 	p->bindFBO();
 
 	pass2.bind();
-	pass2.setTexSize(Vec2i(width(), height()));
-	pass2.applyViewportProj();
+	pass2.setTexSize(Vec2i(auxTex.width, auxTex.height));
+	p->pushSetViewport(pass2);
 
 	quad.draw();
 
-	glState.viewport.pop();
+	p->popViewport();
 	glState.blend.pop();
 
 	shState->texPool().release(auxTex);
+	shState->texPool().release(srcTex);
 
 	p->onModified();
 }
@@ -615,6 +1361,8 @@ void Bitmap::radialBlur(int angle, int divisions)
 
 	GUARD_MEGA;
 
+	p->prepareModify();
+
 	angle     = clamp<int>(angle, 0, 359);
 	divisions = clamp<int>(divisions, 2, 100);
 
@@ -663,6 +1411,8 @@ void Bitmap::radialBlur(int angle, int divisions)
 
 	qArray.commit();
 
+	/* Filtered sampling reaches past the edges */
+	TEXFBO srcTex = p->edgeCopy();
 	TEXFBO newTex = shState->texPool().request(_width, _height);
 
 	FBO::bind(newTex.fbo);
@@ -679,7 +1429,8 @@ void Bitmap::radialBlur(int angle, int divisions)
 	SimpleMatrixShader &shader = shState->shaders().simpleMatrix;
 	shader.bind();
 
-	p->bindTexture(shader);
+	TEX::bind(srcTex.tex);
+	shader.setTexSize(Vec2i(srcTex.width, srcTex.height));
 	TEX::setSmooth(true);
 
 	p->pushSetViewport(shader);
@@ -698,6 +1449,7 @@ void Bitmap::radialBlur(int angle, int divisions)
 	glState.blendMode.pop();
 	glState.clearColor.pop();
 
+	shState->texPool().release(srcTex);
 	shState->texPool().release(p->gl);
 	p->gl = newTex;
 
@@ -708,15 +1460,23 @@ void Bitmap::clear()
 {
 	guardDisposed();
 
-	GUARD_MEGA;
+	if (p->megaSurface)
+	{
+		SurfaceOps::PixelBuffer buf(p->megaSurface);
+		SurfaceOps::fill(buf, rect(), 0);
+	}
+	else
+	{
+		p->prepareModify();
 
-	p->bindFBO();
+		p->bindFBO();
 
-	glState.clearColor.pushSet(Vec4());
+		glState.clearColor.pushSet(Vec4());
 
-	FBO::clear();
+		FBO::clear();
 
-	glState.clearColor.pop();
+		glState.clearColor.pop();
+	}
 
 	p->clearTaintedArea();
 
@@ -727,26 +1487,22 @@ Color Bitmap::getPixel(int x, int y) const
 {
 	guardDisposed();
 
-	GUARD_MEGA;
-
 	if (x < 0 || y < 0 || x >= width() || y >= height())
 		return Vec4();
 
-	if (!p->surface)
-	{
-		p->allocSurface();
-
-		FBO::bind(p->gl.fbo);
-
-		glState.viewport.pushSet(IntRect(0, 0, width(), height()));
+	SDL_Surface *surf = p->megaSurface;
 
-		gl.ReadPixels(0, 0, width(), height(), GL_RGBA, GL_UNSIGNED_BYTE, p->surface->pixels);
+	if (!surf)
+	{
+		if (!p->surface)
+			p->allocSurface();
 
-		glState.viewport.pop();
+		p->ensureTile(x / READBACK_TILE, y / READBACK_TILE);
+		surf = p->surface;
 	}
 
-	size_t offset = x*p->format->BytesPerPixel + y*p->surface->pitch;
-	uint8_t *bytes = (uint8_t*) p->surface->pixels + offset;
+	size_t offset = x*p->format->BytesPerPixel + y*surf->pitch;
+	uint8_t *bytes = (uint8_t*) surf->pixels + offset;
 	uint32_t pixel = *((uint32_t*) bytes);
 
 	return Color((pixel >> p->format->Rshift) & 0xFF,
@@ -755,38 +1511,117 @@ Color Bitmap::getPixel(int x, int y) const
 	             (pixel >> p->format->Ashift) & 0xFF);
 }
 
+void Bitmap::prefetchPixels(const IntRect &rect) const
+{
+	guardDisposed();
+
+	/* Mega surfaces are client side to begin with; the
+	 * rest needs the same entrypoints as the upload ring */
+	if (p->megaSurface || !gl.MapBufferRange)
+		return;
+
+	if (!p->surface)
+		p->allocSurface();
+
+	int tx1, ty1, tx2, ty2;
+
+	if (!p->tileRange(rect, tx1, ty1, tx2, ty2))
+		return;
+
+	bool stale = false;
+
+	for (int ty = ty1; ty < ty2 && !stale; ++ty)
+		for (int tx = tx1; tx < tx2 && !stale; ++tx)
+			stale = !p->tileValid[ty*p->tilesX+tx];
+
+	if (!stale)
+		return;
+
+	/* The readback has to include pending work */
+	p->flush();
+
+	PendingRead read;
+	read.area = p->tileRect(tx1, ty1, tx2, ty2);
+
+	/* A newer request for the same tiles supersedes older ones */
+	p->invalidateTiles(read.area);
+
+	read.pbo = PackPBO::gen();
+	PackPBO::bind(read.pbo);
+	PackPBO::allocEmpty(read.area.w * read.area.h * 4, GL_STREAM_READ);
+
+	Vec2i orig = p->origin();
+
+	FBO::bind(p->texture().fbo);
+	gl.ReadPixels(read.area.x + orig.x, read.area.y + orig.y, read.area.w, read.area.h,
+	              GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+	PackPBO::unbind();
+
+	read.fence = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	p->pendingReads.push_back(read);
+}
+
 void Bitmap::setPixel(int x, int y, const Color &color)
 {
 	guardDisposed();
 
-	GUARD_MEGA;
+	if (x < 0 || y < 0 || x >= width() || y >= height())
+		return;
 
-	uint8_t pixel[] =
+	SDL_Surface *surf = p->megaSurface;
+
+	if (!surf)
 	{
-		(uint8_t) clamp<double>(color.red,   0, 255),
-		(uint8_t) clamp<double>(color.green, 0, 255),
-		(uint8_t) clamp<double>(color.blue,  0, 255),
-		(uint8_t) clamp<double>(color.alpha, 0, 255)
-	};
+		p->flushDependents();
+		p->leaveAtlas();
+
+		if (!p->surface)
+			p->allocSurface();
+
+		p->ensureTile(x / READBACK_TILE, y / READBACK_TILE);
+		surf = p->surface;
+	}
 
-	TEX::bind(p->gl.tex);
-	TEX::uploadSubImage(x, y, 1, 1, &pixel, GL_RGBA);
+	uint8_t *pixel = static_cast<uint8_t*>(surf->pixels)
+		+ y * surf->pitch + x * 4;
+
+	pixel[0] = clamp<double>(color.red,   0, 255);
+	pixel[1] = clamp<double>(color.green, 0, 255);
+	pixel[2] = clamp<double>(color.blue,  0, 255);
+	pixel[3] = clamp<double>(color.alpha, 0, 255);
+
+	if (!p->megaSurface)
+		p->markDirty(x, y);
 
 	p->addTaintedArea(IntRect(x, y, 1, 1));
 
-	p->onModified();
+	/* The shadow copy stays valid, so don't invalidate */
+	p->modStamp = shState->genModStamp();
+	modified();
 }
 
 void Bitmap::hueChange(int hue)
 {
 	guardDisposed();
 
-	GUARD_MEGA;
-
 	if ((hue % 360) == 0)
 		return;
 
-	TEXFBO newTex = shState->texPool().request(width(), height());
+	if (p->megaSurface)
+	{
+		SurfaceOps::PixelBuffer buf(p->megaSurface);
+		SurfaceOps::hueChange(buf, wrapRange(hue, 0, 359));
+
+		p->onModified();
+
+		return;
+	}
+
+	p->prepareModify();
+
+	TEXFBO newTex = requestTex(width(), height());
 
 	FloatRect texRect(rect());
 
@@ -840,93 +1675,6 @@ static std::string fixupString(const char *str)
 	return s;
 }
 
-static void applyShadow(SDL_Surface *&in, const SDL_PixelFormat &fm, const SDL_Color &c)
-{
-	SDL_Surface *out = SDL_CreateRGBSurface
-		(0, in->w+1, in->h+1, fm.BitsPerPixel, fm.Rmask, fm.Gmask, fm.Bmask, fm.Amask);
-
-	float fr = c.r / 255.0;
-	float fg = c.g / 255.0;
-	float fb = c.b / 255.0;
-
-	/* We allocate an output surface one pixel wider and higher than the input,
-	 * (implicitly) blit a copy of the input with RGB values set to black into
-	 * it with x/y offset by 1, then blend the input surface over it at origin
-	 * (0,0) using the bitmap blit equation (see shader/bitmapBlit.frag) */
-
-	for (int y = 0; y < in->h+1; ++y)
-		for (int x = 0; x < in->w+1; ++x)
-		{
-			/* src: input pixel, shd: shadow pixel */
-			uint32_t src = 0, shd = 0;
-
-			/* Output pixel location */
-			uint32_t *outP = ((uint32_t*) ((uint8_t*) out->pixels + y*out->pitch)) + x;
-
-			if (y < in->h && x < in->w)
-				src = ((uint32_t*) ((uint8_t*) in->pixels + y*in->pitch))[x];
-
-			if (y > 0 && x > 0)
-				shd = ((uint32_t*) ((uint8_t*) in->pixels + (y-1)*in->pitch))[x-1];
-
-			/* Set shadow pixel RGB values to 0 (black) */
-			shd &= fm.Amask;
-
-			if (x == 0 || y == 0)
-			{
-				*outP = src;
-				continue;
-			}
-
-			if (x == in->w || y == in->h)
-			{
-				*outP = shd;
-				continue;
-			}
-
-			/* Input and shadow alpha values */
-			uint8_t srcA, shdA;
-			srcA = (src & fm.Amask) >> fm.Ashift;
-			shdA = (shd & fm.Amask) >> fm.Ashift;
-
-			if (srcA == 255 || shdA == 0)
-			{
-				*outP = src;
-				continue;
-			}
-
-			if (srcA == 0 && shdA == 0)
-			{
-				*outP = 0;
-				continue;
-			}
-
-			float fSrcA = srcA / 255.0;
-			float fShdA = shdA / 255.0;
-
-			/* Because opacity == 1, co1 == fSrcA */
-			float co2 = fShdA * (1.0 - fSrcA);
-			/* Result alpha */
-			float fa = fSrcA + co2;
-			/* Temp value to simplify arithmetic below */
-			float co3 = fSrcA / fa;
-
-			/* Result colors */
-			uint8_t r, g, b, a;
-
-			r = clamp<float>(fr * co3, 0, 1) * 255;
-			g = clamp<float>(fg * co3, 0, 1) * 255;
-			b = clamp<float>(fb * co3, 0, 1) * 255;
-			a = clamp<float>(fa, 0, 1) * 255;
-
-			*outP = SDL_MapRGBA(&fm, r, g, b, a);
-		}
-
-	/* Store new surface in the input pointer */
-	SDL_FreeSurface(in);
-	in = out;
-}
-
 void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 {
 	guardDisposed();
@@ -942,50 +1690,26 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 	if (str[0] == ' ' && str[1] == '\0')
 		return;
 
+	p->prepareModify();
+
 	TTF_Font *font = p->font->getSdlFont();
 	const Color &fontColor = p->font->getColor();
 	const Color &outColor = p->font->getOutColor();
 
-	SDL_Color c = fontColor.toSDLColor();
-	c.a = 255;
-
 	float txtAlpha = fontColor.norm.w;
 
-	SDL_Surface *txtSurf;
-
-	if (shState->rtData().config.solidFonts)
-		txtSurf = TTF_RenderUTF8_Solid(font, str, c);
-	else
-		txtSurf = TTF_RenderUTF8_Blended(font, str, c);
-
-	p->ensureFormat(txtSurf, SDL_PIXELFORMAT_ABGR8888);
-
-	if (p->font->getShadow())
-		applyShadow(txtSurf, *p->format, c);
-
-	/* outline using TTF_Outline and blending it together with SDL_BlitSurface
-	 * FIXME: outline is forced to have the same opacity as the font color */
-	if (p->font->getOutline()) {
-		SDL_Color co = outColor.toSDLColor();
-		co.a = 255;
-		SDL_Surface *outline;
-		/* set the next font render to render the outline */
-		TTF_SetFontOutline(font, OUTLINE_SIZE);
-		if (shState->rtData().config.solidFonts)
-			outline = TTF_RenderUTF8_Solid(font, str, co);
-		else
-			outline = TTF_RenderUTF8_Blended(font, str, co);
-
-		p->ensureFormat(outline, SDL_PIXELFORMAT_ABGR8888);
-		SDL_Rect outRect = {OUTLINE_SIZE, OUTLINE_SIZE, txtSurf->w, txtSurf->h}; 
-
-		SDL_SetSurfaceBlendMode(txtSurf, SDL_BLENDMODE_BLEND);
-		SDL_BlitSurface(txtSurf, NULL, outline, &outRect);
-		SDL_FreeSurface(txtSurf);
-		txtSurf = outline;
-		/* reset outline to 0 */
-		TTF_SetFontOutline(font, 0);
-	}
+	/* Glyphs are composed on the GPU; shadow and outline are
+	 * applied by the text shader. The outline is forced to have
+	 * the same opacity as the font color (FIXME) */
+	TEXFBO *txtTex;
+	Vec2i txtSize;
+
+	if (!shState->fontState().renderText(font, str,
+	                                     fontColor.norm, outColor.norm,
+	                                     p->font->getShadow(),
+	                                     p->font->getOutline(),
+	                                     txtTex, txtSize))
+		return;
 
 	int alignX = rect.x;
 
@@ -996,105 +1720,47 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 		break;
 
 	case Center :
-		alignX += (rect.w - txtSurf->w) / 2;
+		alignX += (rect.w - txtSize.x) / 2;
 		break;
 
 	case Right :
-		alignX += rect.w - txtSurf->w;
+		alignX += rect.w - txtSize.x;
 		break;
 	}
 
 	if (alignX < rect.x)
 		alignX = rect.x;
 
-	int alignY = rect.y + (rect.h - txtSurf->h) / 2;
+	int alignY = rect.y + (rect.h - txtSize.y) / 2;
 
-	float squeeze = (float) rect.w / txtSurf->w;
+	float squeeze = (float) rect.w / txtSize.x;
 
 	if (squeeze > 1)
 		squeeze = 1;
 
-	FloatRect posRect(alignX, alignY, txtSurf->w * squeeze, txtSurf->h);
-
-	Vec2i gpTexSize;
-	shState->ensureTexSize(txtSurf->w, txtSurf->h, gpTexSize);
+	FloatRect posRect(alignX, alignY, txtSize.x * squeeze, txtSize.y);
 
 	bool fastBlit = !p->touchesTaintedArea(posRect) && txtAlpha == 1.0;
 
 	if (fastBlit)
 	{
+		/* The target area is cleared, so we can just copy
+		 * the text over (clipped to the bitmap by GL) */
+		p->pushClip();
+
+		GLMeta::blitBegin(p->gl);
+		GLMeta::blitSource(*txtTex);
+
 		if (squeeze == 1.0)
-		{
-			/* Even faster: upload directly to bitmap texture.
-			 * We have to make sure the posRect lies within the texture
-			 * boundaries or texSubImage will generate errors.
-			 * If it partly lies outside bounds we have to upload
-			 * the clipped visible part of it. */
-			SDL_Rect btmRect;
-			btmRect.x = btmRect.y = 0;
-			btmRect.w = width();
-			btmRect.h = height();
-
-			SDL_Rect txtRect;
-			txtRect.x = posRect.x;
-			txtRect.y = posRect.y;
-			txtRect.w = posRect.w;
-			txtRect.h = posRect.h;
-
-			SDL_Rect inters;
-
-			/* If we have no intersection at all,
-			 * there's nothing to upload to begin with */
-			if (SDL_IntersectRect(&btmRect, &txtRect, &inters))
-			{
-				bool subImage = false;
-				int subSrcX = 0, subSrcY = 0;
-
-				if (inters.w != txtRect.w || inters.h != txtRect.h)
-				{
-					/* Clip the text surface */
-					subSrcX = inters.x - txtRect.x;
-					subSrcY = inters.y - txtRect.y;
-					subImage = true;
-
-					posRect.x = inters.x;
-					posRect.y = inters.y;
-					posRect.w = inters.w;
-					posRect.h = inters.h;
-				}
-
-				TEX::bind(p->gl.tex);
-
-				if (!subImage)
-				{
-					TEX::uploadSubImage(posRect.x, posRect.y,
-					                    posRect.w, posRect.h,
-					                    txtSurf->pixels, GL_RGBA);
-				}
-				else
-				{
-					GLMeta::subRectImageUpload(txtSurf->w, subSrcX, subSrcY,
-					                           posRect.x, posRect.y,
-					                           posRect.w, posRect.h,
-					                           txtSurf, GL_RGBA);
-					GLMeta::subRectImageEnd();
-				}
-			}
-		}
+			GLMeta::blitRectangle(IntRect(0, 0, txtSize.x, txtSize.y),
+			                      Vec2i(posRect.x, posRect.y));
 		else
-		{
-			/* Squeezing involved: need to use intermediary TexFBO */
-			TEXFBO &gpTF = shState->gpTexFBO(txtSurf->w, txtSurf->h);
+			GLMeta::blitRectangle(IntRect(0, 0, txtSize.x, txtSize.y),
+			                      posRect, true);
 
-			TEX::bind(gpTF.tex);
-			TEX::uploadSubImage(0, 0, txtSurf->w, txtSurf->h, txtSurf->pixels, GL_RGBA);
+		GLMeta::blitEnd();
 
-			GLMeta::blitBegin(p->gl);
-			GLMeta::blitSource(gpTF);
-			GLMeta::blitRectangle(IntRect(0, 0, txtSurf->w, txtSurf->h),
-			                      posRect, true);
-			GLMeta::blitEnd();
-		}
+		p->popClip();
 	}
 	else
 	{
@@ -1108,23 +1774,22 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 		GLMeta::blitEnd();
 
 		FloatRect bltRect(0, 0,
-		                  (float) (gpTexSize.x * squeeze) / gpTex2.width,
-		                  (float) gpTexSize.y / gpTex2.height);
+		                  (float) (txtTex->width * squeeze) / gpTex2.width,
+		                  (float) txtTex->height / gpTex2.height);
 
 		BltShader &shader = shState->shaders().blt;
 		shader.bind();
-		shader.setTexSize(gpTexSize);
+		shader.setTexSize(Vec2i(txtTex->width, txtTex->height));
 		shader.setSource();
 		shader.setDestination(gpTex2.tex);
 		shader.setSubRect(bltRect);
 		shader.setOpacity(txtAlpha);
 
-		shState->bindTex();
-		TEX::uploadSubImage(0, 0, txtSurf->w, txtSurf->h, txtSurf->pixels, GL_RGBA);
+		TEX::bind(txtTex->tex);
 		TEX::setSmooth(true);
 
 		Quad &quad = shState->gpQuad();
-		quad.setTexRect(FloatRect(0, 0, txtSurf->w, txtSurf->h));
+		quad.setTexRect(FloatRect(0, 0, txtSize.x, txtSize.y));
 		quad.setPosRect(posRect);
 
 		p->bindFBO();
@@ -1133,56 +1798,14 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 		p->blitQuad(quad);
 
 		p->popViewport();
-	}
 
-	SDL_FreeSurface(txtSurf);
-	p->addTaintedArea(posRect);
-
-	p->onModified();
-}
-
-/* http://www.lemoda.net/c/utf8-to-ucs2/index.html */
-static uint16_t utf8_to_ucs2(const char *_input,
-                             const char **end_ptr)
-{
-	const unsigned char *input =
-	        reinterpret_cast<const unsigned char*>(_input);
-	*end_ptr = _input;
-
-	if (input[0] == 0)
-		return -1;
-
-	if (input[0] < 0x80)
-	{
-		*end_ptr = _input + 1;
-
-		return input[0];
-	}
-
-	if ((input[0] & 0xE0) == 0xE0)
-	{
-		if (input[1] == 0 || input[2] == 0)
-			return -1;
-
-		*end_ptr = _input + 3;
-
-		return (input[0] & 0x0F)<<12 |
-		       (input[1] & 0x3F)<<6  |
-		       (input[2] & 0x3F);
+		TEX::bind(txtTex->tex);
+		TEX::setSmooth(false);
 	}
 
-	if ((input[0] & 0xC0) == 0xC0)
-	{
-		if (input[1] == 0)
-			return -1;
-
-		*end_ptr = _input + 2;
-
-		return (input[0] & 0x1F)<<6  |
-		       (input[1] & 0x3F);
-	}
+	p->addTaintedArea(posRect);
 
-	return -1;
+	p->onModified(posRect);
 }
 
 IntRect Bitmap::textSize(const char *str)
@@ -1191,24 +1814,7 @@ IntRect Bitmap::textSize(const char *str)
 
 	GUARD_MEGA;
 
-	TTF_Font *font = p->font->getSdlFont();
-
-	std::string fixed = fixupString(str);
-	str = fixed.c_str();
-
-	int w, h;
-	TTF_SizeUTF8(font, str, &w, &h);
-
-	/* If str is one character long, *endPtr == 0 */
-	const char *endPtr;
-	uint16_t ucs2 = utf8_to_ucs2(str, &endPtr);
-
-	/* For cursive characters, returning the advance
-	 * as width yields better results */
-	if (p->font->getItalic() && *endPtr == '\0')
-		TTF_GlyphMetrics(font, ucs2, 0, 0, 0, 0, &w);
-
-	return IntRect(0, 0, w, h);
+	return p->font->textSize(str);
 }
 
 DEF_ATTR_RD_SIMPLE(Bitmap, Font, Font&, *p->font)
@@ -1225,6 +1831,9 @@ void Bitmap::setInitFont(Font *value)
 
 TEXFBO &Bitmap::getGLTypes()
 {
+	/* Callers might render into the texture */
+	p->prepareModify();
+
 	return p->gl;
 }
 
@@ -1233,6 +1842,26 @@ SDL_Surface *Bitmap::megaSurface() const
 	return p->megaSurface;
 }
 
+int Bitmap::megaTileCount() const
+{
+	return p->megaSurface ? p->megaTileCount() : 0;
+}
+
+IntRect Bitmap::megaTileRect(int i) const
+{
+	return p->megaTileRect(i);
+}
+
+Vec2i Bitmap::bindMegaTile(int i, ShaderBase &shader) const
+{
+	TEXFBO &tile = p->ensureMegaTile(i);
+
+	TEX::bind(tile.tex);
+	shader.setTexSize(Vec2i(tile.width, tile.height));
+
+	return Vec2i(tile.width, tile.height);
+}
+
 void Bitmap::ensureNonMega() const
 {
 	if (isDisposed())
@@ -1241,22 +1870,64 @@ void Bitmap::ensureNonMega() const
 	GUARD_MEGA;
 }
 
+Vec2i Bitmap::texSize() const
+{
+	TEXFBO &tex = p->texture();
+
+	return Vec2i(tex.width, tex.height);
+}
+
+Vec2i Bitmap::texOrigin() const
+{
+	return p->origin();
+}
+
+const TEXFBO &Bitmap::texture() const
+{
+	return p->texture();
+}
+
 void Bitmap::bindTex(ShaderBase &shader)
 {
 	p->bindTexture(shader);
 }
 
+void Bitmap::flush()
+{
+	p->flush();
+}
+
+uint64_t Bitmap::modStamp() const
+{
+	return p->modStamp;
+}
+
 void Bitmap::taintArea(const IntRect &rect)
 {
 	p->addTaintedArea(rect);
+	p->invalidateTiles(rect);
 }
 
 void Bitmap::releaseResources()
 {
+	p->flushDependents();
+
 	if (p->megaSurface)
+	{
+		for (size_t i = 0; i < p->megaTiles.size(); ++i)
+			if (p->megaTiles[i].tex != TEX::ID(0))
+				shState->texPool().release(p->megaTiles[i]);
+
 		SDL_FreeSurface(p->megaSurface);
+	}
+	else if (p->atlas)
+	{
+		shState->bitmapAtlas().remove(p->atlas);
+	}
 	else
+	{
 		shState->texPool().release(p->gl);
+	}
 
 	delete p;
 }
@@ -28,6 +28,8 @@
 
 #include <sigc++/signal.h>
 
+#include <stdint.h>
+
 class Font;
 class ShaderBase;
 struct TEXFBO;
@@ -79,6 +81,10 @@ public:
 	void clear();
 
 	Color getPixel(int x, int y) const;
+
+	/* Starts an asynchronous readback of 'rect' so that
+	 * following getPixel calls there don't stall on the GPU */
+	void prefetchPixels(const IntRect &rect) const;
 	void setPixel(int x, int y, const Color &color);
 
 	void hueChange(int hue);
@@ -106,17 +112,50 @@ public:
 	void setInitFont(Font *value);
 
 	/* <internal> */
+	/* For rendering into the texture; moves the bitmap out
+	 * of the atlas. Read only users go through texture() */
 	TEXFBO &getGLTypes();
 	SDL_Surface *megaSurface() const;
 	void ensureNonMega() const;
 
+	/* Mega surfaces are drawn from a grid of textures; the
+	 * count is 0 for regular bitmaps. Tile rects are in
+	 * bitmap coordinates, binding uploads the tile if needed
+	 * and returns the size of its texture */
+	int megaTileCount() const;
+	IntRect megaTileRect(int i) const;
+	Vec2i bindMegaTile(int i, ShaderBase &shader) const;
+
+	/* Size of the backing texture, which can be larger
+	 * than the bitmap (the pool rounds sizes up) */
+	Vec2i texSize() const;
+
+	/* Position of the bitmap inside its backing texture; non
+	 * zero for bitmaps sharing an atlas page. Can change
+	 * between frames, and is accounted for by bindTex() */
+	Vec2i texOrigin() const;
+
+	/* The texture currently holding the pixels, at texOrigin().
+	 * Unlike getGLTypes(), this doesn't prepare it for being
+	 * rendered into; see flush() for using it as a source */
+	const TEXFBO &texture() const;
+
 	/* Binds the backing texture and sets the correct
-	 * texture size uniform in shader */
+	 * texture size / offset uniforms in shader */
 	void bindTex(ShaderBase &shader);
 
+	/* Lands pending modifications in the texture. This can bind
+	 * other framebuffers and shaders, so blit sources have to be
+	 * flushed before the blit target is set up */
+	void flush();
+
 	/* Adds 'rect' to tainted area */
 	void taintArea(const IntRect &rect);
 
+	/* Changes on every modification of the pixels, and is
+	 * never shared by two bitmaps (even across disposal) */
+	uint64_t modStamp() const;
+
 	sigc::signal<void> modified;
 
 private:
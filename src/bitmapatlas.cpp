@@ -0,0 +1,362 @@
+/*
+** bitmapatlas.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bitmapatlas.h"
+
+#include "glstate.h"
+#include "gl-util.h"
+#include "gl-meta.h"
+#include "config.h"
+#include "util.h"
+
+#include <SDL_surface.h>
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+/* Preferred edge length of one atlas page */
+#define PAGE_SIZE 2048
+
+/* Images larger than this in either
+ * dimension get their own texture */
+#define MAX_IMAGE_SIZE 256
+
+/* Border around each image, filled with copies of its
+ * edge pixels, so filtered sampling at the image edges
+ * behaves like it does with a standalone texture */
+#define GUTTER 2
+
+struct Shelf
+{
+	int y, h;
+	int penX;
+
+	/* Live entries; the shelf is
+	 * reset once this drops to 0 */
+	int count;
+};
+
+struct AtlasPage
+{
+	TEXFBO tex;
+	std::vector<Shelf> shelves;
+
+	/* Top of the area not covered by shelves yet */
+	int shelfEnd;
+
+	AtlasPage()
+	    : shelfEnd(0)
+	{}
+};
+
+/* Where an image slot (image plus gutter) goes */
+struct Placement
+{
+	AtlasPage *page;
+	int shelf;
+	IntRect slot;
+};
+
+static IntRect slotRect(const AtlasEntry *entry)
+{
+	return IntRect(entry->rect.x - GUTTER, entry->rect.y - GUTTER,
+	               entry->rect.w + GUTTER*2, entry->rect.h + GUTTER*2);
+}
+
+static bool tallerFirst(const AtlasEntry *a, const AtlasEntry *b)
+{
+	return a->rect.h > b->rect.h;
+}
+
+struct BitmapAtlasPrivate
+{
+	bool enabled;
+	int pageSize;
+
+	std::vector<AtlasPage*> pages;
+	std::vector<AtlasEntry*> entries;
+
+	/* Slot area of all entries */
+	size_t liveArea;
+
+	BitmapAtlasPrivate(const Config &conf)
+	    : enabled(conf.bitmapAtlas),
+	      pageSize(0),
+	      liveArea(0)
+	{}
+
+	~BitmapAtlasPrivate()
+	{
+		for (size_t i = 0; i < pages.size(); ++i)
+			deletePage(pages[i]);
+
+		for (size_t i = 0; i < entries.size(); ++i)
+			delete entries[i];
+	}
+
+	void initPage(AtlasPage *page)
+	{
+		TEXFBO::init(page->tex);
+		TEXFBO::allocEmpty(page->tex, pageSize, pageSize);
+		TEXFBO::linkFBO(page->tex);
+	}
+
+	void deletePage(AtlasPage *page)
+	{
+		if (page->tex.tex != TEX::ID(0))
+			TEXFBO::fini(page->tex);
+
+		delete page;
+	}
+
+	/* Finds room for a w*h slot in 'pageList', adding shelves
+	 * and pages (without textures) as needed. Tall shelves are
+	 * only filled with short slots when nothing else fits */
+	void place(std::vector<AtlasPage*> &pageList, int w, int h, Placement &out)
+	{
+		out.page = 0;
+		out.shelf = -1;
+
+		for (size_t i = 0; i < pageList.size(); ++i)
+		{
+			AtlasPage *page = pageList[i];
+
+			for (size_t j = 0; j < page->shelves.size(); ++j)
+			{
+				const Shelf &shelf = page->shelves[j];
+
+				if (shelf.h < h || shelf.penX + w > pageSize)
+					continue;
+
+				if (out.page && shelf.h >= out.page->shelves[out.shelf].h)
+					continue;
+
+				out.page = page;
+				out.shelf = j;
+			}
+		}
+
+		if (out.page && out.page->shelves[out.shelf].h > h*2)
+		{
+			/* Rather open a new shelf, if there's room */
+			for (size_t i = 0; i < pageList.size(); ++i)
+				if (pageList[i]->shelfEnd + h <= pageSize)
+				{
+					out.page = 0;
+					break;
+				}
+		}
+
+		if (!out.page)
+		{
+			for (size_t i = 0; i < pageList.size() && !out.page; ++i)
+				if (pageList[i]->shelfEnd + h <= pageSize)
+					out.page = pageList[i];
+
+			if (!out.page)
+			{
+				out.page = new AtlasPage;
+				pageList.push_back(out.page);
+			}
+
+			Shelf shelf = { out.page->shelfEnd, h, 0, 0 };
+			out.page->shelves.push_back(shelf);
+			out.page->shelfEnd += h;
+			out.shelf = out.page->shelves.size() - 1;
+		}
+
+		Shelf &shelf = out.page->shelves[out.shelf];
+		out.slot = IntRect(shelf.penX, shelf.y, w, h);
+
+		shelf.penX += w;
+		shelf.count++;
+	}
+
+	void assign(AtlasEntry *entry, const Placement &pl)
+	{
+		entry->tex = &pl.page->tex;
+		entry->page = pl.page;
+		entry->shelf = pl.shelf;
+		entry->rect = IntRect(pl.slot.x + GUTTER, pl.slot.y + GUTTER,
+		                      pl.slot.w - GUTTER*2, pl.slot.h - GUTTER*2);
+	}
+
+	void upload(AtlasEntry *entry, SDL_Surface *surf)
+	{
+		const int w = surf->w;
+		const int h = surf->h;
+		const IntRect slot = slotRect(entry);
+
+		std::vector<uint32_t> buffer(slot.w * slot.h);
+
+		for (int y = 0; y < slot.h; ++y)
+		{
+			int srcY = clamp(y - GUTTER, 0, h - 1);
+
+			const uint32_t *src = reinterpret_cast<const uint32_t*>
+				(static_cast<const uint8_t*>(surf->pixels) + srcY * surf->pitch);
+			uint32_t *dst = &buffer[y * slot.w];
+
+			for (int x = 0; x < GUTTER; ++x)
+			{
+				dst[x] = src[0];
+				dst[slot.w - 1 - x] = src[w - 1];
+			}
+
+			memcpy(dst + GUTTER, src, w * 4);
+		}
+
+		TEX::bind(entry->tex->tex);
+		GLMeta::texSubImage(slot.x, slot.y, slot.w, slot.h,
+		                    &buffer[0], slot.w * 4, GL_RGBA);
+	}
+
+	/* Packs all live entries anew, tallest first, and moves them
+	 * over if that frees up at least one page. Plans are made up
+	 * front, so nothing is touched on the GPU otherwise */
+	void defragment()
+	{
+		std::vector<AtlasEntry*> sorted = entries;
+		std::stable_sort(sorted.begin(), sorted.end(), tallerFirst);
+
+		std::vector<AtlasPage*> newPages;
+		std::vector<Placement> plan(sorted.size());
+
+		for (size_t i = 0; i < sorted.size(); ++i)
+		{
+			IntRect slot = slotRect(sorted[i]);
+			place(newPages, slot.w, slot.h, plan[i]);
+		}
+
+		if (newPages.size() >= pages.size())
+		{
+			for (size_t i = 0; i < newPages.size(); ++i)
+				deletePage(newPages[i]);
+
+			return;
+		}
+
+		for (size_t i = 0; i < newPages.size(); ++i)
+			initPage(newPages[i]);
+
+		for (size_t i = 0; i < sorted.size(); ++i)
+		{
+			AtlasEntry *entry = sorted[i];
+			const Placement &pl = plan[i];
+
+			GLMeta::blitBegin(pl.page->tex);
+			GLMeta::blitSource(*entry->tex);
+			GLMeta::blitRectangle(slotRect(entry), Vec2i(pl.slot.x, pl.slot.y));
+			GLMeta::blitEnd();
+
+			assign(entry, pl);
+		}
+
+		for (size_t i = 0; i < pages.size(); ++i)
+			deletePage(pages[i]);
+
+		pages = newPages;
+	}
+
+	/* Worth a try once the live area would
+	 * fit into fewer pages with some slack */
+	bool isSparse() const
+	{
+		if (pages.size() < 2)
+			return false;
+
+		size_t pageArea = pageSize * pageSize;
+
+		return liveArea * 4 < (pages.size() - 1) * pageArea * 3;
+	}
+};
+
+BitmapAtlas::BitmapAtlas(const Config &conf)
+{
+	p = new BitmapAtlasPrivate(conf);
+}
+
+BitmapAtlas::~BitmapAtlas()
+{
+	delete p;
+}
+
+AtlasEntry *BitmapAtlas::add(SDL_Surface *surf)
+{
+	if (!p->enabled || surf->w > MAX_IMAGE_SIZE || surf->h > MAX_IMAGE_SIZE)
+		return 0;
+
+	if (p->pageSize == 0)
+		p->pageSize = std::min<int>(PAGE_SIZE, glState.caps.maxTexSize);
+
+	Placement pl;
+	p->place(p->pages, surf->w + GUTTER*2, surf->h + GUTTER*2, pl);
+
+	if (pl.page->tex.tex == TEX::ID(0))
+		p->initPage(pl.page);
+
+	AtlasEntry *entry = new AtlasEntry;
+	p->assign(entry, pl);
+	p->upload(entry, surf);
+
+	p->entries.push_back(entry);
+	p->liveArea += pl.slot.w * pl.slot.h;
+
+	return entry;
+}
+
+void BitmapAtlas::remove(AtlasEntry *entry)
+{
+	AtlasPage *page = entry->page;
+	Shelf &shelf = page->shelves[entry->shelf];
+
+	if (--shelf.count == 0)
+		shelf.penX = 0;
+
+	/* Give empty shelves at the top back to the page */
+	while (!page->shelves.empty() && page->shelves.back().count == 0)
+	{
+		page->shelfEnd = page->shelves.back().y;
+		page->shelves.pop_back();
+	}
+
+	IntRect slot = slotRect(entry);
+	p->liveArea -= slot.w * slot.h;
+
+	p->entries.erase(std::find(p->entries.begin(), p->entries.end(), entry));
+	delete entry;
+
+	if (page->shelves.empty())
+	{
+		p->pages.erase(std::find(p->pages.begin(), p->pages.end(), page));
+		p->deletePage(page);
+	}
+	else if (p->enabled && p->isSparse())
+	{
+		p->defragment();
+	}
+}
+
+void BitmapAtlas::disable()
+{
+	p->enabled = false;
+}
@@ -0,0 +1,70 @@
+/*
+** bitmapatlas.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BITMAPATLAS_H
+#define BITMAPATLAS_H
+
+#include "etc-internal.h"
+
+struct Config;
+struct TEXFBO;
+struct SDL_Surface;
+struct AtlasPage;
+struct BitmapAtlasPrivate;
+
+/* A bitmap image living inside a shared atlas page */
+struct AtlasEntry
+{
+	/* Page texture and the image area inside of it. Both
+	 * change when the page is defragmented, so they have
+	 * to be looked up anew every time they're used */
+	TEXFBO *tex;
+	IntRect rect;
+
+	/* Allocator internal */
+	AtlasPage *page;
+	int shelf;
+};
+
+/* Packs small, read-only images into a few large textures
+ * (shelf by shelf), so that consecutive draws from them
+ * don't require texture switches. Once the live images
+ * would fit into fewer pages, everything is repacked */
+class BitmapAtlas
+{
+public:
+	BitmapAtlas(const Config &conf);
+	~BitmapAtlas();
+
+	/* Uploads 'surf' (ABGR8888) into a page. Returns null if
+	 * the atlas is disabled or the image is too large */
+	AtlasEntry *add(SDL_Surface *surf);
+	void remove(AtlasEntry *entry);
+
+	/* Stops accepting images and repacking
+	 * pages, for use during shutdown */
+	void disable();
+
+private:
+	BitmapAtlasPrivate *p;
+};
+
+#endif // BITMAPATLAS_H
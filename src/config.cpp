@@ -142,11 +142,21 @@ Config::Config()
       fixedAspectRatio(true),
       smoothScaling(false),
       vsync(false),
+      renderThread(false),
       defScreenW(0),
       defScreenH(0),
       fixedFramerate(0),
       frameSkip(true),
+      skipStaticFrames(false),
       solidFonts(false),
+      textCacheSize(4096),
+      decodeThreads(2),
+      decodeCacheSize(65536),
+      workerThreads(2),
+      texPoolBudget(0),
+      bitmapAtlas(false),
+      tilemapChunks(false),
+      tilemapAtlasCache(2),
       gameFolder("."),
       anyAltToggleFS(false),
       enableReset(true),
@@ -169,11 +179,22 @@ void Config::read(int argc, char *argv[])
 	PO_DESC(fixedAspectRatio, bool) \
 	PO_DESC(smoothScaling, bool) \
 	PO_DESC(vsync, bool) \
+	PO_DESC(renderThread, bool) \
 	PO_DESC(defScreenW, int) \
 	PO_DESC(defScreenH, int) \
 	PO_DESC(fixedFramerate, int) \
 	PO_DESC(frameSkip, bool) \
+	PO_DESC(skipStaticFrames, bool) \
+	PO_DESC(profileTrace, std::string) \
 	PO_DESC(solidFonts, bool) \
+	PO_DESC(textCacheSize, int) \
+	PO_DESC(decodeThreads, int) \
+	PO_DESC(decodeCacheSize, int) \
+	PO_DESC(workerThreads, int) \
+	PO_DESC(texPoolBudget, int) \
+	PO_DESC(bitmapAtlas, bool) \
+	PO_DESC(tilemapChunks, bool) \
+	PO_DESC(tilemapAtlasCache, int) \
 	PO_DESC(gameFolder, std::string) \
 	PO_DESC(anyAltToggleFS, bool) \
 	PO_DESC(enableReset, bool) \
@@ -257,6 +278,13 @@ void Config::read(int argc, char *argv[])
 
 	SE.sourceCount = clamp(SE.sourceCount, 1, 64);
 
+	textCacheSize = std::max(textCacheSize, 0);
+	decodeThreads = clamp(decodeThreads, 0, 8);
+	decodeCacheSize = std::max(decodeCacheSize, 0);
+	workerThreads = clamp(workerThreads, 0, 8);
+	texPoolBudget = std::max(texPoolBudget, 0);
+	tilemapAtlasCache = clamp(tilemapAtlasCache, 0, 16);
+
 	if (!dataPathOrg.empty() && !dataPathApp.empty())
 		customDataPath = prefPath(dataPathOrg.c_str(), dataPathApp.c_str());
 
@@ -36,14 +36,28 @@ struct Config
 	bool fixedAspectRatio;
 	bool smoothScaling;
 	bool vsync;
+	bool renderThread;
 
 	int defScreenW;
 	int defScreenH;
 
 	int fixedFramerate;
 	bool frameSkip;
+	bool skipStaticFrames;
+	std::string profileTrace;
 
 	bool solidFonts;
+	int textCacheSize;
+
+	int decodeThreads;
+	int decodeCacheSize;
+
+	int workerThreads;
+
+	int texPoolBudget;
+	bool bitmapAtlas;
+	bool tilemapChunks;
+	int tilemapAtlasCache;
 
 	std::string gameFolder;
 	bool anyAltToggleFS;
@@ -235,6 +235,16 @@ void EventThread::process(RGSSThreadData &rtData)
 				break;
 			}
 
+			if (event.key.keysym.scancode == SDL_SCANCODE_F3)
+			{
+				if (showProfiler)
+					showProfiler.clear();
+				else
+					showProfiler.set();
+
+				break;
+			}
+
 			if (event.key.keysym.scancode == SDL_SCANCODE_F12)
 			{
 				if (!rtData.config.enableReset)
@@ -456,6 +466,11 @@ bool EventThread::getShowCursor() const
 	return showCursor;
 }
 
+bool EventThread::getShowProfiler() const
+{
+	return showProfiler;
+}
+
 void EventThread::notifyFrame()
 {
 	if (!fps.displaying)
@@ -79,6 +79,9 @@ public:
 	bool getFullscreen() const;
 	bool getShowCursor() const;
 
+	/* Toggled with F3 */
+	bool getShowProfiler() const;
+
 	void showMessageBox(const char *body, int flags = 0);
 
 	/* RGSS thread calls this once per frame */
@@ -91,6 +94,7 @@ private:
 
 	bool fullscreen;
 	bool showCursor;
+	AtomicFlag showProfiler;
 	AtomicFlag msgBoxDone;
 
 	struct
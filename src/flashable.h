@@ -24,6 +24,7 @@
 
 #include "etc.h"
 #include "etc-internal.h"
+#include "framedigest.h"
 
 class Flashable
 {
@@ -78,6 +79,13 @@ public:
 	}
 
 protected:
+	void digestFlash(FrameDigest &digest) const
+	{
+		digest.add(flashing);
+		digest.add(emptyFlashFlag);
+		digest.add(flashColor);
+	}
+
 	Vec4 flashColor;
 	bool flashing;
 	bool emptyFlashFlag;
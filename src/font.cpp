@@ -27,9 +27,16 @@
 #include "boost-hash.h"
 #include "util.h"
 #include "config.h"
+#include "glyphatlas.h"
+#include "gl-util.h"
+#include "gl-meta.h"
+#include "texpool.h"
 
 #include <string>
 #include <utility>
+#include <list>
+
+#include <boost/functional/hash.hpp>
 
 #include <SDL_ttf.h>
 
@@ -64,6 +71,90 @@ struct FontSet
 	std::string other;
 };
 
+/* Identifies one fully rendered string; colors are packed
+ * to 8 bit RGB (the alpha is applied when composing) */
+struct TextCacheKey
+{
+	TTF_Font *font;
+	int style;
+	bool shadow;
+	bool outline;
+	uint32_t color;
+	uint32_t outColor;
+	std::string str;
+
+	bool operator==(const TextCacheKey &o) const
+	{
+		return font == o.font && style == o.style &&
+		       shadow == o.shadow && outline == o.outline &&
+		       color == o.color && outColor == o.outColor &&
+		       str == o.str;
+	}
+};
+
+inline size_t hash_value(const TextCacheKey &k)
+{
+	size_t seed = 0;
+
+	boost::hash_combine(seed, k.font);
+	boost::hash_combine(seed, k.style | k.shadow << 8 | k.outline << 9);
+	boost::hash_combine(seed, k.color);
+	boost::hash_combine(seed, k.outColor);
+	boost::hash_combine(seed, k.str);
+
+	return seed;
+}
+
+static uint32_t packRGB(const Vec4 &c)
+{
+	return (uint32_t) (clamp<float>(c.x, 0, 1) * 255) << 16 |
+	       (uint32_t) (clamp<float>(c.y, 0, 1) * 255) << 8  |
+	       (uint32_t) (clamp<float>(c.z, 0, 1) * 255);
+}
+
+struct TextCacheEntry
+{
+	TextCacheKey key;
+	TEXFBO tex;
+	Vec2i size;
+};
+
+typedef std::list<TextCacheEntry> TextCacheList;
+
+/* Font handle, style */
+typedef std::pair<TTF_Font*, int> LineKey;
+/* Font handle, (style << 16 | UCS-2 character) */
+typedef std::pair<TTF_Font*, uint32_t> GlyphKey;
+/* Font handle, (left << 16 | right UCS-2 character) */
+typedef std::pair<TTF_Font*, uint32_t> KernKey;
+
+struct MeasuredLine
+{
+	int height;
+
+	/* Extra width SDL_ttf adds to every emboldened glyph,
+	 * without advancing the pen by it */
+	int overhang;
+};
+
+struct MeasuredGlyph
+{
+	int minx;
+
+	/* Right edge relative to the pen position */
+	int extent;
+
+	/* Pen advance as used by TTF_SizeUTF8, and the advance
+	 * as reported by TTF_GlyphMetrics */
+	int advance;
+	int metricsAdvance;
+};
+
+/* TTF_GetFontKerningSizeGlyphs is only available in later versions;
+ * with older ones we leave kerned fonts to TTF_SizeUTF8 */
+#define HAVE_KERNING_QUERY \
+	(SDL_VERSIONNUM(SDL_TTF_MAJOR_VERSION, SDL_TTF_MINOR_VERSION, SDL_TTF_PATCHLEVEL) >= SDL_VERSIONNUM(2, 0, 14))
+
 struct SharedFontStatePrivate
 {
 	/* Maps: font family name, To: substituted family name,
@@ -77,11 +168,121 @@ struct SharedFontStatePrivate
 	/* Pool of already opened fonts; once opened, they are reused
 	 * and never closed until the termination of the program */
 	BoostHash<FontKey, TTF_Font*> pool;
+
+	/* Rendered strings, most recently used first */
+	TextCacheList textLRU;
+	BoostHash<TextCacheKey, TextCacheList::iterator> textIndex;
+
+	size_t textBytes;
+	size_t textBudget;
+
+	unsigned int textHits;
+	unsigned int textMisses;
+
+	/* Measurement cache; these never change for a given
+	 * font handle, so they are kept for the whole runtime */
+	BoostHash<LineKey, MeasuredLine> lines;
+	BoostHash<GlyphKey, MeasuredGlyph> glyphs;
+	BoostHash<KernKey, int> kerning;
+
+	SharedFontStatePrivate(const Config &conf)
+	    : textBytes(0),
+	      textBudget((size_t) conf.textCacheSize * 1024),
+	      textHits(0),
+	      textMisses(0)
+	{}
+
+	void evictText()
+	{
+		TextCacheEntry &last = textLRU.back();
+
+		textBytes -= last.size.x * last.size.y * 4;
+		textIndex.remove(last.key);
+		shState->texPool().release(last.tex);
+
+		textLRU.pop_back();
+	}
+
+	const MeasuredLine &getLine(TTF_Font *font, int style)
+	{
+		LineKey key(font, style);
+
+		if (lines.contains(key))
+			return lines[key];
+
+		MeasuredLine line;
+		line.overhang = 0;
+
+		int w1, w2, h;
+		TTF_SizeUTF8(font, " ", &w1, &line.height);
+
+		if (style & TTF_STYLE_BOLD)
+		{
+			/* The second space's offset is the raw advance */
+			int adv;
+			TTF_SizeUTF8(font, "  ", &w2, &h);
+			TTF_GlyphMetrics(font, ' ', 0, 0, 0, 0, &adv);
+
+			line.overhang = adv - (w2 - w1);
+		}
+
+		lines.insert(key, line);
+
+		return lines[key];
+	}
+
+	const MeasuredGlyph &getGlyph(TTF_Font *font, int style, uint16_t ch)
+	{
+		GlyphKey key(font, (style << 16) | ch);
+
+		if (glyphs.contains(key))
+			return glyphs[key];
+
+		const MeasuredLine &line = getLine(font, style);
+
+		int minx = 0, maxx = 0, adv = 0;
+		TTF_GlyphMetrics(font, ch, &minx, &maxx, 0, 0, &adv);
+
+		MeasuredGlyph glyph;
+		glyph.minx = minx;
+		glyph.extent = std::max(adv, maxx);
+		glyph.advance = adv - line.overhang;
+		glyph.metricsAdvance = adv;
+
+		glyphs.insert(key, glyph);
+
+		return glyphs[key];
+	}
+
+	int getKerning(TTF_Font *font, uint16_t left, uint16_t right)
+	{
+#if HAVE_KERNING_QUERY
+		KernKey key(font, (left << 16) | right);
+
+		if (kerning.contains(key))
+			return kerning[key];
+
+		int value = TTF_GetFontKerningSizeGlyphs(font, left, right);
+		kerning.insert(key, value);
+
+		return value;
+#else
+		(void) font; (void) left; (void) right;
+		return 0;
+#endif
+	}
 };
 
+/* RMXP draws LF as a "missing glyph" box, but we treat
+ * CR / LF as white space (see Bitmap::drawText) */
+static uint16_t fixupChar(uint16_t ch)
+{
+	return (ch == '\r' || ch == '\n') ? ' ' : ch;
+}
+
 SharedFontState::SharedFontState(const Config &conf)
 {
-	p = new SharedFontStatePrivate;
+	p = new SharedFontStatePrivate(conf);
 
 	/* Parse font substitutions */
 	for (size_t i = 0; i < conf.fontSubs.size(); ++i)
@@ -105,6 +306,10 @@ SharedFontState::~SharedFontState()
 	for (iter = p->pool.cbegin(); iter != p->pool.cend(); ++iter)
 		TTF_CloseFont(iter->second);
 
+	TextCacheList::iterator tIter;
+	for (tIter = p->textLRU.begin(); tIter != p->textLRU.end(); ++tIter)
+		TEXFBO::fini(tIter->tex);
+
 	delete p;
 }
 
@@ -195,6 +400,155 @@ bool SharedFontState::fontPresent(std::string family)
 	return !(set.regular.empty() && set.other.empty());
 }
 
+bool SharedFontState::renderText(_TTF_Font *font, const char *str,
+                                 const Vec4 &color, const Vec4 &outColor,
+                                 bool shadow, bool outline,
+                                 TEXFBO *&texOut, Vec2i &sizeOut)
+{
+	GlyphAtlas &atlas = shState->glyphAtlas();
+
+	if (p->textBudget == 0)
+		return atlas.renderText(font, str, color, outColor,
+		                        shadow, outline, texOut, sizeOut);
+
+	TextCacheKey key;
+	key.font = font;
+	key.style = TTF_GetFontStyle(font);
+	key.shadow = shadow;
+	key.outline = outline;
+	key.color = packRGB(color);
+	key.outColor = outline ? packRGB(outColor) : 0;
+	key.str = str;
+
+	if (p->textIndex.contains(key))
+	{
+		TextCacheList::iterator iter = p->textIndex[key];
+
+		/* Move to front */
+		p->textLRU.splice(p->textLRU.begin(), p->textLRU, iter);
+		++p->textHits;
+
+		texOut = &iter->tex;
+		sizeOut = iter->size;
+
+		return true;
+	}
+
+	++p->textMisses;
+
+	TEXFBO *rendered;
+
+	if (!atlas.renderText(font, str, color, outColor,
+	                      shadow, outline, rendered, sizeOut))
+		return false;
+
+	size_t bytes = sizeOut.x * sizeOut.y * 4;
+
+	/* Not worth evicting the entire cache for */
+	if (bytes > p->textBudget / 4)
+	{
+		texOut = rendered;
+		return true;
+	}
+
+	while (!p->textLRU.empty() && p->textBytes + bytes > p->textBudget)
+		p->evictText();
+
+	TextCacheEntry entry;
+	entry.key = key;
+	entry.size = sizeOut;
+	entry.tex = shState->texPool().request(sizeOut.x, sizeOut.y);
+
+	GLMeta::blitBegin(entry.tex);
+	GLMeta::blitSource(*rendered);
+	GLMeta::blitRectangle(IntRect(0, 0, sizeOut.x, sizeOut.y), Vec2i());
+	GLMeta::blitEnd();
+
+	p->textLRU.push_front(entry);
+	p->textIndex.insert(key, p->textLRU.begin());
+	p->textBytes += bytes;
+
+	texOut = &p->textLRU.front().tex;
+
+	return true;
+}
+
+void SharedFontState::textSize(_TTF_Font *font, const char *str,
+                               int &w, int &h)
+{
+	int style = TTF_GetFontStyle(font);
+	bool useKerning = TTF_GetFontKerning(font);
+
+#if !HAVE_KERNING_QUERY
+	if (useKerning)
+	{
+		std::string fixed(str);
+		for (size_t i = 0; i < fixed.size(); ++i)
+			fixed[i] = fixupChar(fixed[i]);
+
+		TTF_SizeUTF8(font, fixed.c_str(), &w, &h);
+		return;
+	}
+#endif
+
+	/* Mirrors the extent calculation of TTF_SizeUTF8 */
+	int x = 0, minx = 0, maxx = 0;
+	uint16_t prev = 0;
+
+	while (*str)
+	{
+		uint16_t ch = fixupChar(utf8NextUCS2(str));
+
+		if (ch == 0)
+			continue;
+
+		const MeasuredGlyph &glyph = p->getGlyph(font, style, ch);
+
+		if (useKerning && prev)
+			x += p->getKerning(font, prev, ch);
+
+		minx = std::min(minx, x + glyph.minx);
+		maxx = std::max(maxx, x + glyph.extent);
+
+		x += glyph.advance;
+		prev = ch;
+	}
+
+	w = maxx - minx;
+	h = p->getLine(font, style).height;
+}
+
+int SharedFontState::glyphAdvance(_TTF_Font *font, uint16_t ch)
+{
+	int style = TTF_GetFontStyle(font);
+
+	return p->getGlyph(font, style, fixupChar(ch)).metricsAdvance;
+}
+
+int SharedFontState::penAdvance(_TTF_Font *font, uint16_t ch)
+{
+	int style = TTF_GetFontStyle(font);
+
+	return p->getGlyph(font, style, fixupChar(ch)).advance;
+}
+
+int SharedFontState::kerning(_TTF_Font *font, uint16_t left, uint16_t right)
+{
+	return p->getKerning(font, fixupChar(left), fixupChar(right));
+}
+
+TextCacheStats SharedFontState::textCacheStats() const
+{
+	TextCacheStats stats;
+	stats.hits = p->textHits;
+	stats.misses = p->textMisses;
+	stats.entries = p->textLRU.size();
+	stats.bytes = p->textBytes;
+	stats.budget = p->textBudget;
+
+	return stats;
+}
+
 _TTF_Font *SharedFontState::openBundled(int size)
 {
 	SDL_RWops *ops = openBundledFont();
@@ -399,6 +753,28 @@ void Font::initDefaults()
 	FontPrivate::defaultShadow  = (rgssVer == 2 ? true : false);
 }
 
+IntRect Font::textSize(const char *str)
+{
+	TTF_Font *font = getSdlFont();
+	SharedFontState &fontState = shState->fontState();
+
+	int w, h;
+	fontState.textSize(font, str, w, h);
+
+	/* For cursive characters, returning the advance
+	 * as width yields better results */
+	if (p->italic && *str)
+	{
+		const char *endPtr = str;
+		uint16_t ucs2 = utf8NextUCS2(endPtr);
+
+		if (ucs2 && *endPtr == '\0')
+			w = fontState.glyphAdvance(font, ucs2);
+	}
+
+	return IntRect(0, 0, w, h);
+}
+
 _TTF_Font *Font::getSdlFont()
 {
 	if (!p->sdlFont)
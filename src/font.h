@@ -28,6 +28,17 @@
 struct SDL_RWops;
 struct _TTF_Font;
 struct Config;
+struct TEXFBO;
+
+struct TextCacheStats
+{
+	unsigned int hits;
+	unsigned int misses;
+
+	size_t entries;
+	size_t bytes;
+	size_t budget;
+};
 
 struct SharedFontStatePrivate;
 
@@ -49,6 +60,26 @@ public:
 
 	bool fontPresent(std::string family);
 
+	/* Renders 'str' via the GlyphAtlas, but reuses the texture of
+	 * a previous call with identical font, style, colors and string
+	 * if it is still cached. Same semantics as GlyphAtlas::renderText */
+	bool renderText(_TTF_Font *font, const char *str,
+	                const Vec4 &color, const Vec4 &outColor,
+	                bool shadow, bool outline,
+	                TEXFBO *&texOut, Vec2i &sizeOut);
+
+	TextCacheStats textCacheStats() const;
+
+	/* Measures 'str' like TTF_SizeUTF8 (with CR / LF treated as
+	 * spaces), but from cached glyph advances and kerning pairs */
+	void textSize(_TTF_Font *font, const char *str, int &w, int &h);
+	int glyphAdvance(_TTF_Font *font, uint16_t ch);
+
+	/* Pen advance and kerning exactly as textSize applies
+	 * them, so text laid out with these fits its measure */
+	int penAdvance(_TTF_Font *font, uint16_t ch);
+	int kerning(_TTF_Font *font, uint16_t left, uint16_t right);
+
 	static _TTF_Font *openBundled(int size);
 
 private:
@@ -117,6 +148,9 @@ public:
 	/* internal */
 	_TTF_Font *getSdlFont();
 
+	/* Size of 'str' as reported by Bitmap#text_size */
+	IntRect textSize(const char *str);
+
 private:
 	FontPrivate *p;
 };
@@ -0,0 +1,58 @@
+/*
+** framedigest.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEDIGEST_H
+#define FRAMEDIGEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Hash (64 bit FNV-1a) over everything that decides what a frame
+ * looks like, so that frames identical to the previous one can be
+ * detected without drawing them */
+struct FrameDigest
+{
+	uint64_t value;
+
+	FrameDigest()
+	    : value(14695981039346656037ULL)
+	{}
+
+	void addBytes(const void *data, size_t size)
+	{
+		const uint8_t *bytes = static_cast<const uint8_t*>(data);
+
+		for (size_t i = 0; i < size; ++i)
+		{
+			value ^= bytes[i];
+			value *= 1099511628211ULL;
+		}
+	}
+
+	/* Only for plain values without padding */
+	template<typename T>
+	void add(const T &v)
+	{
+		addBytes(&v, sizeof(v));
+	}
+};
+
+#endif // FRAMEDIGEST_H
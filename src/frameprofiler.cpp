@@ -0,0 +1,497 @@
+/*
+** frameprofiler.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "frameprofiler.h"
+
+#include "eventthread.h"
+#include "sharedstate.h"
+#include "font.h"
+#include "gl-util.h"
+#include "gl-meta.h"
+#include "glstate.h"
+#include "shader.h"
+#include "quad.h"
+#include "debugwriter.h"
+
+#include <SDL_timer.h>
+#include <SDL_ttf.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+/* Frames the overlay statistics are taken over */
+#define HISTORY_SIZE 240
+
+/* Overlay statistics refreshes per second */
+#define REFRESH_RATE 2
+
+#define OVERLAY_FONT_SIZE 12
+#define OVERLAY_LINE_H 15
+#define OVERLAY_PAD 4
+#define OVERLAY_W 190
+#define OVERLAY_POS 4
+
+/* Overlay columns */
+#define COL_AVG 100
+#define COL_LOW 145
+
+static const char *sectionNames[] =
+{
+	"Script",
+	"Update",
+	"Composite",
+	"TilemapPrepare",
+	"WindowPrepare",
+	"Delay",
+	"Swap"
+};
+
+/* Same, indented by nesting for the overlay */
+static const char *sectionLabels[] =
+{
+	"Script",
+	"Update",
+	"  Composite",
+	"    Tilemaps",
+	"    Windows",
+	"  Delay",
+	"  Swap"
+};
+
+struct FrameRecord
+{
+	/* Update section start to the next one */
+	uint64_t total;
+	uint64_t sections[FrameProfiler::SectionCount];
+};
+
+struct OverlayCell
+{
+	Vec2i pos;
+	std::string text;
+};
+
+struct FrameProfilerPrivate
+{
+	RGSSThreadData &rtData;
+
+	const uint64_t freq;
+	/* Trace timestamps are relative to this */
+	const uint64_t origin;
+
+	/* Only changes at frame boundaries */
+	bool active;
+
+	/* Start of the running sections, 0 if not running */
+	uint64_t started[FrameProfiler::SectionCount];
+	uint64_t frameStart;
+	FrameRecord current;
+
+	std::vector<FrameRecord> history;
+	size_t historyPos;
+	size_t historyCount;
+
+	FILE *trace;
+	bool traceCSV;
+	bool traceEmpty;
+	unsigned int frameIndex;
+
+	struct
+	{
+		bool init;
+		bool dirty;
+		uint64_t lastRefresh;
+
+		std::vector<OverlayCell> cells;
+
+		TEXFBO tex;
+		_TTF_Font *font;
+		Quad *bgQuad;
+		Quad *texQuad;
+	} overlay;
+
+	FrameProfilerPrivate(RGSSThreadData &rtData)
+	    : rtData(rtData),
+	      freq(SDL_GetPerformanceFrequency()),
+	      origin(SDL_GetPerformanceCounter()),
+	      active(false),
+	      frameStart(0),
+	      history(HISTORY_SIZE),
+	      historyPos(0),
+	      historyCount(0),
+	      trace(0),
+	      traceCSV(false),
+	      traceEmpty(true),
+	      frameIndex(0)
+	{
+		memset(started, 0, sizeof(started));
+		memset(&current, 0, sizeof(current));
+
+		overlay.init = false;
+		overlay.dirty = false;
+		overlay.lastRefresh = 0;
+		overlay.font = 0;
+		overlay.bgQuad = 0;
+		overlay.texQuad = 0;
+	}
+
+	~FrameProfilerPrivate()
+	{
+		if (overlay.init)
+		{
+			TEXFBO::fini(overlay.tex);
+			delete overlay.bgQuad;
+			delete overlay.texQuad;
+		}
+
+		if (overlay.font)
+			TTF_CloseFont(overlay.font);
+	}
+
+	double toMS(uint64_t ticks) const
+	{
+		return (ticks * 1000.0) / freq;
+	}
+
+	double toUS(uint64_t ticks) const
+	{
+		return (ticks * 1000000.0) / freq;
+	}
+
+	void openTrace(const std::string &path)
+	{
+		trace = fopen(path.c_str(), "w");
+
+		if (!trace)
+		{
+			Debug() << "Unable to open profile trace" << path;
+			return;
+		}
+
+		traceCSV = path.size() >= 4 &&
+		           path.compare(path.size() - 4, 4, ".csv") == 0;
+
+		if (traceCSV)
+		{
+			fputs("frame,total_ms", trace);
+
+			for (int i = 0; i < FrameProfiler::SectionCount; ++i)
+				fprintf(trace, ",%s_ms", sectionNames[i]);
+
+			fputs("\n", trace);
+		}
+		else
+		{
+			fputs("[", trace);
+		}
+	}
+
+	void closeTrace()
+	{
+		if (!trace)
+			return;
+
+		if (!traceCSV)
+			fputs("\n]\n", trace);
+
+		fclose(trace);
+	}
+
+	/* Chrome trace "complete" event */
+	void writeEvent(const char *name, uint64_t start, uint64_t dur)
+	{
+		fprintf(trace, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+		               "\"ts\":%.3f,\"dur\":%.3f}",
+		        traceEmpty ? "" : ",", name, toUS(start - origin), toUS(dur));
+
+		traceEmpty = false;
+	}
+
+	void closeFrame(uint64_t now)
+	{
+		current.total = now - frameStart;
+
+		history[historyPos] = current;
+		historyPos = (historyPos + 1) % HISTORY_SIZE;
+		historyCount = std::min<size_t>(historyCount + 1, HISTORY_SIZE);
+
+		if (trace && traceCSV)
+		{
+			fprintf(trace, "%u,%.3f", frameIndex, toMS(current.total));
+
+			for (int i = 0; i < FrameProfiler::SectionCount; ++i)
+				fprintf(trace, ",%.3f", toMS(current.sections[i]));
+
+			fputs("\n", trace);
+		}
+		else if (trace)
+		{
+			writeEvent("Frame", frameStart, current.total);
+		}
+
+		++frameIndex;
+		memset(&current, 0, sizeof(current));
+	}
+
+	/* Average and mean of the slowest 1% of 'values' */
+	void summarize(std::vector<uint64_t> &values, double &avg, double &low) const
+	{
+		std::sort(values.begin(), values.end(), std::greater<uint64_t>());
+
+		size_t worstN = std::max<size_t>(1, values.size() / 100);
+		uint64_t sum = 0, worstSum = 0;
+
+		for (size_t i = 0; i < values.size(); ++i)
+		{
+			sum += values[i];
+
+			if (i < worstN)
+				worstSum += values[i];
+		}
+
+		avg = toMS(sum) / values.size();
+		low = toMS(worstSum) / worstN;
+	}
+
+	void addCell(int x, int row, const char *text)
+	{
+		OverlayCell cell;
+		cell.pos = Vec2i(OVERLAY_PAD + x, OVERLAY_PAD + row * OVERLAY_LINE_H);
+		cell.text = text;
+
+		overlay.cells.push_back(cell);
+	}
+
+	void refreshOverlay()
+	{
+		overlay.cells.clear();
+		overlay.dirty = true;
+
+		if (historyCount == 0)
+			return;
+
+		std::vector<uint64_t> values(historyCount);
+		double avg, low;
+		char buffer[32];
+
+		for (size_t i = 0; i < historyCount; ++i)
+			values[i] = history[i].total;
+
+		summarize(values, avg, low);
+
+		addCell(0, 0, "FPS");
+		snprintf(buffer, sizeof(buffer), "%.1f", 1000.0 / avg);
+		addCell(COL_AVG, 0, buffer);
+		snprintf(buffer, sizeof(buffer), "%.1f", 1000.0 / low);
+		addCell(COL_LOW, 0, buffer);
+
+		addCell(0, 1, "ms");
+		addCell(COL_AVG, 1, "avg");
+		addCell(COL_LOW, 1, "1% low");
+
+		for (int s = 0; s < FrameProfiler::SectionCount; ++s)
+		{
+			for (size_t i = 0; i < historyCount; ++i)
+				values[i] = history[i].sections[s];
+
+			summarize(values, avg, low);
+
+			addCell(0, s+2, sectionLabels[s]);
+			snprintf(buffer, sizeof(buffer), "%.2f", avg);
+			addCell(COL_AVG, s+2, buffer);
+			snprintf(buffer, sizeof(buffer), "%.2f", low);
+			addCell(COL_LOW, s+2, buffer);
+		}
+	}
+
+	void initOverlay()
+	{
+		const int h = OVERLAY_PAD*2 + (FrameProfiler::SectionCount+2) * OVERLAY_LINE_H;
+
+		TEXFBO::init(overlay.tex);
+		TEXFBO::allocEmpty(overlay.tex, OVERLAY_W, h);
+		TEXFBO::linkFBO(overlay.tex);
+
+		overlay.font = SharedFontState::openBundled(OVERLAY_FONT_SIZE);
+
+		const FloatRect rect(OVERLAY_POS, OVERLAY_POS, OVERLAY_W, h);
+
+		overlay.bgQuad = new Quad;
+		overlay.bgQuad->setPosRect(rect);
+		overlay.bgQuad->setColor(Vec4(0, 0, 0, 0.6));
+
+		overlay.texQuad = new Quad;
+		overlay.texQuad->setTexPosRect(FloatRect(0, 0, OVERLAY_W, h), rect);
+
+		overlay.init = true;
+	}
+
+	void renderOverlay()
+	{
+		FBO::bind(overlay.tex.fbo);
+
+		glState.clearColor.pushSet(Vec4());
+		FBO::clear();
+		glState.clearColor.pop();
+
+		if (!overlay.font)
+			return;
+
+		for (size_t i = 0; i < overlay.cells.size(); ++i)
+		{
+			const OverlayCell &cell = overlay.cells[i];
+			TEXFBO *txtTex;
+			Vec2i txtSize;
+
+			if (!shState->fontState().renderText(overlay.font, cell.text.c_str(),
+			                                     Vec4(1, 1, 1, 1), Vec4(0, 0, 0, 1),
+			                                     false, false, txtTex, txtSize))
+				continue;
+
+			GLMeta::blitBegin(overlay.tex);
+			GLMeta::blitSource(*txtTex);
+			GLMeta::blitRectangle(IntRect(0, 0, txtSize.x, txtSize.y), cell.pos);
+			GLMeta::blitEnd();
+		}
+	}
+};
+
+FrameProfiler::FrameProfiler(RGSSThreadData &rtData)
+{
+	p = new FrameProfilerPrivate(rtData);
+
+	if (!rtData.config.profileTrace.empty())
+		p->openTrace(rtData.config.profileTrace);
+}
+
+FrameProfiler::~FrameProfiler()
+{
+	p->closeTrace();
+
+	delete p;
+}
+
+void FrameProfiler::begin(Section section)
+{
+	if (!p->active)
+		return;
+
+	p->started[section] = SDL_GetPerformanceCounter();
+}
+
+void FrameProfiler::end(Section section)
+{
+	if (!p->active || p->started[section] == 0)
+		return;
+
+	const uint64_t start = p->started[section];
+	const uint64_t dur = SDL_GetPerformanceCounter() - start;
+
+	p->current.sections[section] += dur;
+	p->started[section] = 0;
+
+	if (p->trace && !p->traceCSV)
+		p->writeEvent(sectionNames[section], start, dur);
+}
+
+void FrameProfiler::beginFrame()
+{
+	end(Script);
+
+	const uint64_t now = SDL_GetPerformanceCounter();
+
+	if (p->active && p->frameStart != 0)
+		p->closeFrame(now);
+
+	p->active = p->trace || overlayVisible();
+
+	if (!p->active)
+	{
+		p->frameStart = 0;
+		return;
+	}
+
+	p->frameStart = now;
+	begin(Update);
+}
+
+void FrameProfiler::endFrame()
+{
+	end(Update);
+	begin(Script);
+
+	if (!p->active || !overlayVisible())
+		return;
+
+	const uint64_t now = SDL_GetPerformanceCounter();
+
+	if (now - p->overlay.lastRefresh < p->freq / REFRESH_RATE)
+		return;
+
+	p->overlay.lastRefresh = now;
+	p->refreshOverlay();
+}
+
+bool FrameProfiler::overlayVisible() const
+{
+	return p->rtData.ethread->getShowProfiler();
+}
+
+void FrameProfiler::drawOverlay(TEXFBO &target, const Vec2i &size)
+{
+	if (!p->overlay.init)
+		p->initOverlay();
+
+	if (p->overlay.dirty)
+	{
+		p->renderOverlay();
+		p->overlay.dirty = false;
+	}
+
+	FBO::bind(target.fbo);
+	glState.viewport.pushSet(IntRect(0, 0, size.x, size.y));
+	glState.blend.pushSet(true);
+	glState.blendMode.pushSet(BlendNormal);
+
+	SimpleColorShader &colorShader = shState->shaders().simpleColor;
+	colorShader.bind();
+	colorShader.applyViewportProj();
+	colorShader.setTranslation(Vec2i());
+
+	p->overlay.bgQuad->draw();
+
+	SimpleShader &shader = shState->shaders().simple;
+	shader.bind();
+	shader.applyViewportProj();
+	shader.setTranslation(Vec2i());
+	shader.setTexSize(Vec2i(p->overlay.tex.width, p->overlay.tex.height));
+
+	TEX::bind(p->overlay.tex.tex);
+	p->overlay.texQuad->draw();
+
+	glState.blendMode.pop();
+	glState.blend.pop();
+	glState.viewport.pop();
+}
@@ -0,0 +1,117 @@
+/*
+** frameprofiler.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include "etc-internal.h"
+
+#include <stdint.h>
+
+struct RGSSThreadData;
+struct TEXFBO;
+struct FrameProfilerPrivate;
+
+/* Measures where the time of each frame goes, split into a few
+ * fixed sections. Results are shown in an on-screen overlay
+ * (toggled with F3) as rolling averages plus the mean of the
+ * slowest 1% of frames, and/or written to a trace file (Chrome
+ * trace JSON, or CSV if the path ends in ".csv").
+ * Recording is off while neither of them is in use */
+class FrameProfiler
+{
+public:
+	enum Section
+	{
+		/* Ruby execution between two Graphics.update calls */
+		Script,
+		/* Graphics.update as a whole */
+		Update,
+		Composite,
+		TilemapPrepare,
+		WindowPrepare,
+		/* FPSLimiter::delay */
+		Delay,
+		/* Presenting the frame (buffer swap) */
+		Swap,
+
+		SectionCount
+	};
+
+	FrameProfiler(RGSSThreadData &rtData);
+	~FrameProfiler();
+
+	/* Sections of the same kind add up over a frame.
+	 * Nesting different sections is fine */
+	void begin(Section section);
+	void end(Section section);
+
+	/* Graphics::update brackets every frame with these */
+	void beginFrame();
+	void endFrame();
+
+	bool overlayVisible() const;
+
+	/* Draws the overlay on top of 'target' (of 'size') */
+	void drawOverlay(TEXFBO &target, const Vec2i &size);
+
+	struct Scope
+	{
+		Scope(FrameProfiler &prof, Section section)
+		    : prof(prof), section(section)
+		{
+			prof.begin(section);
+		}
+
+		~Scope()
+		{
+			prof.end(section);
+		}
+
+	private:
+		FrameProfiler &prof;
+		Section section;
+	};
+
+	/* Ends the script section, begins the update
+	 * section, and the reverse on destruction */
+	struct FrameScope
+	{
+		FrameScope(FrameProfiler &prof)
+		    : prof(prof)
+		{
+			prof.beginFrame();
+		}
+
+		~FrameScope()
+		{
+			prof.endFrame();
+		}
+
+	private:
+		FrameProfiler &prof;
+	};
+
+private:
+	FrameProfilerPrivate *p;
+};
+
+#endif // FRAMEPROFILER_H
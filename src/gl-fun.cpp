@@ -97,6 +97,7 @@ void initGLFunctions()
 
 	/* Assume single digit */
 	int glMajor = *ver - '0';
+	int glMinor = (ver[1] == '.') ? ver[2] - '0' : 0;
 
 	if (glMajor < 2)
 		throw EXC("At least OpenGL (ES) 2.0 is required");
@@ -158,6 +159,34 @@ void initGLFunctions()
 		GL_VAO_FUN;
 	}
 
+	/* Instanced drawing entrypoints; all or nothing */
+	if (gles ? glMajor >= 3 : (glMajor > 3 || (glMajor == 3 && glMinor >= 3)))
+	{
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+		GL_INSTANCED_FUN;
+	}
+	else if (HAVE_EXT(ARB_instanced_arrays) && HAVE_EXT(ARB_draw_instanced))
+	{
+#undef EXT_SUFFIX
+#define EXT_SUFFIX "ARB"
+		GL_INSTANCED_FUN;
+	}
+
+	if (!gl.VertexAttribDivisor)
+		gl.DrawElementsInstanced = 0;
+
+	/* Streaming upload entrypoints; all or nothing */
+	if (glMajor >= 3 || (HAVE_EXT(ARB_map_buffer_range) && HAVE_EXT(ARB_sync)))
+	{
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+		GL_PBO_STREAM_FUN;
+
+		if (!gl.MapBufferRange || !gl.FenceSync)
+			gl.MapBufferRange = 0;
+	}
+
 	/* Debug callback entrypoints */
 	if (HAVE_EXT(KHR_debug))
 	{
@@ -185,4 +214,10 @@ void initGLFunctions()
 
 	if (!gles || glMajor >= 3 || HAVE_EXT(OES_texture_npot))
 		gl.npot_repeat = true;
+
+	if (HAVE_EXT(NVX_gpu_memory_info))
+		gl.nvx_gpu_memory_info = true;
+
+	if (HAVE_EXT(ATI_meminfo))
+		gl.ati_meminfo = true;
 }
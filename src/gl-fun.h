@@ -29,10 +29,14 @@
 #include <SDL_opengl.h>
 #endif
 
+#include <stdint.h>
+
 /* Etc */
 typedef GLenum (APIENTRYP _PFNGLGETERRORPROC) (void);
 typedef void (APIENTRYP _PFNGLCLEARCOLORPROC) (GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha);
 typedef void (APIENTRYP _PFNGLCLEARPROC) (GLbitfield mask);
+typedef void (APIENTRYP _PFNGLFLUSHPROC) (void);
+typedef void (APIENTRYP _PFNGLFINISHPROC) (void);
 typedef const GLubyte * (APIENTRYP _PFNGLGETSTRINGPROC) (GLenum name);
 typedef void (APIENTRYP _PFNGLGETINTEGERVPROC) (GLenum pname, GLint *params);
 typedef void (APIENTRYP _PFNGLPIXELSTOREIPROC) (GLenum pname, GLint param);
@@ -67,6 +71,14 @@ typedef void (APIENTRYP _PFNGLBINDBUFFERPROC) (GLenum target, GLuint buffer);
 typedef void (APIENTRYP _PFNGLBUFFERDATAPROC) (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage);
 typedef void (APIENTRYP _PFNGLBUFFERSUBDATAPROC) (GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data);
 
+/* Buffer mapping / sync objects */
+typedef void* (APIENTRYP _PFNGLMAPBUFFERRANGEPROC) (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (APIENTRYP _PFNGLUNMAPBUFFERPROC) (GLenum target);
+typedef struct __GLsync *_GLsync;
+typedef _GLsync (APIENTRYP _PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRYP _PFNGLCLIENTWAITSYNCPROC) (_GLsync sync, GLbitfield flags, uint64_t timeout);
+typedef void (APIENTRYP _PFNGLDELETESYNCPROC) (_GLsync sync);
+
 /* Shader */
 typedef GLuint (APIENTRYP _PFNGLCREATESHADERPROC) (GLenum type);
 typedef void (APIENTRYP _PFNGLDELETESHADERPROC) (GLuint shader);
@@ -110,10 +122,26 @@ typedef void (APIENTRYP _PFNGLGENVERTEXARRAYSPROC) (GLsizei n, GLuint* arrays);
 typedef void (APIENTRYP _PFNGLDELETEVERTEXARRAYSPROC) (GLsizei n, const GLuint* arrays);
 typedef void (APIENTRYP _PFNGLBINDVERTEXARRAYPROC) (GLuint array);
 
+/* Instanced drawing */
+typedef void (APIENTRYP _PFNGLDRAWELEMENTSINSTANCEDPROC) (GLenum mode, GLsizei count, GLenum type, const GLvoid* indices, GLsizei primcount);
+typedef void (APIENTRYP _PFNGLVERTEXATTRIBDIVISORPROC) (GLuint index, GLuint divisor);
+
 #ifdef GLES2_HEADER
 #define GL_NUM_EXTENSIONS 0x821D
 #define GL_READ_FRAMEBUFFER 0x8CA8
 #define GL_DRAW_FRAMEBUFFER 0x8CA9
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#define GL_STREAM_READ 0x88E1
+#define GL_MAP_READ_BIT 0x0001
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_INVALIDATE_RANGE_BIT 0x0004
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#define GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x0001
+#define GL_TIMEOUT_EXPIRED 0x911B
+#define GL_WAIT_FAILED 0x911D
 #endif
 
 #define GL_20_FUN \
@@ -121,6 +149,8 @@ typedef void (APIENTRYP _PFNGLBINDVERTEXARRAYPROC) (GLuint array);
 	GL_FUN(GetError, _PFNGLGETERRORPROC) \
 	GL_FUN(ClearColor, _PFNGLCLEARCOLORPROC) \
 	GL_FUN(Clear, _PFNGLCLEARPROC) \
+	GL_FUN(Flush, _PFNGLFLUSHPROC) \
+	GL_FUN(Finish, _PFNGLFINISHPROC) \
 	GL_FUN(GetString, _PFNGLGETSTRINGPROC) \
 	GL_FUN(GetIntegerv, _PFNGLGETINTEGERVPROC) \
 	GL_FUN(PixelStorei, _PFNGLPIXELSTOREIPROC) \
@@ -191,6 +221,19 @@ typedef void (APIENTRYP _PFNGLBINDVERTEXARRAYPROC) (GLuint array);
 	GL_FUN(DeleteVertexArrays, _PFNGLDELETEVERTEXARRAYSPROC) \
 	GL_FUN(BindVertexArray, _PFNGLBINDVERTEXARRAYPROC)
 
+#define GL_INSTANCED_FUN \
+	/* Instanced drawing */ \
+	GL_FUN(DrawElementsInstanced, _PFNGLDRAWELEMENTSINSTANCEDPROC) \
+	GL_FUN(VertexAttribDivisor, _PFNGLVERTEXATTRIBDIVISORPROC)
+
+#define GL_PBO_STREAM_FUN \
+	/* Buffer mapping / sync objects */ \
+	GL_FUN(MapBufferRange, _PFNGLMAPBUFFERRANGEPROC) \
+	GL_FUN(UnmapBuffer, _PFNGLUNMAPBUFFERPROC) \
+	GL_FUN(FenceSync, _PFNGLFENCESYNCPROC) \
+	GL_FUN(ClientWaitSync, _PFNGLCLIENTWAITSYNCPROC) \
+	GL_FUN(DeleteSync, _PFNGLDELETESYNCPROC)
+
 #define GL_DEBUG_KHR_FUN \
 	GL_FUN(DebugMessageCallback, _PFNGLDEBUGMESSAGECALLBACKPROC)
 
@@ -206,12 +249,16 @@ struct GLFunctions
 	GL_FBO_FUN
 	GL_FBO_BLIT_FUN
 	GL_VAO_FUN
+	GL_INSTANCED_FUN
+	GL_PBO_STREAM_FUN
 	GL_DEBUG_KHR_FUN
 	GL_GREMEMDY_FUN
 
 	bool glsles;
 	bool unpack_subimage;
 	bool npot_repeat;
+	bool nvx_gpu_memory_info;
+	bool ati_meminfo;
 
 #undef GL_FUN
 };
@@ -25,18 +25,227 @@
 #include "glstate.h"
 #include "quad.h"
 
+#include <string.h>
+
 namespace GLMeta
 {
 
+#define HAVE_STREAM_UPLOAD gl.MapBufferRange
+
+/* The ring is one buffer split into equally sized segments.
+ * Uploads are appended to the current segment; once it is full,
+ * a fence is placed behind it and we move on to the next one */
+static const size_t RING_SEGMENTS = 4;
+static const size_t RING_SEGMENT_SIZE = 2 * 1024 * 1024;
+
+/* Below this size, mapping the buffer costs more than
+ * letting the driver copy from client memory */
+static const size_t RING_MIN_UPLOAD = 4096;
+
+static struct
+{
+	PBO::ID pbo;
+	_GLsync fences[RING_SEGMENTS];
+
+	size_t segment;
+	size_t offset;
+
+	/* Unpack row length / skip state was changed
+	 * by a direct sub rect upload */
+	bool unpackDirty;
+
+	UploadStats current;
+	UploadStats last;
+} ring;
+
+static void resetUnpackState()
+{
+	gl.PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	gl.PixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	gl.PixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+
+	ring.unpackDirty = false;
+}
+
+static void ringAdvance()
+{
+	ring.fences[ring.segment] = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	ring.segment = (ring.segment + 1) % RING_SEGMENTS;
+	ring.offset = 0;
+
+	_GLsync &fence = ring.fences[ring.segment];
+
+	if (!fence)
+		return;
+
+	GLenum status = gl.ClientWaitSync(fence, 0, 0);
+
+	if (status != GL_TIMEOUT_EXPIRED && status != GL_WAIT_FAILED)
+	{
+		gl.DeleteSync(fence);
+		fence = 0;
+
+		return;
+	}
+
+	/* The GPU still sources from this segment. Rather than
+	 * waiting, orphan the whole buffer; the driver keeps the
+	 * old storage alive until pending transfers are done */
+	PBO::allocEmpty(RING_SEGMENTS * RING_SEGMENT_SIZE, GL_STREAM_DRAW);
+
+	for (size_t i = 0; i < RING_SEGMENTS; ++i)
+	{
+		if (ring.fences[i])
+			gl.DeleteSync(ring.fences[i]);
+
+		ring.fences[i] = 0;
+	}
+
+	++ring.current.stallsAvoided;
+}
+
+static bool ringUpload(GLint x, GLint y, GLsizei w, GLsizei h,
+                       const void *data, int pitch, GLenum format)
+{
+	const size_t rowBytes = w * 4;
+	const size_t size = rowBytes * h;
+
+	if (!ring.pbo.gl || size < RING_MIN_UPLOAD || size > RING_SEGMENT_SIZE)
+		return false;
+
+	if (ring.unpackDirty)
+		resetUnpackState();
+
+	PBO::bind(ring.pbo);
+
+	/* Keep offsets aligned for the driver's copy routines */
+	size_t offset = (ring.offset + 15) & ~(size_t) 15;
+
+	if (offset + size > RING_SEGMENT_SIZE)
+	{
+		ringAdvance();
+		offset = 0;
+	}
+
+	const size_t base = ring.segment * RING_SEGMENT_SIZE + offset;
+
+	/* Everything in this segment past 'offset' is unused by
+	 * the GPU, so there's no need for the driver to sync */
+	uint8_t *dst = static_cast<uint8_t*>
+		(gl.MapBufferRange(GL_PIXEL_UNPACK_BUFFER, base, size,
+		                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+		                   GL_MAP_UNSYNCHRONIZED_BIT));
+
+	if (!dst)
+	{
+		PBO::unbind();
+		return false;
+	}
+
+	const uint8_t *src = static_cast<const uint8_t*>(data);
+
+	if ((size_t) pitch == rowBytes)
+		memcpy(dst, src, size);
+	else
+		for (GLsizei i = 0; i < h; ++i)
+			memcpy(dst + i*rowBytes, src + i*pitch, rowBytes);
+
+	gl.UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	TEX::uploadSubImage(x, y, w, h, reinterpret_cast<const void*>(base), format);
+
+	PBO::unbind();
+
+	ring.offset = offset + size;
+
+	ring.current.bytes += size;
+	++ring.current.streamed;
+
+	return true;
+}
+
+void uploadRingInit()
+{
+	if (!HAVE_STREAM_UPLOAD)
+		return;
+
+	ring.pbo = PBO::gen();
+	PBO::bind(ring.pbo);
+	PBO::allocEmpty(RING_SEGMENTS * RING_SEGMENT_SIZE, GL_STREAM_DRAW);
+	PBO::unbind();
+}
+
+void uploadRingFini()
+{
+	if (!ring.pbo.gl)
+		return;
+
+	for (size_t i = 0; i < RING_SEGMENTS; ++i)
+		if (ring.fences[i])
+			gl.DeleteSync(ring.fences[i]);
+
+	PBO::del(ring.pbo);
+	ring.pbo = PBO::ID(0);
+}
+
+void texSubImage(GLint x, GLint y, GLsizei w, GLsizei h,
+                 const void *data, int pitch, GLenum format)
+{
+	if (ringUpload(x, y, w, h, data, pitch, format))
+		return;
+
+	if (ring.unpackDirty)
+		resetUnpackState();
+
+	if (pitch == w * 4)
+	{
+		TEX::uploadSubImage(x, y, w, h, data, format);
+	}
+	else if (gl.unpack_subimage)
+	{
+		gl.PixelStorei(GL_UNPACK_ROW_LENGTH, pitch / 4);
+		TEX::uploadSubImage(x, y, w, h, data, format);
+		gl.PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	}
+	else
+	{
+		for (GLsizei i = 0; i < h; ++i)
+			TEX::uploadSubImage(x, y+i, w, 1,
+			                    static_cast<const uint8_t*>(data) + i*pitch, format);
+	}
+
+	ring.current.bytes += w * h * 4;
+	++ring.current.direct;
+}
+
+void uploadRingFrame()
+{
+	ring.last = ring.current;
+	memset(&ring.current, 0, sizeof(ring.current));
+}
+
+const UploadStats &uploadStats()
+{
+	return ring.last;
+}
+
 void subRectImageUpload(GLint srcW, GLint srcX, GLint srcY,
                         GLint dstX, GLint dstY, GLsizei dstW, GLsizei dstH,
                         SDL_Surface *src, GLenum format)
 {
+	const uint8_t *srcPix = static_cast<const uint8_t*>(src->pixels)
+		+ srcY * src->pitch + srcX * src->format->BytesPerPixel;
+
+	if (ringUpload(dstX, dstY, dstW, dstH, srcPix, src->pitch, format))
+		return;
+
 	if (gl.unpack_subimage)
 	{
 		gl.PixelStorei(GL_UNPACK_ROW_LENGTH, srcW);
 		gl.PixelStorei(GL_UNPACK_SKIP_PIXELS, srcX);
 		gl.PixelStorei(GL_UNPACK_SKIP_ROWS, srcY);
+		ring.unpackDirty = true;
 
 		TEX::uploadSubImage(dstX, dstY, dstW, dstH, src->pixels, format);
 	}
@@ -53,16 +262,15 @@ void subRectImageUpload(GLint srcW, GLint srcX, GLint srcY,
 
 		SDL_FreeSurface(tmp);
 	}
+
+	ring.current.bytes += dstW * dstH * 4;
+	++ring.current.direct;
 }
 
 void subRectImageEnd()
 {
-	if (gl.unpack_subimage)
-	{
-		gl.PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-		gl.PixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
-		gl.PixelStorei(GL_UNPACK_SKIP_ROWS, 0);
-	}
+	if (gl.unpack_subimage && ring.unpackDirty)
+		resetUnpackState();
 }
 
 #define HAVE_NATIVE_VAO gl.GenVertexArrays
@@ -161,7 +369,7 @@ void blitBeginScreen(const Vec2i &size)
 	_blitBegin(FBO::ID(0), size);
 }
 
-void blitSource(TEXFBO &source)
+void blitSource(const TEXFBO &source)
 {
 	if (HAVE_NATIVE_BLIT)
 	{
@@ -37,6 +37,35 @@ void subRectImageUpload(GLint srcW, GLint srcX, GLint srcY,
                         SDL_Surface *src, GLenum format);
 void subRectImageEnd();
 
+/* ARB_map_buffer_range + ARB_sync */
+struct UploadStats
+{
+	/* Pixel data handed to GL for texture uploads */
+	size_t bytes;
+	/* Uploads staged through the PBO ring */
+	size_t streamed;
+	/* Uploads passed to GL straight from client memory */
+	size_t direct;
+	/* Times a ring segment was still in use by the GPU,
+	 * and the buffer was orphaned instead of waiting on it */
+	size_t stallsAvoided;
+};
+
+void uploadRingInit();
+void uploadRingFini();
+
+/* Uploads a 'w' x 'h' block of 32 bit pixels into the currently
+ * bound texture at (x, y). 'pitch' is the byte distance between
+ * source rows. Goes through the PBO ring when it pays off */
+void texSubImage(GLint x, GLint y, GLsizei w, GLsizei h,
+                 const void *data, int pitch, GLenum format);
+
+/* Call once per presented frame */
+void uploadRingFrame();
+
+/* Counters of the last completed frame */
+const UploadStats &uploadStats();
+
 /* ARB_vertex_array_object */
 struct VAO
 {
@@ -67,7 +96,7 @@ void vaoUnbind(VAO &vao);
 /* EXT_framebuffer_blit */
 void blitBegin(TEXFBO &target);
 void blitBeginScreen(const Vec2i &size);
-void blitSource(TEXFBO &source);
+void blitSource(const TEXFBO &source);
 void blitRectangle(const IntRect &src, const Vec2i &dstPos,
                    bool smooth = false);
 void blitRectangle(const IntRect &src, const IntRect &dst,
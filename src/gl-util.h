@@ -193,6 +193,12 @@ typedef struct GenericBO<GL_ARRAY_BUFFER> VBO;
 /* Index Buffer Object */
 typedef struct GenericBO<GL_ELEMENT_ARRAY_BUFFER> IBO;
 
+/* Pixel (unpack) Buffer Object */
+typedef struct GenericBO<GL_PIXEL_UNPACK_BUFFER> PBO;
+
+/* Pixel (pack) Buffer Object, for readbacks */
+typedef struct GenericBO<GL_PIXEL_PACK_BUFFER> PackPBO;
+
 #undef DEF_GL_ID
 
 /* Convenience struct wrapping a framebuffer
@@ -0,0 +1,452 @@
+/*
+** glyphatlas.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "glyphatlas.h"
+
+#include "sharedstate.h"
+#include "glstate.h"
+#include "gl-util.h"
+#include "gl-meta.h"
+#include "quad.h"
+#include "quadarray.h"
+#include "shader.h"
+#include "boost-hash.h"
+#include "eventthread.h"
+#include "config.h"
+#include "font.h"
+#include "util.h"
+
+#include <SDL_ttf.h>
+#include <SDL_surface.h>
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+/* Preferred edge length of one atlas page */
+#define PAGE_SIZE 1024
+
+/* Once this many pages are filled, the whole
+ * cache is dropped and rebuilt on demand */
+#define MAX_PAGES 4
+
+/* Empty border around each glyph inside the page
+ * so neighbouring glyphs never bleed into each other */
+#define GLYPH_PAD 1
+
+/* Empty border around the composed string in the coverage
+ * texture so the shadow / outline kernels sample zeros */
+#define COVER_PAD 1
+
+/* Font handle, (style << 16 | UCS-2 character) */
+typedef std::pair<TTF_Font*, uint32_t> GlyphKey;
+
+struct Glyph
+{
+	/* Page index, or -1 for glyphs without pixels (eg. spaces) */
+	int page;
+	IntRect rect;
+
+	/* Offset of the glyph image relative to the pen position
+	 * on the baseline / top of the line */
+	int minx, yoffset;
+};
+
+struct Page
+{
+	TEX::ID tex;
+
+	/* Simple shelf packer state */
+	int shelfY, shelfH, penX;
+};
+
+struct GlyphAtlasPrivate
+{
+	BoostHash<GlyphKey, Glyph> glyphs;
+	std::vector<Page> pages;
+	int pageSize;
+
+	/* Incremented whenever the cache is dropped, so in-flight
+	 * string layouts know their glyph references became stale */
+	unsigned int generation;
+
+	/* Glyph coverage of the current string (additively blended),
+	 * and the final colored result */
+	TEXFBO cover;
+	TEXFBO result;
+
+	SimpleQuadArray qArray;
+	Quad resolveQuad;
+
+	struct Placed
+	{
+		const Glyph *glyph;
+		int x, y;
+	};
+
+	std::vector<Placed> placed;
+
+	GlyphAtlasPrivate()
+	    : pageSize(0),
+	      generation(0)
+	{}
+
+	~GlyphAtlasPrivate()
+	{
+		for (size_t i = 0; i < pages.size(); ++i)
+			TEX::del(pages[i].tex);
+
+		if (cover.tex != TEX::ID(0))
+			TEXFBO::fini(cover);
+
+		if (result.tex != TEX::ID(0))
+			TEXFBO::fini(result);
+	}
+
+	void clear()
+	{
+		glyphs = BoostHash<GlyphKey, Glyph>();
+
+		for (size_t i = 0; i < pages.size(); ++i)
+			TEX::del(pages[i].tex);
+
+		pages.clear();
+		++generation;
+	}
+
+	void addPage()
+	{
+		if (pageSize == 0)
+			pageSize = std::min<int>(PAGE_SIZE, glState.caps.maxTexSize);
+
+		Page page;
+		page.tex = TEX::gen();
+		page.shelfY = page.shelfH = page.penX = 0;
+
+		TEX::bind(page.tex);
+		TEX::setRepeat(false);
+		TEX::setSmooth(false);
+		TEX::allocEmpty(pageSize, pageSize);
+
+		pages.push_back(page);
+	}
+
+	/* Finds space for a w*h rectangle, adding pages or
+	 * dropping the cache as needed */
+	int allocRect(int w, int h, IntRect &rect)
+	{
+		if (w + GLYPH_PAD > pageSize || h + GLYPH_PAD > pageSize)
+			return -1;
+
+		if (pages.empty())
+			addPage();
+
+		Page *page = &pages.back();
+
+		/* Start a new shelf if the current one is full */
+		if (page->penX + w + GLYPH_PAD > pageSize)
+		{
+			page->shelfY += page->shelfH;
+			page->shelfH = 0;
+			page->penX = 0;
+		}
+
+		if (page->shelfY + h + GLYPH_PAD > pageSize)
+		{
+			if (pages.size() == MAX_PAGES)
+				clear();
+
+			addPage();
+			page = &pages.back();
+		}
+
+		rect = IntRect(page->penX, page->shelfY, w, h);
+
+		page->penX += w + GLYPH_PAD;
+		page->shelfH = std::max(page->shelfH, h + GLYPH_PAD);
+
+		return pages.size() - 1;
+	}
+
+	const Glyph &getGlyph(TTF_Font *font, int style, uint16_t ch)
+	{
+		GlyphKey key(font, (style << 16) | ch);
+
+		if (glyphs.contains(key))
+			return glyphs[key];
+
+		Glyph glyph;
+		glyph.page = -1;
+		glyph.minx = glyph.yoffset = 0;
+
+		int maxy;
+
+		if (TTF_GlyphMetrics(font, ch, &glyph.minx, 0, 0, &maxy, 0) < 0)
+		{
+			glyphs.insert(key, glyph);
+			return glyphs[key];
+		}
+
+		glyph.yoffset = TTF_FontAscent(font) - maxy;
+
+		SDL_Color white = { 255, 255, 255, 255 };
+		SDL_Surface *surf;
+
+		if (shState->rtData().config.solidFonts)
+			surf = TTF_RenderGlyph_Solid(font, ch, white);
+		else
+			surf = TTF_RenderGlyph_Blended(font, ch, white);
+
+		if (surf && surf->format->format != SDL_PIXELFORMAT_ABGR8888)
+		{
+			SDL_Surface *conv = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ABGR8888, 0);
+			SDL_FreeSurface(surf);
+			surf = conv;
+		}
+
+		if (surf && surf->w > 0 && surf->h > 0)
+		{
+			glyph.page = allocRect(surf->w, surf->h, glyph.rect);
+
+			if (glyph.page >= 0)
+			{
+				TEX::bind(pages[glyph.page].tex);
+				GLMeta::texSubImage(glyph.rect.x, glyph.rect.y,
+				                    glyph.rect.w, glyph.rect.h,
+				                    surf->pixels, surf->pitch, GL_RGBA);
+			}
+		}
+
+		if (surf)
+			SDL_FreeSurface(surf);
+
+		glyphs.insert(key, glyph);
+
+		return glyphs[key];
+	}
+
+	/* Places every glyph of 'str' relative to the origin of the text
+	 * line, mirroring the layout TTF_RenderUTF8_Blended performs.
+	 * The pen moves by the advances SharedFontState::textSize
+	 * measures with, so the glyphs fit the measured width */
+	void layout(TTF_Font *font, const char *str)
+	{
+		SharedFontState &fontState = shState->fontState();
+		int style = TTF_GetFontStyle(font);
+		bool useKerning = TTF_GetFontKerning(font);
+
+		placed.clear();
+
+		int penX = 0;
+		uint16_t prev = 0;
+		bool first = true;
+
+		while (*str)
+		{
+			uint16_t ch = utf8NextUCS2(str);
+
+			if (ch == 0)
+				continue;
+
+			const Glyph &glyph = getGlyph(font, style, ch);
+
+			if (useKerning && prev)
+				penX += fontState.kerning(font, prev, ch);
+
+			/* Compensate for glyphs reaching left of the origin */
+			if (first && glyph.minx < 0)
+				penX -= glyph.minx;
+
+			if (glyph.page >= 0)
+			{
+				Placed pl;
+				pl.glyph = &glyph;
+				pl.x = penX + glyph.minx;
+				pl.y = glyph.yoffset;
+
+				placed.push_back(pl);
+			}
+
+			penX += fontState.penAdvance(font, ch);
+			prev = ch;
+			first = false;
+		}
+	}
+
+	void ensureScratch(TEXFBO &tex, int minW, int minH)
+	{
+		if (tex.tex == TEX::ID(0))
+		{
+			TEXFBO::init(tex);
+			TEXFBO::allocEmpty(tex, findNextPow2(minW), findNextPow2(minH));
+			TEXFBO::linkFBO(tex);
+
+			return;
+		}
+
+		if (minW <= tex.width && minH <= tex.height)
+			return;
+
+		TEXFBO::allocEmpty(tex, findNextPow2(std::max(minW, tex.width)),
+		                        findNextPow2(std::max(minH, tex.height)));
+	}
+};
+
+GlyphAtlas::GlyphAtlas()
+{
+	p = new GlyphAtlasPrivate;
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+	delete p;
+}
+
+bool GlyphAtlas::renderText(TTF_Font *font, const char *str,
+                            const Vec4 &color, const Vec4 &outColor,
+                            bool shadow, bool outline,
+                            TEXFBO *&texOut, Vec2i &sizeOut)
+{
+	int lineW, lineH;
+	shState->fontState().textSize(font, str, lineW, lineH);
+
+	if (lineW <= 0 || lineH <= 0)
+		return false;
+
+	/* If the cache had to be dropped while laying out, some of the
+	 * earlier glyph references are stale; a second pass is guaranteed
+	 * to fit into the freshly emptied pages */
+	unsigned int gen = p->generation;
+	p->layout(font, str);
+
+	if (gen != p->generation)
+		p->layout(font, str);
+
+	/* Outline surrounds the text by one pixel on each
+	 * side, the shadow extends it by one to the bottom right */
+	int off = outline ? 1 : 0;
+	int extra = outline ? 2 : (shadow ? 1 : 0);
+
+	int outW = lineW + extra;
+	int outH = lineH + extra;
+
+	p->ensureScratch(p->cover, outW + COVER_PAD*2, outH + COVER_PAD*2);
+	p->ensureScratch(p->result, outW, outH);
+
+	/* Build glyph quads, grouped by page */
+	std::vector<size_t> pageCounts(p->pages.size(), 0);
+
+	p->qArray.resize(p->placed.size());
+	size_t quadI = 0;
+
+	for (size_t pg = 0; pg < p->pages.size(); ++pg)
+		for (size_t i = 0; i < p->placed.size(); ++i)
+		{
+			const GlyphAtlasPrivate::Placed &pl = p->placed[i];
+
+			if (pl.glyph->page != (int) pg)
+				continue;
+
+			const IntRect &r = pl.glyph->rect;
+			FloatRect pos(pl.x, pl.y, r.w, r.h);
+
+			Quad::setTexPosRect(&p->qArray.vertices[quadI*4], r, pos);
+			++pageCounts[pg];
+			++quadI;
+		}
+
+	if (quadI > 0)
+		p->qArray.commit();
+
+	glState.scissorTest.pushSet(false);
+
+	/* Pass 1: accumulate glyph coverage */
+	FBO::bind(p->cover.fbo);
+	glState.viewport.pushSet(IntRect(0, 0, p->cover.width, p->cover.height));
+	glState.clearColor.pushSet(Vec4());
+	FBO::clear();
+	glState.clearColor.pop();
+
+	if (quadI > 0)
+	{
+		SimpleShader &shader = shState->shaders().simple;
+		shader.bind();
+		shader.applyViewportProj();
+		shader.setTexSize(Vec2i(p->pageSize, p->pageSize));
+		shader.setTranslation(Vec2i(COVER_PAD + off, COVER_PAD + off));
+
+		glState.blendMode.pushSet(BlendAddition);
+
+		size_t offset = 0;
+
+		for (size_t pg = 0; pg < p->pages.size(); ++pg)
+		{
+			if (pageCounts[pg] == 0)
+				continue;
+
+			TEX::bind(p->pages[pg].tex);
+			p->qArray.draw(offset, pageCounts[pg]);
+			offset += pageCounts[pg];
+		}
+
+		glState.blendMode.pop();
+	}
+
+	glState.viewport.pop();
+
+	/* Pass 2: resolve coverage into colored text,
+	 * applying shadow and outline */
+	FBO::bind(p->result.fbo);
+	glState.viewport.pushSet(IntRect(0, 0, p->result.width, p->result.height));
+
+	TextShader &shader = shState->shaders().text;
+	shader.bind();
+	shader.applyViewportProj();
+	shader.setTexSize(Vec2i(p->cover.width, p->cover.height));
+	shader.setTranslation(Vec2i());
+	shader.setColor(color);
+	shader.setOutColor(outColor);
+	shader.setShadow(shadow);
+	shader.setOutline(outline);
+
+	TEX::bind(p->cover.tex);
+
+	Quad &quad = p->resolveQuad;
+	quad.setTexPosRect(FloatRect(COVER_PAD, COVER_PAD, outW, outH),
+	                   FloatRect(0, 0, outW, outH));
+
+	glState.blend.pushSet(false);
+	quad.draw();
+	glState.blend.pop();
+
+	glState.viewport.pop();
+	glState.scissorTest.pop();
+
+	texOut = &p->result;
+	sizeOut = Vec2i(outW, outH);
+
+	return true;
+}
+
+void GlyphAtlas::clear()
+{
+	p->clear();
+}
@@ -0,0 +1,63 @@
+/*
+** glyphatlas.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+
+#include "etc-internal.h"
+
+struct _TTF_Font;
+struct TEXFBO;
+struct GlyphAtlasPrivate;
+
+/* Caches individually rasterized glyphs (white, alpha = coverage)
+ * in a set of shared textures, and composes whole strings out of
+ * them on the GPU. Glyphs are keyed by the font handle (which
+ * uniquely identifies face and size, see SharedFontState::getFont)
+ * and the active style (bold/italic). Outline and shadow are not
+ * part of the key, as they are applied in the text shader */
+class GlyphAtlas
+{
+public:
+	GlyphAtlas();
+	~GlyphAtlas();
+
+	/* Renders the UTF-8 string 'str' using the style currently
+	 * set on 'font' into an internal scratch texture. The result
+	 * is a non-premultiplied RGBA image located at (0, 0) whose
+	 * size is returned in 'sizeOut', equivalent to what rendering
+	 * the string via SDL_ttf with applied shadow / outline would
+	 * have produced. The returned texture is only valid until the
+	 * next call to this function. Returns false if the string
+	 * doesn't produce any pixels */
+	bool renderText(_TTF_Font *font, const char *str,
+	                const Vec4 &color, const Vec4 &outColor,
+	                bool shadow, bool outline,
+	                TEXFBO *&texOut, Vec2i &sizeOut);
+
+	/* Drops all cached glyphs */
+	void clear();
+
+private:
+	GlyphAtlasPrivate *p;
+};
+
+#endif // GLYPHATLAS_H
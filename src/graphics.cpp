@@ -37,6 +37,9 @@
 #include "intrulist.h"
 #include "binding.h"
 #include "debugwriter.h"
+#include "exception.h"
+#include "renderthread.h"
+#include "frameprofiler.h"
 
 #include <SDL_video.h>
 #include <SDL_timer.h>
@@ -148,6 +151,9 @@ public:
 		const int w = geometry.rect.w;
 		const int h = geometry.rect.h;
 
+		FrameProfiler::Scope scope(shState->profiler(), FrameProfiler::Composite);
+
+		resetCullStats();
 		shState->prepareDraw();
 
 		pp.startRender();
@@ -210,6 +216,12 @@ public:
 		brightEffect = norm < 1.0;
 	}
 
+	/* Brightness is folded in by the caller */
+	bool digest(FrameDigest &digest)
+	{
+		return digestElements(digest);
+	}
+
 	void updateReso(int width, int height)
 	{
 		geometry.rect.w = width;
@@ -297,6 +309,8 @@ struct FPSLimiter
 		if (disabled)
 			return;
 
+		FrameProfiler::Scope scope(shState->profiler(), FrameProfiler::Delay);
+
 		int64_t tickDelta = SDL_GetPerformanceCounter() - lastTickCount;
 		int64_t toDelay = tpf - tickDelta;
 
@@ -397,6 +411,12 @@ struct GraphicsPrivate
 
 	FPSLimiter fpsLimiter;
 
+	/* Digest of what the PingPong front buffer currently
+	 * shows, so unchanged frames can be presented again
+	 * without compositing (see 'skipStaticFrames') */
+	uint64_t lastDigest;
+	bool lastDigestValid;
+
 	bool frozen;
 	TEXFBO frozenScene;
 	TEXFBO currentScene;
@@ -407,6 +427,9 @@ struct GraphicsPrivate
 	 * (disposed on reset) */
 	IntruList<Disposable> dispList;
 
+	/* Null if frames are presented on the RGSS thread */
+	RenderThread *renderThread;
+
 	GraphicsPrivate(RGSSThreadData *rtData)
 	    : scRes(DEF_SCREEN_W, DEF_SCREEN_H),
 	      scSize(scRes),
@@ -417,7 +440,10 @@ struct GraphicsPrivate
 	      frameCount(0),
 	      brightness(255),
 	      fpsLimiter(frameRate),
-	      frozen(false)
+	      lastDigest(0),
+	      lastDigestValid(false),
+	      frozen(false),
+	      renderThread(0)
 	{
 		recalculateScreenSize(rtData);
 		updateScreenResoRatio(rtData);
@@ -438,10 +464,25 @@ struct GraphicsPrivate
 		TEXFBO::linkFBO(transBuffer);
 
 		fpsLimiter.resetFrameAdjust();
+
+		/* The render thread relies on native blits */
+		if (rtData->config.renderThread && gl.BlitFramebuffer)
+		{
+			try
+			{
+				renderThread = new RenderThread(*rtData);
+			}
+			catch (const Exception &exc)
+			{
+				Debug() << exc.msg;
+			}
+		}
 	}
 
 	~GraphicsPrivate()
 	{
+		delete renderThread;
+
 		TEXFBO::fini(frozenScene);
 		TEXFBO::fini(currentScene);
 
@@ -505,19 +546,85 @@ struct GraphicsPrivate
 		scriptBinding->terminate();
 	}
 
-	void swapGLBuffer()
+	/* Shows 'buffer' scaled to the window. Without
+	 * a render thread, this blocks on the swap */
+	void presentBuffer(TEXFBO &buffer, bool delay)
 	{
-		fpsLimiter.delay();
+		if (renderThread)
+		{
+			if (delay)
+				fpsLimiter.delay();
+
+			FrameProfiler::Scope scope(shState->profiler(), FrameProfiler::Swap);
+
+			renderThread->present(buffer, IntRect(0, 0, scRes.x, scRes.y),
+			                      screenRectFlipped(), winSize,
+			                      threadData->config.smoothScaling);
+
+			return;
+		}
+
+		GLMeta::blitBeginScreen(winSize);
+		GLMeta::blitSource(buffer);
+
+		FBO::clear();
+		metaBlitBufferFlippedScaled();
+
+		GLMeta::blitEnd();
+
+		if (delay)
+			fpsLimiter.delay();
+
+		FrameProfiler::Scope scope(shState->profiler(), FrameProfiler::Swap);
+
 		SDL_GL_SwapWindow(threadData->window);
+	}
+
+	void presentFrame(TEXFBO &buffer)
+	{
+		presentBuffer(buffer, true);
 
 		++frameCount;
+		GLMeta::uploadRingFrame();
 
 		threadData->ethread->notifyFrame();
 	}
 
+	/* Returns true if compositing the screen now would
+	 * produce the same image as the last time */
+	bool frameUnchanged()
+	{
+		if (!threadData->config.skipStaticFrames)
+			return false;
+
+		/* The profiler overlay is drawn into the front buffer */
+		if (shState->profiler().overlayVisible())
+		{
+			lastDigestValid = false;
+			return false;
+		}
+
+		FrameDigest digest;
+		digest.add(brightness);
+
+		if (!screen.digest(digest))
+		{
+			lastDigestValid = false;
+			return false;
+		}
+
+		bool unchanged = lastDigestValid && digest.value == lastDigest;
+
+		lastDigest = digest.value;
+		lastDigestValid = true;
+
+		return unchanged;
+	}
+
 	void compositeToBuffer(TEXFBO &buffer)
 	{
-		screen.composite();
+		if (!frameUnchanged())
+			screen.composite();
 
 		GLMeta::blitBegin(buffer);
 		GLMeta::blitSource(screen.getPP().frontBuffer());
@@ -525,26 +632,29 @@ struct GraphicsPrivate
 		GLMeta::blitEnd();
 	}
 
+	IntRect screenRectFlipped() const
+	{
+		return IntRect(scOffset.x, scSize.y+scOffset.y, scSize.x, -scSize.y);
+	}
+
 	void metaBlitBufferFlippedScaled()
 	{
 		GLMeta::blitRectangle(IntRect(0, 0, scRes.x, scRes.y),
-		                      IntRect(scOffset.x, scSize.y+scOffset.y, scSize.x, -scSize.y),
+		                      screenRectFlipped(),
 		                      threadData->config.smoothScaling);
 	}
 
 	void redrawScreen()
 	{
-		screen.composite();
+		if (!frameUnchanged())
+			screen.composite();
 
-		GLMeta::blitBeginScreen(winSize);
-		GLMeta::blitSource(screen.getPP().frontBuffer());
+		FrameProfiler &prof = shState->profiler();
 
-		FBO::clear();
-		metaBlitBufferFlippedScaled();
+		if (prof.overlayVisible())
+			prof.drawOverlay(screen.getPP().frontBuffer(), scRes);
 
-		GLMeta::blitEnd();
-
-		swapGLBuffer();
+		presentFrame(screen.getPP().frontBuffer());
 	}
 };
 
@@ -565,6 +675,8 @@ Graphics::~Graphics()
 
 void Graphics::update()
 {
+	FrameProfiler::FrameScope frame(shState->profiler());
+
 	p->checkShutDownReset();
 
 	if (p->frozen)
@@ -625,12 +737,18 @@ void Graphics::transition(int duration,
 
 	if (transMap)
 	{
+		/* Can flush pending work on the bitmap,
+		 * so it has to come before binding */
+		TEX::ID transMapTex = transMap->getGLTypes().tex;
+
 		TransShader &shader = transShader;
 		shader.bind();
 		shader.applyViewportProj();
 		shader.setFrozenScene(p->frozenScene.tex);
 		shader.setCurrentScene(p->currentScene.tex);
-		shader.setTransMap(transMap->getGLTypes().tex);
+		shader.setTransMap(transMapTex);
+		shader.setTransMapScale(Vec2((float) transMap->width()  / transMap->texSize().x,
+		                             (float) transMap->height() / transMap->texSize().y));
 		shader.setVague(vague / 512.0f);
 		shader.setTexSize(p->scRes);
 	}
@@ -690,14 +808,7 @@ void Graphics::transition(int duration,
 
 		/* Then blit it flipped and scaled to the screen */
 		FBO::unbind();
-		FBO::clear();
-
-		GLMeta::blitBeginScreen(Vec2i(p->winSize));
-		GLMeta::blitSource(p->transBuffer);
-		p->metaBlitBufferFlippedScaled();
-		GLMeta::blitEnd();
-
-		p->swapGLBuffer();
+		p->presentFrame(p->transBuffer);
 	}
 
 	glState.blend.pop();
@@ -750,15 +861,7 @@ void Graphics::fadeout(int duration)
 
 		if (p->frozen)
 		{
-			GLMeta::blitBeginScreen(p->scSize);
-			GLMeta::blitSource(p->frozenScene);
-
-			FBO::clear();
-			p->metaBlitBufferFlippedScaled();
-
-			GLMeta::blitEnd();
-
-			p->swapGLBuffer();
+			p->presentFrame(p->frozenScene);
 		}
 		else
 		{
@@ -780,15 +883,7 @@ void Graphics::fadein(int duration)
 
 		if (p->frozen)
 		{
-			GLMeta::blitBeginScreen(p->scSize);
-			GLMeta::blitSource(p->frozenScene);
-
-			FBO::clear();
-			p->metaBlitBufferFlippedScaled();
-
-			GLMeta::blitEnd();
-
-			p->swapGLBuffer();
+			p->presentFrame(p->frozenScene);
 		}
 		else
 		{
@@ -832,6 +927,7 @@ void Graphics::resizeScreen(int width, int height)
 	p->scRes = size;
 
 	p->screen.setResolution(width, height);
+	p->lastDigestValid = false;
 
 	TEX::bind(p->frozenScene.tex);
 	TEX::allocEmpty(width, height);
@@ -915,8 +1011,6 @@ void Graphics::repaintWait(const AtomicFlag &exitCond, bool checkReset)
 
 	/* Repaint the screen with the last good frame we drew */
 	TEXFBO &lastFrame = p->screen.getPP().frontBuffer();
-	GLMeta::blitBeginScreen(p->winSize);
-	GLMeta::blitSource(lastFrame);
 
 	while (!exitCond)
 	{
@@ -925,15 +1019,11 @@ void Graphics::repaintWait(const AtomicFlag &exitCond, bool checkReset)
 		if (checkReset)
 			shState->checkReset();
 
-		FBO::clear();
-		p->metaBlitBufferFlippedScaled();
-		SDL_GL_SwapWindow(p->threadData->window);
+		p->presentBuffer(lastFrame, false);
 		p->fpsLimiter.delay();
 
 		p->threadData->ethread->notifyFrame();
 	}
-
-	GLMeta::blitEnd();
 }
 
 void Graphics::addDisposable(Disposable *d)
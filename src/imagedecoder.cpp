@@ -0,0 +1,321 @@
+/*
+** imagedecoder.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imagedecoder.h"
+
+#include "sharedstate.h"
+#include "filesystem.h"
+#include "exception.h"
+#include "boost-hash.h"
+#include "sdl-util.h"
+#include "config.h"
+
+#include <SDL_image.h>
+#include <SDL_mutex.h>
+#include <SDL_surface.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <deque>
+
+struct DecodeEntry
+{
+	enum State
+	{
+		Pending,
+		Decoding,
+		Done,
+		Failed
+	};
+
+	std::string filename;
+	State state;
+
+	/* Opened on the RGSS thread, consumed by the worker */
+	SDL_RWops *ops;
+	const char *extension;
+
+	SDL_Surface *surface;
+	std::string error;
+
+	/* Set once a Bitmap is waiting on this entry;
+	 * it can no longer be evicted after that */
+	bool claimed;
+
+	std::list<DecodeEntry*>::iterator doneIter;
+};
+
+typedef std::list<DecodeEntry*> EntryList;
+
+static size_t surfaceBytes(SDL_Surface *surf)
+{
+	return surf ? surf->pitch * surf->h : 0;
+}
+
+struct ImageDecoderPrivate
+{
+	std::vector<SDL_Thread*> workers;
+
+	SDL_mutex *mutex;
+	/* Signaled when new jobs are queued */
+	SDL_cond *jobCond;
+	/* Signaled when a job finishes */
+	SDL_cond *doneCond;
+
+	BoostHash<std::string, DecodeEntry*> entries;
+	std::deque<DecodeEntry*> queue;
+
+	/* Decoded, unclaimed entries, oldest first */
+	EntryList done;
+
+	size_t bytes;
+	const size_t maxBytes;
+
+	bool quit;
+
+	ImageDecoderPrivate(const Config &conf)
+	    : bytes(0),
+	      maxBytes((size_t) conf.decodeCacheSize * 1024),
+	      quit(false)
+	{
+		mutex = SDL_CreateMutex();
+		jobCond = SDL_CreateCond();
+		doneCond = SDL_CreateCond();
+	}
+
+	~ImageDecoderPrivate()
+	{
+		SDL_DestroyCond(doneCond);
+		SDL_DestroyCond(jobCond);
+		SDL_DestroyMutex(mutex);
+	}
+
+	void deleteEntry(DecodeEntry *e)
+	{
+		if (e->ops)
+			SDL_RWclose(e->ops);
+
+		if (e->surface)
+			SDL_FreeSurface(e->surface);
+
+		delete e;
+	}
+
+	/* Drop the oldest decoded surfaces nobody asked for yet
+	 * until we're within budget again. Requires 'mutex' */
+	void enforceBudget()
+	{
+		EntryList::iterator iter = done.begin();
+
+		while (bytes > maxBytes && iter != done.end())
+		{
+			DecodeEntry *e = *iter;
+
+			if (e->claimed)
+			{
+				++iter;
+				continue;
+			}
+
+			iter = done.erase(iter);
+			bytes -= surfaceBytes(e->surface);
+			entries.remove(e->filename);
+
+			deleteEntry(e);
+		}
+	}
+
+	void worker()
+	{
+		SDL_LockMutex(mutex);
+
+		while (true)
+		{
+			while (queue.empty() && !quit)
+				SDL_CondWait(jobCond, mutex);
+
+			if (quit)
+				break;
+
+			DecodeEntry *e = queue.front();
+			queue.pop_front();
+			e->state = DecodeEntry::Decoding;
+
+			SDL_UnlockMutex(mutex);
+
+			SDL_Surface *surf = IMG_LoadTyped_RW(e->ops, 1, e->extension);
+			std::string error;
+
+			if (surf && surf->format->format != SDL_PIXELFORMAT_ABGR8888)
+			{
+				SDL_Surface *conv = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ABGR8888, 0);
+				SDL_FreeSurface(surf);
+				surf = conv;
+			}
+
+			if (!surf)
+				error = SDL_GetError();
+
+			SDL_LockMutex(mutex);
+
+			/* IMG_LoadTyped_RW closed it for us */
+			e->ops = 0;
+			e->surface = surf;
+			e->error = error;
+			e->state = surf ? DecodeEntry::Done : DecodeEntry::Failed;
+
+			done.push_back(e);
+			e->doneIter = --done.end();
+			bytes += surfaceBytes(surf);
+
+			enforceBudget();
+
+			SDL_CondBroadcast(doneCond);
+		}
+
+		SDL_UnlockMutex(mutex);
+	}
+};
+
+ImageDecoder::ImageDecoder(const Config &conf)
+{
+	p = new ImageDecoderPrivate(conf);
+
+	for (int i = 0; i < conf.decodeThreads; ++i)
+	{
+		SDL_Thread *thread = createSDLThread
+			<ImageDecoderPrivate, &ImageDecoderPrivate::worker>(p, "image_decode");
+
+		if (thread)
+			p->workers.push_back(thread);
+	}
+}
+
+ImageDecoder::~ImageDecoder()
+{
+	SDL_LockMutex(p->mutex);
+	p->quit = true;
+	SDL_CondBroadcast(p->jobCond);
+	SDL_UnlockMutex(p->mutex);
+
+	for (size_t i = 0; i < p->workers.size(); ++i)
+		SDL_WaitThread(p->workers[i], 0);
+
+	BoostHash<std::string, DecodeEntry*>::const_iterator iter;
+	for (iter = p->entries.cbegin(); iter != p->entries.cend(); ++iter)
+		p->deleteEntry(iter->second);
+
+	delete p;
+}
+
+bool ImageDecoder::preload(const char *filename)
+{
+	if (p->workers.empty())
+		return false;
+
+	SDL_LockMutex(p->mutex);
+
+	if (p->entries.contains(filename))
+	{
+		bool ready = p->entries[filename]->state == DecodeEntry::Done;
+		SDL_UnlockMutex(p->mutex);
+
+		return ready;
+	}
+
+	SDL_UnlockMutex(p->mutex);
+
+	DecodeEntry *e = new DecodeEntry;
+	e->filename = filename;
+	e->state = DecodeEntry::Pending;
+	e->surface = 0;
+	e->claimed = false;
+	e->ops = SDL_AllocRW();
+
+	/* Resolving and opening the file is cheap and touches the
+	 * FileSystem's path cache, so do it here on the RGSS thread.
+	 * 'extension' may point into 'e->filename', so it has to be
+	 * resolved against our own copy */
+	try
+	{
+		shState->fileSystem().openRead(*e->ops, e->filename.c_str(),
+		                               FileSystem::Image, true, &e->extension);
+	}
+	catch (const Exception &)
+	{
+		SDL_FreeRW(e->ops);
+		delete e;
+
+		return false;
+	}
+
+	SDL_LockMutex(p->mutex);
+
+	p->entries.insert(e->filename, e);
+	p->queue.push_back(e);
+	SDL_CondSignal(p->jobCond);
+
+	SDL_UnlockMutex(p->mutex);
+
+	return false;
+}
+
+bool ImageDecoder::take(const char *filename, SDL_Surface *&surfOut)
+{
+	if (p->workers.empty())
+		return false;
+
+	SDL_LockMutex(p->mutex);
+
+	if (!p->entries.contains(filename))
+	{
+		SDL_UnlockMutex(p->mutex);
+		return false;
+	}
+
+	DecodeEntry *e = p->entries[filename];
+	e->claimed = true;
+
+	while (e->state == DecodeEntry::Pending || e->state == DecodeEntry::Decoding)
+		SDL_CondWait(p->doneCond, p->mutex);
+
+	p->entries.remove(e->filename);
+	p->done.erase(e->doneIter);
+	p->bytes -= surfaceBytes(e->surface);
+
+	SDL_UnlockMutex(p->mutex);
+
+	if (e->state == DecodeEntry::Failed)
+	{
+		Exception exc(Exception::SDLError, "Error loading image '%s': %s",
+		              filename, e->error.c_str());
+		p->deleteEntry(e);
+
+		throw exc;
+	}
+
+	surfOut = e->surface;
+	e->surface = 0;
+	p->deleteEntry(e);
+
+	return true;
+}
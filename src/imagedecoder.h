@@ -0,0 +1,55 @@
+/*
+** imagedecoder.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+struct SDL_Surface;
+struct Config;
+struct ImageDecoderPrivate;
+
+/* Decodes image files into ABGR8888 surfaces on a pool of worker
+ * threads, ahead of the Bitmaps that will eventually be created
+ * from them. Decoded surfaces are kept in a memory bounded cache
+ * until claimed; uploading them to GL is left to the Bitmap
+ * constructor on the RGSS thread */
+class ImageDecoder
+{
+public:
+	ImageDecoder(const Config &conf);
+	~ImageDecoder();
+
+	/* Queues 'filename' (as it would be passed to Bitmap.new)
+	 * for decoding. Files that don't exist are ignored.
+	 * Returns true if the surface is already decoded */
+	bool preload(const char *filename);
+
+	/* If 'filename' was preloaded, waits for it to finish decoding,
+	 * removes it from the cache, and hands over its surface in
+	 * 'surfOut'. Throws if decoding failed. Returns false if the
+	 * file wasn't preloaded (or was evicted meanwhile) */
+	bool take(const char *filename, SDL_Surface *&surfOut);
+
+private:
+	ImageDecoderPrivate *p;
+};
+
+#endif // IMAGEDECODER_H
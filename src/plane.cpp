@@ -36,6 +36,8 @@
 
 #include <sigc++/connection.h>
 
+#include <vector>
+
 static float fwrap(float value, float range)
 {
 	float res = fmod(value, range);
@@ -60,6 +62,10 @@ struct PlanePrivate
 
 	SimpleQuadArray qArray;
 
+	/* For mega surface bitmaps, the amount of quads
+	 * in 'qArray' per texture tile, in tile order */
+	std::vector<size_t> megaQuadCounts;
+
 	EtcTemps tmp;
 
 	sigc::connection prepareCon;
@@ -85,10 +91,31 @@ struct PlanePrivate
 		prepareCon.disconnect();
 	}
 
+	bool isMega() const
+	{
+		return !nullOrDisposed(bitmap) && bitmap->megaTileCount() > 0;
+	}
+
+	/* GL can only repeat the bitmap for us if its
+	 * texture isn't padded */
+	bool canRepeat() const
+	{
+		if (!gl.npot_repeat)
+			return false;
+
+		if (nullOrDisposed(bitmap))
+			return true;
+
+		return !isMega() && bitmap->texSize() == bitmap->rect().size();
+	}
+
 	void updateQuadSource()
 	{
-		if (gl.npot_repeat)
+		if (canRepeat())
 		{
+			qArray.resize(1);
+			Quad::setPosRect(&qArray.vertices[0], FloatRect(sceneGeo.rect));
+
 			FloatRect srcRect;
 			srcRect.x = (sceneGeo.xOrigin + ox) / zoomX;
 			srcRect.y = (sceneGeo.yOrigin + oy) / zoomY;
@@ -120,6 +147,12 @@ struct PlanePrivate
 		size_t tilesX = ceil((vpw - sw + wox) / sw) + 1;
 		size_t tilesY = ceil((vph - sh + woy) / sh) + 1;
 
+		if (isMega())
+		{
+			updateMegaQuads(sw, sh, wox, woy, tilesX, tilesY);
+			return;
+		}
+
 		FloatRect tex = bitmap->rect();
 
 		qArray.resize(tilesX * tilesY);
@@ -128,7 +161,8 @@ struct PlanePrivate
 			for (size_t x = 0; x < tilesX; ++x)
 			{
 				SVertex *vert = &qArray.vertices[(y*tilesX + x) * 4];
-				FloatRect pos(x*sw - wox, y*sh - woy, sw, sh);
+				FloatRect pos(sceneGeo.rect.x + x*sw - wox,
+				              sceneGeo.rect.y + y*sh - woy, sw, sh);
 
 				Quad::setTexPosRect(vert, tex, pos);
 			}
@@ -136,6 +170,44 @@ struct PlanePrivate
 		qArray.commit();
 	}
 
+	/* Same tiling as above, but every repetition is made up
+	 * of one quad per texture tile of the mega surface */
+	void updateMegaQuads(double sw, double sh, float wox, float woy,
+	                     size_t tilesX, size_t tilesY)
+	{
+		FloatRect viewport(sceneGeo.rect);
+		int megaTiles = bitmap->megaTileCount();
+
+		megaQuadCounts.assign(megaTiles, 0);
+		qArray.clear();
+
+		for (int i = 0; i < megaTiles; ++i)
+		{
+			IntRect tile = bitmap->megaTileRect(i);
+			FloatRect tex(0, 0, tile.w, tile.h);
+
+			for (size_t y = 0; y < tilesY; ++y)
+				for (size_t x = 0; x < tilesX; ++x)
+				{
+					FloatRect pos(viewport.x + x*sw - wox + tile.x * zoomX,
+					              viewport.y + y*sh - woy + tile.y * zoomY,
+					              tile.w * zoomX, tile.h * zoomY);
+
+					if (pos.x >= viewport.x + viewport.w || pos.y >= viewport.y + viewport.h ||
+					    pos.x + pos.w <= viewport.x || pos.y + pos.h <= viewport.y)
+						continue;
+
+					qArray.vertices.resize(qArray.vertices.size() + 4);
+					Quad::setTexPosRect(&qArray.vertices[qArray.vertices.size() - 4], tex, pos);
+
+					++megaQuadCounts[i];
+				}
+		}
+
+		qArray.quadCount = qArray.vertices.size() / 4;
+		qArray.commit();
+	}
+
 	void prepare()
 	{
 		if (quadSourceDirty)
@@ -175,11 +247,7 @@ void Plane::setBitmap(Bitmap *value)
 	guardDisposed();
 
 	p->bitmap = value;
-
-	if (!value)
-		return;
-
-	value->ensureNonMega();
+	p->quadSourceDirty = true;
 }
 
 void Plane::setOX(int value)
@@ -251,6 +319,22 @@ void Plane::initDynAttribs()
 	p->tone = new Tone;
 }
 
+bool Plane::digest(FrameDigest &digest)
+{
+	digestBitmap(digest, p->bitmap);
+
+	digest.add(p->opacity.unNorm);
+	digest.add(p->blendType);
+	digest.add(p->color->norm);
+	digest.add(p->tone->norm);
+	digest.add(p->ox);
+	digest.add(p->oy);
+	digest.add(p->zoomX);
+	digest.add(p->zoomY);
+
+	return true;
+}
+
 void Plane::draw()
 {
 	if (nullOrDisposed(p->bitmap))
@@ -287,14 +371,38 @@ void Plane::draw()
 
 	glState.blendMode.pushSet(p->blendType);
 
+	if (p->isMega())
+	{
+		size_t offset = 0;
+
+		for (size_t i = 0; i < p->megaQuadCounts.size(); ++i)
+		{
+			size_t count = p->megaQuadCounts[i];
+
+			if (count == 0)
+				continue;
+
+			p->bitmap->bindMegaTile(i, *base);
+			p->qArray.draw(offset, count);
+
+			offset += count;
+		}
+
+		glState.blendMode.pop();
+
+		return;
+	}
+
 	p->bitmap->bindTex(*base);
 
-	if (gl.npot_repeat)
+	bool repeat = p->canRepeat();
+
+	if (repeat)
 		TEX::setRepeat(true);
 
 	p->qArray.draw();
 
-	if (gl.npot_repeat)
+	if (repeat)
 		TEX::setRepeat(false);
 
 	glState.blendMode.pop();
@@ -302,9 +410,6 @@ void Plane::draw()
 
 void Plane::onGeometryChange(const Scene::Geometry &geo)
 {
-	if (gl.npot_repeat)
-		Quad::setPosRect(&p->qArray.vertices[0], FloatRect(geo.rect));
-
 	p->sceneGeo = geo;
 	p->quadSourceDirty = true;
 }
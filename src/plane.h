@@ -53,6 +53,7 @@ private:
 	PlanePrivate *p;
 
 	void draw();
+	bool digest(FrameDigest &digest);
 	void onGeometryChange(const Scene::Geometry &);
 
 	void releaseResources();
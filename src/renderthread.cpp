@@ -0,0 +1,312 @@
+/*
+** renderthread.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "renderthread.h"
+
+#include "eventthread.h"
+#include "exception.h"
+#include "gl-util.h"
+#include "gl-meta.h"
+#include "sdl-util.h"
+
+#include <SDL_video.h>
+#include <SDL_mutex.h>
+
+#include <deque>
+
+/* One recorded frame, replayed by the render thread */
+struct PresentCmd
+{
+	int slot;
+	IntRect srcRect;
+	IntRect dstRect;
+	Vec2i winSize;
+	bool smooth;
+
+	/* Signals that the copy into the slot is done,
+	 * null if the RGSS thread waited for it instead */
+	_GLsync ready;
+};
+
+/* Frames in flight; the RGSS thread fills one
+ * slot while the other one is being presented */
+#define SLOT_COUNT 2
+
+struct PresentSlot
+{
+	TEXFBO buffer;
+
+	/* Set from queuing the frame until the
+	 * render thread is done reading it */
+	bool busy;
+
+	/* Signals that the render thread's blit is done,
+	 * null if it waited for it instead */
+	_GLsync released;
+};
+
+struct RenderThreadPrivate
+{
+	SDL_Window *window;
+	SDL_GLContext glCtx;
+	bool vsync;
+
+	SDL_Thread *thread;
+
+	SDL_mutex *mutex;
+	/* Signaled when a frame is queued */
+	SDL_cond *cmdCond;
+	/* Signaled when a slot is released */
+	SDL_cond *slotCond;
+
+	std::deque<PresentCmd> queue;
+	PresentSlot slots[SLOT_COUNT];
+	int nextSlot;
+
+	bool quit;
+
+	/* Sync objects can be waited on across contexts;
+	 * without them, we have to glFinish() instead */
+	bool haveSync;
+
+	RenderThreadPrivate(RGSSThreadData &rtData)
+	    : window(rtData.window),
+	      vsync(rtData.config.vsync),
+	      thread(0),
+	      nextSlot(0),
+	      quit(false),
+	      haveSync(gl.FenceSync && gl.ClientWaitSync)
+	{
+		mutex = SDL_CreateMutex();
+		cmdCond = SDL_CreateCond();
+		slotCond = SDL_CreateCond();
+
+		for (int i = 0; i < SLOT_COUNT; ++i)
+		{
+			slots[i].busy = false;
+			slots[i].released = 0;
+		}
+	}
+
+	~RenderThreadPrivate()
+	{
+		SDL_DestroyCond(slotCond);
+		SDL_DestroyCond(cmdCond);
+		SDL_DestroyMutex(mutex);
+	}
+
+	/* Makes the current context's previous commands visible
+	 * to the other context, returns what to wait on there */
+	_GLsync fence()
+	{
+		if (!haveSync)
+		{
+			gl.Finish();
+			return 0;
+		}
+
+		_GLsync sync = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		gl.Flush();
+
+		return sync;
+	}
+
+	void waitFence(_GLsync &sync)
+	{
+		if (!sync)
+			return;
+
+		gl.ClientWaitSync(sync, 0, (uint64_t) -1);
+		gl.DeleteSync(sync);
+		sync = 0;
+	}
+
+	void replay(const PresentCmd &cmd, FBO::ID readFBO)
+	{
+		const IntRect &src = cmd.srcRect;
+		const IntRect &dst = cmd.dstRect;
+
+		/* Texture storage may have been respecified
+		 * by the RGSS context, so attach it anew */
+		FBO::bind(readFBO);
+		FBO::setTarget(slots[cmd.slot].buffer.tex);
+		gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+		gl.Viewport(0, 0, cmd.winSize.x, cmd.winSize.y);
+		FBO::clear();
+
+		gl.BlitFramebuffer(src.x, src.y, src.x+src.w, src.y+src.h,
+		                   dst.x, dst.y, dst.x+dst.w, dst.y+dst.h,
+		                   GL_COLOR_BUFFER_BIT, cmd.smooth ? GL_LINEAR : GL_NEAREST);
+	}
+
+	void run()
+	{
+		SDL_GL_MakeCurrent(window, glCtx);
+		SDL_GL_SetSwapInterval(vsync ? 1 : 0);
+
+		gl.ClearColor(0, 0, 0, 1);
+
+		/* FBOs aren't shared between contexts */
+		FBO::ID readFBO = FBO::gen();
+
+		SDL_LockMutex(mutex);
+
+		while (true)
+		{
+			while (queue.empty() && !quit)
+				SDL_CondWait(cmdCond, mutex);
+
+			if (queue.empty())
+				break;
+
+			PresentCmd cmd = queue.front();
+			queue.pop_front();
+
+			SDL_UnlockMutex(mutex);
+
+			waitFence(cmd.ready);
+			replay(cmd, readFBO);
+
+			_GLsync released = fence();
+
+			SDL_LockMutex(mutex);
+
+			slots[cmd.slot].busy = false;
+			slots[cmd.slot].released = released;
+			SDL_CondBroadcast(slotCond);
+
+			SDL_UnlockMutex(mutex);
+
+			SDL_GL_SwapWindow(window);
+
+			SDL_LockMutex(mutex);
+		}
+
+		SDL_UnlockMutex(mutex);
+
+		FBO::del(readFBO);
+		SDL_GL_MakeCurrent(window, 0);
+	}
+};
+
+RenderThread::RenderThread(RGSSThreadData &rtData)
+{
+	SDL_GLContext rgssCtx = SDL_GL_GetCurrentContext();
+
+	SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+	SDL_GLContext glCtx = SDL_GL_CreateContext(rtData.window);
+	SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+
+	/* Creating a context makes it current */
+	SDL_GL_MakeCurrent(rtData.window, rgssCtx);
+
+	if (!glCtx)
+		throw Exception(Exception::MKXPError,
+		                "Error creating render thread context: %s", SDL_GetError());
+
+	p = new RenderThreadPrivate(rtData);
+	p->glCtx = glCtx;
+
+	for (int i = 0; i < SLOT_COUNT; ++i)
+		TEXFBO::init(p->slots[i].buffer);
+
+	p->thread = createSDLThread
+		<RenderThreadPrivate, &RenderThreadPrivate::run>(p, "render");
+
+	if (!p->thread)
+	{
+		for (int i = 0; i < SLOT_COUNT; ++i)
+			TEXFBO::fini(p->slots[i].buffer);
+
+		SDL_GL_DeleteContext(glCtx);
+		delete p;
+
+		throw Exception(Exception::MKXPError,
+		                "Error creating render thread: %s", SDL_GetError());
+	}
+}
+
+RenderThread::~RenderThread()
+{
+	/* Queued frames are still presented */
+	SDL_LockMutex(p->mutex);
+	p->quit = true;
+	SDL_CondBroadcast(p->cmdCond);
+	SDL_UnlockMutex(p->mutex);
+
+	SDL_WaitThread(p->thread, 0);
+
+	for (int i = 0; i < SLOT_COUNT; ++i)
+	{
+		p->waitFence(p->slots[i].released);
+		TEXFBO::fini(p->slots[i].buffer);
+	}
+
+	SDL_GL_DeleteContext(p->glCtx);
+
+	delete p;
+}
+
+void RenderThread::present(TEXFBO &buffer, const IntRect &srcRect,
+                           const IntRect &dstRect, const Vec2i &winSize, bool smooth)
+{
+	PresentSlot &slot = p->slots[p->nextSlot];
+
+	SDL_LockMutex(p->mutex);
+
+	while (slot.busy)
+		SDL_CondWait(p->slotCond, p->mutex);
+
+	SDL_UnlockMutex(p->mutex);
+
+	/* Don't overwrite the slot before the last blit from it is done */
+	p->waitFence(slot.released);
+
+	if (slot.buffer.width < srcRect.w || slot.buffer.height < srcRect.h)
+	{
+		TEXFBO::allocEmpty(slot.buffer, srcRect.w, srcRect.h);
+		TEXFBO::linkFBO(slot.buffer);
+	}
+
+	GLMeta::blitBegin(slot.buffer);
+	GLMeta::blitSource(buffer);
+	GLMeta::blitRectangle(srcRect, Vec2i());
+	GLMeta::blitEnd();
+
+	PresentCmd cmd;
+	cmd.slot = p->nextSlot;
+	cmd.srcRect = IntRect(0, 0, srcRect.w, srcRect.h);
+	cmd.dstRect = dstRect;
+	cmd.winSize = winSize;
+	cmd.smooth = smooth;
+	cmd.ready = p->fence();
+
+	SDL_LockMutex(p->mutex);
+
+	slot.busy = true;
+	p->queue.push_back(cmd);
+	SDL_CondSignal(p->cmdCond);
+
+	SDL_UnlockMutex(p->mutex);
+
+	p->nextSlot = (p->nextSlot + 1) % SLOT_COUNT;
+}
@@ -0,0 +1,57 @@
+/*
+** renderthread.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include "etc-internal.h"
+
+struct RGSSThreadData;
+struct TEXFBO;
+struct RenderThreadPrivate;
+
+/* Presents finished frames to the window from a thread of its own,
+ * with a second GL context sharing objects with the RGSS one. Each
+ * frame is copied into one of two present buffers and recorded as
+ * a small command for the render thread to replay (blit to the
+ * window + buffer swap), so the RGSS thread can go on with the next
+ * frame while the previous one is waiting on the swap */
+class RenderThread
+{
+public:
+	/* Has to be called from the RGSS thread with its
+	 * context current. Throws if no second context
+	 * could be created */
+	RenderThread(RGSSThreadData &rtData);
+	~RenderThread();
+
+	/* Queues 'srcRect' of 'buffer' to be shown in 'dstRect' (window
+	 * coordinates, bottom-up like glBlitFramebuffer) of a 'winSize'
+	 * sized window. Only blocks while both present buffers are
+	 * still in use */
+	void present(TEXFBO &buffer, const IntRect &srcRect,
+	             const IntRect &dstRect, const Vec2i &winSize, bool smooth);
+
+private:
+	RenderThreadPrivate *p;
+};
+
+#endif // RENDERTHREAD_H
@@ -21,6 +21,12 @@
 
 #include "scene.h"
 #include "sharedstate.h"
+#include "spritebatch.h"
+#include "bitmap.h"
+
+#include <SDL_rect.h>
+
+static CullStats cullCounters;
 
 Scene::Scene()
 {
@@ -41,44 +47,103 @@ Scene::~Scene()
 
 void Scene::insert(SceneElement &element)
 {
-	IntruListLink<SceneElement> *iter;
+	linkOrdered(element, elementOrder.insert(&element).first);
+}
 
-	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
+void Scene::insertAfter(SceneElement &element, SceneElement &after)
+{
+	/* Usually ends up right behind 'after' */
+	ElementSet::iterator hint = after.orderIter;
+	++hint;
+
+	linkOrdered(element, elementOrder.insert(hint, &element));
+}
+
+void Scene::reinsert(SceneElement &element)
+{
+	/* Most changes (eg. a sprite moving by a few
+	 * pixels) don't affect the order at all */
+	if (element.link.next && isOrdered(element))
+		return;
+
+	remove(element);
+	insert(element);
+}
+
+void Scene::remove(SceneElement &element)
+{
+	if (!element.link.next)
+		return;
+
+	elementOrder.erase(element.orderIter);
+	elements.remove(element.link);
+}
+
+void Scene::linkOrdered(SceneElement &element, ElementSet::iterator pos)
+{
+	element.orderIter = pos;
+
+	if (++pos == elementOrder.end())
+		elements.append(element.link);
+	else
+		elements.insertBefore(element.link, (*pos)->link);
+}
+
+bool Scene::isOrdered(SceneElement &element)
+{
+	ElementSet::iterator iter = element.orderIter;
+
+	if (iter != elementOrder.begin())
 	{
-		SceneElement *e = iter->data;
+		ElementSet::iterator prev = iter;
 
-		if (element < *e)
-		{
-			elements.insertBefore(element.link, *iter);
-			return;
-		}
+		if (!(**--prev < element))
+			return false;
+	}
+
+	if (++iter != elementOrder.end())
+	{
+		if (!(element < **iter))
+			return false;
 	}
 
-	elements.append(element.link);
+	return true;
 }
 
-void Scene::insertAfter(SceneElement &element, SceneElement &after)
+const CullStats &Scene::cullStats()
+{
+	return cullCounters;
+}
+
+void Scene::resetCullStats()
+{
+	cullCounters.visited = 0;
+	cullCounters.culled = 0;
+}
+
+bool Scene::digestElements(FrameDigest &digest)
 {
 	IntruListLink<SceneElement> *iter;
 
-	for (iter = &after.link; iter != elements.end(); iter = iter->next)
+	digest.add(geometry.xOrigin);
+	digest.add(geometry.yOrigin);
+	digest.add(geometry.rect.x);
+	digest.add(geometry.rect.y);
+	digest.add(geometry.rect.w);
+	digest.add(geometry.rect.h);
+
+	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
 	{
 		SceneElement *e = iter->data;
 
-		if (element < *e)
-		{
-			elements.insertBefore(element.link, *iter);
-			return;
-		}
-	}
+		digest.add(e);
+		digest.add(e->visible);
 
-	elements.append(element.link);
-}
+		if (e->visible && !e->digest(digest))
+			return false;
+	}
 
-void Scene::reinsert(SceneElement &element)
-{
-	elements.remove(element.link);
-	insert(element);
+	return true;
 }
 
 void Scene::notifyGeometryChange()
@@ -93,15 +158,32 @@ void Scene::notifyGeometryChange()
 
 void Scene::composite()
 {
+	SpriteBatch &batch = shState->spriteBatch();
 	IntruListLink<SceneElement> *iter;
 
 	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
 	{
 		SceneElement *e = iter->data;
 
-		if (e->visible)
-			e->draw();
+		if (!e->visible)
+			continue;
+
+		++cullCounters.visited;
+
+		if (e->isOutside(geometry.rect))
+		{
+			++cullCounters.culled;
+			continue;
+		}
+
+		if (e->batch(batch))
+			continue;
+
+		batch.flush();
+		e->draw();
 	}
+
+	batch.flush();
 }
 
 
@@ -111,6 +193,7 @@ SceneElement::SceneElement(Scene &scene, int z, int spriteY)
       z(z),
       visible(true),
       scene(&scene),
+      hasBounds(false),
       spriteY(spriteY)
 {
 	scene.insert(*this);
@@ -164,6 +247,35 @@ void SceneElement::setVisible(bool value)
 	visible = value;
 }
 
+void SceneElement::digestBitmap(FrameDigest &digest, Bitmap *bitmap)
+{
+	digest.add(bitmap);
+
+	if (nullOrDisposed(bitmap))
+		return;
+
+	digest.add(bitmap->modStamp());
+}
+
+void SceneElement::setBounds(const IntRect &value)
+{
+	bounds = value;
+	hasBounds = true;
+}
+
+void SceneElement::clearBounds()
+{
+	hasBounds = false;
+}
+
+bool SceneElement::isOutside(const IntRect &rect) const
+{
+	if (!hasBounds)
+		return false;
+
+	return !SDL_HasIntersection(&bounds, &rect);
+}
+
 bool SceneElement::operator<(const SceneElement &o) const
 {
 	/* Element draw order is decided by their Z value.
@@ -201,5 +313,10 @@ void SceneElement::setSpriteY(int value)
 void SceneElement::unlink()
 {
 	if (scene)
-		scene->elements.remove(link);
+		scene->remove(*this);
+}
+
+bool SceneElementOrder::operator()(const SceneElement *a, const SceneElement *b) const
+{
+	return *a < *b;
 }
@@ -26,14 +26,35 @@
 #include "intrulist.h"
 #include "etc.h"
 #include "etc-internal.h"
+#include "framedigest.h"
+
+#include <set>
 
 class SceneElement;
 class Viewport;
 class WindowVX;
 class Window;
+class SpriteBatch;
+class Bitmap;
 struct ScanRow;
 struct TilemapPrivate;
 
+/* Counters of the last screen composite */
+struct CullStats
+{
+	/* Visible elements looked at */
+	size_t visited;
+	/* Elements (or whole viewports) skipped for
+	 * lying completely outside of their scene */
+	size_t culled;
+};
+
+/* Display priority, see SceneElement::operator< */
+struct SceneElementOrder
+{
+	bool operator()(const SceneElement *a, const SceneElement *b) const;
+};
+
 class Scene
 {
 public:
@@ -43,6 +64,8 @@ public:
 		IntRect rect;
 	};
 
+	typedef std::set<SceneElement*, SceneElementOrder> ElementSet;
+
 	Scene();
 	virtual ~Scene();
 
@@ -51,17 +74,33 @@ public:
 
 	const Geometry &getGeometry() const { return geometry; }
 
+	static const CullStats &cullStats();
+
 protected:
 	void insert(SceneElement &element);
 	void insertAfter(SceneElement &element, SceneElement &after);
 	void reinsert(SceneElement &element);
+	void remove(SceneElement &element);
 
 	/* Notify all elements that geometry has changed */
 	void notifyGeometryChange();
 
+	static void resetCullStats();
+
+	/* Digests all elements in order, see SceneElement::digest() */
+	bool digestElements(FrameDigest &digest);
+
+	/* Kept in draw order */
 	IntruList<SceneElement> elements;
+	/* Same elements, for finding the place of
+	 * a new or reordered one in log time */
+	ElementSet elementOrder;
 	Geometry geometry;
 
+private:
+	void linkOrdered(SceneElement &element, ElementSet::iterator pos);
+	bool isOrdered(SceneElement &element);
+
 	friend class SceneElement;
 	friend class Window;
 	friend class WindowVX;
@@ -81,6 +120,20 @@ public:
 
 	virtual void aboutToAccess() const = 0;
 
+	/* Screen space area the element draws into, for skipping it
+	 * while it lies completely outside of its scene. To be kept
+	 * up to date by subclasses on position / geometry changes;
+	 * elements that never set one are never skipped */
+	void setBounds(const IntRect &value);
+	void clearBounds();
+
+	/* Element lies outside 'rect' (screen space) */
+	bool isOutside(const IntRect &rect) const;
+
+	/* Adds a bitmap's identity, disposal state and
+	 * contents to a digest (see digest()) */
+	static void digestBitmap(FrameDigest &digest, Bitmap *bitmap);
+
 protected:
 	/* A bit about OpenGL state:
 	 *
@@ -102,6 +155,17 @@ protected:
 	 */
 	virtual void draw() = 0;
 
+	/* Instead of drawing right away, elements may queue their
+	 * geometry into 'batch', which is drawn once an element
+	 * that can't be batched comes up (or the scene ends).
+	 * Returns false if the element needs a draw() call */
+	virtual bool batch(SpriteBatch &) { return false; }
+
+	/* Folds everything deciding how the element is drawn into
+	 * 'digest'. Returns false if the element can't tell, which
+	 * forces the frame to be redrawn */
+	virtual bool digest(FrameDigest &) { return false; }
+
 	// FIXME: This should be a signal
 	virtual void onGeometryChange(const Scene::Geometry &) {}
 
@@ -113,14 +177,19 @@ protected:
 	void unlink();
 
 	IntruListLink<SceneElement> link;
+	Scene::ElementSet::iterator orderIter;
 	const unsigned int creationStamp;
 	int z;
 	bool visible;
 	Scene *scene;
 
+	IntRect bounds;
+	bool hasBounds;
+
 	friend class Scene;
 	friend class Viewport;
 	friend struct TilemapPrivate;
+	friend struct SceneElementOrder;
 
 private:
 
@@ -26,13 +26,16 @@
 
 #include <assert.h>
 #include <string.h>
+#include <math.h>
 #include <iostream>
 
 #include "sprite.frag.xxd"
+#include "spriteBatch.frag.xxd"
 #include "hue.frag.xxd"
 #include "trans.frag.xxd"
 #include "transSimple.frag.xxd"
 #include "bitmapBlit.frag.xxd"
+#include "text.frag.xxd"
 #include "plane.frag.xxd"
 #include "simple.frag.xxd"
 #include "simpleColor.frag.xxd"
@@ -41,6 +44,9 @@
 #include "simple.vert.xxd"
 #include "simpleColor.vert.xxd"
 #include "sprite.vert.xxd"
+#include "spriteBatch.vert.xxd"
+#include "spriteInstanced.vert.xxd"
+#include "spriteWave.vert.xxd"
 #include "tilemap.vert.xxd"
 #include "blur.frag.xxd"
 #include "simpleMatrix.vert.xxd"
@@ -176,6 +182,10 @@ void Shader::init(const unsigned char *vert, int vertSize,
 	gl.BindAttribLocation(program, Position, "position");
 	gl.BindAttribLocation(program, TexCoord, "texCoord");
 	gl.BindAttribLocation(program, Color, "color");
+	gl.BindAttribLocation(program, Tone, "tone");
+	gl.BindAttribLocation(program, Effect, "effect");
+	gl.BindAttribLocation(program, Edges, "edges");
+	gl.BindAttribLocation(program, Origin, "origin");
 
 	gl.LinkProgram(program);
 
@@ -238,6 +248,7 @@ void ShaderBase::GLProjMat::apply(const Vec2i &value)
 void ShaderBase::init()
 {
 	GET_U(texSizeInv);
+	GET_U(texOffset);
 	GET_U(translation);
 
 	projMat.u_mat = gl.GetUniformLocation(program, "projMat");
@@ -252,6 +263,12 @@ void ShaderBase::applyViewportProj()
 void ShaderBase::setTexSize(const Vec2i &value)
 {
 	gl.Uniform2f(u_texSizeInv, 1.f / value.x, 1.f / value.y);
+	gl.Uniform2f(u_texOffset, 0, 0);
+}
+
+void ShaderBase::setTexOffset(const Vec2i &value)
+{
+	gl.Uniform2f(u_texOffset, value.x, value.y);
 }
 
 void ShaderBase::setTranslation(const Vec2i &value)
@@ -315,6 +332,7 @@ TransShader::TransShader()
 	GET_U(currentScene);
 	GET_U(frozenScene);
 	GET_U(transMap);
+	GET_U(transMapScale);
 	GET_U(prog);
 	GET_U(vague);
 }
@@ -334,6 +352,11 @@ void TransShader::setTransMap(TEX::ID tex)
 	setTexUniform(u_transMap, 3, tex);
 }
 
+void TransShader::setTransMapScale(const Vec2 &value)
+{
+	gl.Uniform2f(u_transMapScale, value.x, value.y);
+}
+
 void TransShader::setProg(float value)
 {
 	gl.Uniform1f(u_prog, value);
@@ -376,6 +399,14 @@ SpriteShader::SpriteShader()
 {
 	INIT_SHADER(sprite, sprite, SpriteShader);
 
+	initSprite();
+}
+
+SpriteShader::SpriteShader(NoInit)
+{}
+
+void SpriteShader::initSprite()
+{
 	ShaderBase::init();
 
 	GET_U(spriteMat);
@@ -417,6 +448,56 @@ void SpriteShader::setBushOpacity(float value)
 }
 
 
+SpriteWaveShader::SpriteWaveShader()
+    : SpriteShader(NoInit())
+{
+	INIT_SHADER(spriteWave, sprite, SpriteWaveShader);
+
+	initSprite();
+
+	GET_U(waveSource);
+	GET_U(waveClip);
+	GET_U(waveParams);
+	GET_U(waveStrip);
+}
+
+void SpriteWaveShader::setWaveSource(const Vec2 &pos, float zoomY)
+{
+	gl.Uniform4f(u_waveSource, pos.x, pos.y, zoomY, 0);
+}
+
+void SpriteWaveShader::setWaveClip(const Vec4 &value)
+{
+	setVec4Uniform(u_waveClip, value);
+}
+
+void SpriteWaveShader::setWaveParams(float amp, float length, float phase)
+{
+	gl.Uniform4f(u_waveParams, amp, (M_PI * 2) / length, phase, 0);
+}
+
+void SpriteWaveShader::setWaveStrip(float firstLength, float visibleLength)
+{
+	gl.Uniform2f(u_waveStrip, firstLength, visibleLength);
+}
+
+
+SpriteBatchShader::SpriteBatchShader()
+{
+	INIT_SHADER(spriteBatch, spriteBatch, SpriteBatchShader);
+
+	ShaderBase::init();
+}
+
+
+SpriteInstancedShader::SpriteInstancedShader()
+{
+	INIT_SHADER(spriteInstanced, spriteBatch, SpriteInstancedShader);
+
+	ShaderBase::init();
+}
+
+
 PlaneShader::PlaneShader()
 {
 	INIT_SHADER(simple, plane, PlaneShader);
@@ -578,3 +659,36 @@ void BltShader::setOpacity(float value)
 {
 	gl.Uniform1f(u_opacity, value);
 }
+
+
+TextShader::TextShader()
+{
+	INIT_SHADER(simple, text, TextShader);
+
+	ShaderBase::init();
+
+	GET_U(color);
+	GET_U(outColor);
+	GET_U(shadow);
+	GET_U(outline);
+}
+
+void TextShader::setColor(const Vec4 &value)
+{
+	setVec4Uniform(u_color, value);
+}
+
+void TextShader::setOutColor(const Vec4 &value)
+{
+	setVec4Uniform(u_outColor, value);
+}
+
+void TextShader::setShadow(bool value)
+{
+	gl.Uniform1f(u_shadow, value ? 1.f : 0.f);
+}
+
+void TextShader::setOutline(bool value)
+{
+	gl.Uniform1f(u_outline, value ? 1.f : 0.f);
+}
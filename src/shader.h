@@ -36,7 +36,11 @@ public:
 	{
 		Position = 0,
 		TexCoord = 1,
-		Color = 2
+		Color = 2,
+		Tone = 3,
+		Effect = 4,
+		Edges = 5,
+		Origin = 6
 	};
 
 protected:
@@ -78,13 +82,19 @@ public:
 	 * and loads it into the shaders uniform */
 	void applyViewportProj();
 
+	/* Also resets the texture offset */
 	void setTexSize(const Vec2i &value);
+	/* Added to texture coordinates before normalization, for
+	 * images located inside a larger texture. Only has an
+	 * effect on shaders using the simple(Color) / sprite
+	 * vertex stages */
+	void setTexOffset(const Vec2i &value);
 	void setTranslation(const Vec2i &value);
 
 protected:
 	void init();
 
-	GLint u_texSizeInv, u_translation;
+	GLint u_texSizeInv, u_texOffset, u_translation;
 };
 
 class SimpleShader : public ShaderBase
@@ -121,6 +131,22 @@ private:
 	GLint u_spriteMat;
 };
 
+/* Draws sprite batches; all effect
+ * parameters are vertex attributes */
+class SpriteBatchShader : public ShaderBase
+{
+public:
+	SpriteBatchShader();
+};
+
+/* Same as SpriteBatchShader, but expands instances
+ * of a unit quad (see SpriteInstance) */
+class SpriteInstancedShader : public ShaderBase
+{
+public:
+	SpriteInstancedShader();
+};
+
 class TransShader : public ShaderBase
 {
 public:
@@ -129,11 +155,12 @@ public:
 	void setCurrentScene(TEX::ID tex);
 	void setFrozenScene(TEX::ID tex);
 	void setTransMap(TEX::ID tex);
+	void setTransMapScale(const Vec2 &value);
 	void setProg(float value);
 	void setVague(float value);
 
 private:
-	GLint u_currentScene, u_frozenScene, u_transMap, u_prog, u_vague;
+	GLint u_currentScene, u_frozenScene, u_transMap, u_transMapScale, u_prog, u_vague;
 };
 
 class SimpleTransShader : public ShaderBase
@@ -161,10 +188,40 @@ public:
 	void setBushDepth(float value);
 	void setBushOpacity(float value);
 
+protected:
+	/* For variants with their own vertex stage,
+	 * which call initSprite() after init */
+	struct NoInit {};
+	SpriteShader(NoInit);
+
+	void initSprite();
+
 private:
 	GLint u_spriteMat, u_tone, u_opacity, u_color, u_bushDepth, u_bushOpacity;
 };
 
+/* Sprite shader drawing a strip of chunks (see SpritePrivate),
+ * each displaced horizontally by the wave effect */
+class SpriteWaveShader : public SpriteShader
+{
+public:
+	SpriteWaveShader();
+
+	/* Source rect position and the vertical zoom */
+	void setWaveSource(const Vec2 &pos, float zoomY);
+	/* Part of the source rect inside the bitmap, relative
+	 * to it: left, right, top, bottom */
+	void setWaveClip(const Vec4 &value);
+	/* 'phase' in radians */
+	void setWaveParams(float amp, float length, float phase);
+	/* Length of the first chunk (1 to 8), and the
+	 * visible height of the sprite */
+	void setWaveStrip(float firstLength, float visibleLength);
+
+private:
+	GLint u_waveSource, u_waveClip, u_waveParams, u_waveStrip;
+};
+
 class PlaneShader : public ShaderBase
 {
 public:
@@ -270,6 +327,21 @@ private:
 	GLint u_source, u_destination, u_subRect, u_opacity;
 };
 
+/* Glyph coverage to text resolve */
+class TextShader : public ShaderBase
+{
+public:
+	TextShader();
+
+	void setColor(const Vec4 &value);
+	void setOutColor(const Vec4 &value);
+	void setShadow(bool value);
+	void setOutline(bool value);
+
+private:
+	GLint u_color, u_outColor, u_shadow, u_outline;
+};
+
 /* Global object containing all available shaders */
 struct ShaderSet
 {
@@ -278,6 +350,9 @@ struct ShaderSet
 	SimpleAlphaShader simpleAlpha;
 	SimpleSpriteShader simpleSprite;
 	SpriteShader sprite;
+	SpriteWaveShader spriteWave;
+	SpriteBatchShader spriteBatch;
+	SpriteInstancedShader spriteInstanced;
 	PlaneShader plane;
 	TilemapShader tilemap;
 	FlashMapShader flashMap;
@@ -285,6 +360,7 @@ struct ShaderSet
 	SimpleTransShader simpleTrans;
 	HueShader hue;
 	BltShader blt;
+	TextShader text;
 	SimpleMatrixShader simpleMatrix;
 	BlurShader blur;
 	TilemapVXShader tilemapVX;
@@ -29,14 +29,23 @@
 #include "glstate.h"
 #include "shader.h"
 #include "texpool.h"
+#include "bitmapatlas.h"
+#include "tileatlascache.h"
 #include "font.h"
 #include "eventthread.h"
 #include "gl-util.h"
+#include "gl-meta.h"
 #include "global-ibo.h"
 #include "quad.h"
+#include "quadarray.h"
 #include "binding.h"
 #include "exception.h"
 #include "sharedmidistate.h"
+#include "glyphatlas.h"
+#include "spritebatch.h"
+#include "imagedecoder.h"
+#include "workerpool.h"
+#include "frameprofiler.h"
 
 #include <unistd.h>
 #include <stdio.h>
@@ -71,6 +80,8 @@ struct SharedStatePrivate
 	RGSSThreadData &rtData;
 	Config &config;
 
+	FrameProfiler profiler;
+
 	SharedMidiState midiState;
 
 	Graphics graphics;
@@ -82,20 +93,28 @@ struct SharedStatePrivate
 	ShaderSet shaders;
 
 	TexPool texPool;
+	BitmapAtlas bitmapAtlas;
+
+	ImageDecoder imageDecoder;
+
+	WorkerPool workerPool;
 
 	SharedFontState fontState;
 	Font *defaultFont;
 
-	TEX::ID globalTex;
-	int globalTexW, globalTexH;
-
 	TEXFBO gpTexFBO;
 
-	TEXFBO atlasTex;
+	TileAtlasCache atlasCache;
 
 	Quad gpQuad;
+	ColorQuadArray gpQuadArray;
+
+	GlyphAtlas glyphAtlas;
+
+	SpriteBatch spriteBatch;
 
 	unsigned int stampCounter;
+	uint64_t modStampCounter;
 
 	SharedStatePrivate(RGSSThreadData *threadData)
 	    : bindingData(0),
@@ -104,12 +123,19 @@ struct SharedStatePrivate
 	      eThread(*threadData->ethread),
 	      rtData(*threadData),
 	      config(threadData->config),
+	      profiler(*threadData),
 	      midiState(threadData->config),
 	      graphics(threadData),
 	      input(*threadData),
 	      audio(threadData->config),
+	      texPool(threadData->config),
+	      bitmapAtlas(threadData->config),
+	      imageDecoder(threadData->config),
+	      workerPool(threadData->config.workerThreads),
 	      fontState(threadData->config),
-	      stampCounter(0)
+	      atlasCache(threadData->config),
+	      stampCounter(0),
+	      modStampCounter(1)
 	{
 		if (!config.gameFolder.empty())
 		{
@@ -142,20 +168,12 @@ struct SharedStatePrivate
 
 		fileSystem.initFontSets(fontState);
 
-		globalTexW = 128;
-		globalTexH = 64;
-
-		globalTex = TEX::gen();
-		TEX::bind(globalTex);
-		TEX::setRepeat(false);
-		TEX::setSmooth(false);
-		TEX::allocEmpty(globalTexW, globalTexH);
-
 		TEXFBO::init(gpTexFBO);
-		/* Reuse starting values */
-		TEXFBO::allocEmpty(gpTexFBO, globalTexW, globalTexH);
+		TEXFBO::allocEmpty(gpTexFBO, 128, 64);
 		TEXFBO::linkFBO(gpTexFBO);
 
+		GLMeta::uploadRingInit();
+
 		/* RGSS3 games will call setup_midi, so there's
 		 * no need to do it on startup */
 		if (rgssVer <= 2)
@@ -164,9 +182,8 @@ struct SharedStatePrivate
 
 	~SharedStatePrivate()
 	{
-		TEX::del(globalTex);
+		GLMeta::uploadRingFini();
 		TEXFBO::fini(gpTexFBO);
-		TEXFBO::fini(atlasTex);
 	}
 };
 
@@ -235,7 +252,14 @@ GSATT(Audio&, audio)
 GSATT(GLState&, _glState)
 GSATT(ShaderSet&, shaders)
 GSATT(TexPool&, texPool)
+GSATT(BitmapAtlas&, bitmapAtlas)
+GSATT(ImageDecoder&, imageDecoder)
+GSATT(WorkerPool&, workerPool)
 GSATT(Quad&, gpQuad)
+GSATT(ColorQuadArray&, gpQuadArray)
+GSATT(GlyphAtlas&, glyphAtlas)
+GSATT(SpriteBatch&, spriteBatch)
+GSATT(FrameProfiler&, profiler)
 GSATT(SharedFontState&, fontState)
 GSATT(SharedMidiState&, midiState)
 
@@ -254,23 +278,6 @@ GlobalIBO &SharedState::globalIBO()
 	return *_globalIBO;
 }
 
-void SharedState::bindTex()
-{
-	TEX::bind(p->globalTex);
-	TEX::allocEmpty(p->globalTexW, p->globalTexH);
-}
-
-void SharedState::ensureTexSize(int minW, int minH, Vec2i &currentSizeOut)
-{
-	if (minW > p->globalTexW)
-		p->globalTexW = findNextPow2(minW);
-
-	if (minH > p->globalTexH)
-		p->globalTexH = findNextPow2(minH);
-
-	currentSizeOut = Vec2i(p->globalTexW, p->globalTexH);
-}
-
 TEXFBO &SharedState::gpTexFBO(int minW, int minH)
 {
 	bool needResize = false;
@@ -298,32 +305,22 @@ TEXFBO &SharedState::gpTexFBO(int minW, int minH)
 
 void SharedState::requestAtlasTex(int w, int h, TEXFBO &out)
 {
-	TEXFBO tex;
-
-	if (w == p->atlasTex.width && h == p->atlasTex.height)
-	{
-		tex = p->atlasTex;
-		p->atlasTex = TEXFBO();
-	}
-	else
-	{
-		TEXFBO::init(tex);
-		TEXFBO::allocEmpty(tex, w, h);
-		TEXFBO::linkFBO(tex);
-	}
+	out = p->atlasCache.request(w, h);
+}
 
-	out = tex;
+bool SharedState::requestAtlasTex(const TileAtlasKey &key, TEXFBO &out)
+{
+	return p->atlasCache.request(key, out);
 }
 
 void SharedState::releaseAtlasTex(TEXFBO &tex)
 {
-	/* No point in caching an invalid object */
-	if (tex.tex == TEX::ID(0))
-		return;
-
-	TEXFBO::fini(p->atlasTex);
+	p->atlasCache.release(tex, TileAtlasKey());
+}
 
-	p->atlasTex = tex;
+void SharedState::releaseAtlasTex(TEXFBO &tex, const TileAtlasKey &key)
+{
+	p->atlasCache.release(tex, key);
 }
 
 void SharedState::checkShutdown()
@@ -333,6 +330,7 @@ void SharedState::checkShutdown()
 
 	p->rtData.rqTermAck.set();
 	p->texPool.disable();
+	p->bitmapAtlas.disable();
 	scriptBinding->terminate();
 }
 
@@ -355,6 +353,11 @@ unsigned int SharedState::genTimeStamp()
 	return p->stampCounter++;
 }
 
+uint64_t SharedState::genModStamp()
+{
+	return p->modStampCounter++;
+}
+
 SharedState::SharedState(RGSSThreadData *threadData)
 {
 	p = new SharedStatePrivate(threadData);
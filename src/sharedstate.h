@@ -24,6 +24,8 @@
 
 #include <sigc++/signal.h>
 
+#include <stdint.h>
+
 #define shState SharedState::instance
 #define glState shState->_glState()
 #define rgssVer SharedState::rgssVersion
@@ -33,6 +35,7 @@ struct RGSSThreadData;
 struct GlobalIBO;
 struct SDL_Window;
 struct TEXFBO;
+struct TileAtlasKey;
 struct Quad;
 struct ShaderSet;
 
@@ -44,12 +47,21 @@ class Input;
 class Audio;
 class GLState;
 class TexPool;
+class BitmapAtlas;
+class ImageDecoder;
+class WorkerPool;
 class Font;
 class SharedFontState;
+class GlyphAtlas;
+class SpriteBatch;
+class FrameProfiler;
 struct GlobalIBO;
 struct Config;
 struct Vec2i;
 struct SharedMidiState;
+struct Vertex;
+template<class VertexType> struct QuadArray;
+typedef QuadArray<Vertex> ColorQuadArray;
 
 struct SharedState
 {
@@ -77,6 +89,15 @@ struct SharedState
 
 	TexPool &texPool() const;
 
+	/* Shared textures for small image file Bitmaps */
+	BitmapAtlas &bitmapAtlas() const;
+
+	/* Background decoding of preloaded image files */
+	ImageDecoder &imageDecoder() const;
+
+	/* Threads for splitting up CPU heavy work */
+	WorkerPool &workerPool() const;
+
 	SharedFontState &fontState() const;
 	Font &defaultFont() const;
 
@@ -86,23 +107,41 @@ struct SharedState
 
 	unsigned int genTimeStamp();
 
+	/* Bitmap modification stamps. Kept apart from the time
+	 * stamps, and wide enough to never wrap around; 0 is
+	 * never returned, so it can stand for "no bitmap" */
+	uint64_t genModStamp();
+
 	/* Returns global quad IBO, and ensures it has indices
 	 * for at least minSize quads */
 	void ensureQuadIBO(size_t minSize);
 	GlobalIBO &globalIBO();
 
-	/* Global general purpose texture */
-	void bindTex();
-	void ensureTexSize(int minW, int minH, Vec2i &currentSizeOut);
-
 	TEXFBO &gpTexFBO(int minW, int minH);
 
 	Quad &gpQuad() const;
 
+	/* General purpose quad array, contents
+	 * are only valid until the next user */
+	ColorQuadArray &gpQuadArray() const;
+
+	/* Glyph cache used for GPU text composition */
+	GlyphAtlas &glyphAtlas() const;
+
+	/* Merges draws of consecutive sprites */
+	SpriteBatch &spriteBatch() const;
+
+	/* Per-frame timing breakdown (F3 overlay / trace file) */
+	FrameProfiler &profiler() const;
+
 	/* Basically just a simple "TexPool"
-	 * replacement for Tilemap atlas use */
+	 * replacement for Tilemap atlas use. Atlases released
+	 * with a key can be requested back by the same key,
+	 * with their contents intact (see TileAtlasCache) */
 	void requestAtlasTex(int w, int h, TEXFBO &out);
+	bool requestAtlasTex(const TileAtlasKey &key, TEXFBO &out);
 	void releaseAtlasTex(TEXFBO &tex);
+	void releaseAtlasTex(TEXFBO &tex, const TileAtlasKey &key);
 
 	/* Checks EventThread's shutdown request flag and if set,
 	 * requests the binding to terminate. In this case, this
@@ -33,8 +33,12 @@
 #include "shader.h"
 #include "glstate.h"
 #include "quadarray.h"
+#include "spritebatch.h"
 
 #include <math.h>
+#include <float.h>
+#include <vector>
+#include <algorithm>
 
 #include <SDL_rect.h>
 
@@ -42,6 +46,8 @@
 
 struct SpritePrivate
 {
+	Sprite *self;
+
 	Bitmap *bitmap;
 
 	Quad quad;
@@ -52,15 +58,14 @@ struct SpritePrivate
 
 	bool mirrored;
 	int bushDepth;
-	float efBushDepth;
+	/* Bush depth in bitmap pixels */
+	float bushLine;
 	NormValue bushOpacity;
 	NormValue opacity;
 	BlendType blendType;
 
-	SDL_Rect sceneRect;
-
-	/* Would this sprite be visible on
-	 * the screen if drawn? */
+	/* Has anything to draw at all; whether that
+	 * lands on screen is up to the scene bounds */
 	bool isVisible;
 
 	Color *color;
@@ -77,19 +82,33 @@ struct SpritePrivate
 		bool active;
 		/* qArray needs updating */
 		bool dirty;
+		/* Chunk strip for positive amplitudes, a
+		 * single plain quad for negative ones */
 		SimpleQuadArray qArray;
 	} wave;
 
+	/* Mega surface bitmaps are drawn with one
+	 * quad per texture tile intersecting srcRect */
+	struct
+	{
+		/* Tile index per quad */
+		std::vector<int> tiles;
+		/* qArray needs updating */
+		bool dirty;
+		SimpleQuadArray qArray;
+	} mega;
+
 	EtcTemps tmp;
 
 	sigc::connection prepareCon;
 
-	SpritePrivate()
-	    : bitmap(0),
+	SpritePrivate(Sprite *self)
+	    : self(self),
+	      bitmap(0),
 	      srcRect(&tmp.rect),
 	      mirrored(false),
 	      bushDepth(0),
-	      efBushDepth(0),
+	      bushLine(0),
 	      bushOpacity(128),
 	      opacity(255),
 	      blendType(BlendNormal),
@@ -98,8 +117,6 @@ struct SpritePrivate
 	      tone(&tmp.tone)
 
 	{
-		sceneRect.x = sceneRect.y = 0;
-
 		updateSrcRectCon();
 
 		prepareCon = shState->prepareDraw.connect
@@ -110,6 +127,8 @@ struct SpritePrivate
 		wave.speed = 360;
 		wave.phase = 0.0;
 		wave.dirty = false;
+
+		mega.dirty = false;
 	}
 
 	~SpritePrivate()
@@ -128,20 +147,56 @@ struct SpritePrivate
 		                     (srcRect->y + srcRect->height) +
 		                     bitmap->height();
 
-		efBushDepth = 1.0 - texBushDepth / bitmap->height();
+		bushLine = bitmap->height() - texBushDepth;
+	}
+
+	/* The shader compares against texture coordinates, which
+	 * are normalized by the (padded) texture size and shifted
+	 * by the bitmap's position inside of it. The latter can
+	 * change any time, so this is computed at draw time */
+	float effectiveBushDepth() const
+	{
+		return (bushLine + bitmap->texOrigin().y) / bitmap->texSize().y;
+	}
+
+	/* The part of srcRect inside the bitmap, which is all that
+	 * gets drawn; past its edges, atlas pages hold other
+	 * bitmaps' pixels */
+	IntRect srcPart()
+	{
+		IntRect src = srcRect->toIntRect();
+		IntRect part = src;
+
+		if (!nullOrDisposed(bitmap))
+		{
+			IntRect bounds = bitmap->rect();
+
+			if (!SDL_IntersectRect(&bounds, &src, &part))
+				part = IntRect(src.x, src.y, 0, 0);
+		}
+
+		return part;
 	}
 
 	void onSrcRectChange()
 	{
+		IntRect src = srcRect->toIntRect();
+		IntRect part = srcPart();
+
+		FloatRect tex(part.x, part.y, part.w, part.h);
+		FloatRect pos(part.x - src.x, part.y - src.y, part.w, part.h);
+
 		if (mirrored)
-			quad.setTexRect(srcRect->toFloatRect().hFlipped());
-		else
-			quad.setTexRect(srcRect->toFloatRect());
+		{
+			tex = tex.hFlipped();
+			pos.x = src.w - (pos.x + pos.w);
+		}
 
-		quad.setPosRect(IntRect(0, 0, srcRect->width, srcRect->height));
+		quad.setTexPosRect(tex, pos);
 		recomputeBushDepth();
 
 		wave.dirty = true;
+		mega.dirty = true;
 	}
 
 	void updateSrcRectCon()
@@ -153,7 +208,9 @@ struct SpritePrivate
 				(sigc::mem_fun(this, &SpritePrivate::onSrcRectChange));
 	}
 
-	void updateVisibility()
+	/* Called by prepare() once per frame; the scene uses
+	 * the resulting bounds to skip off screen sprites */
+	void updateVisibility(Sprite *self)
 	{
 		isVisible = false;
 
@@ -163,46 +220,52 @@ struct SpritePrivate
 		if (!opacity)
 			return;
 
+		isVisible = true;
+
 		if (wave.active)
 		{
 			/* Don't do expensive wave bounding box
 			 * calculations */
-			isVisible = true;
+			self->clearBounds();
 			return;
 		}
 
-		/* Compare sprite bounding box against the scene */
+		/* Bounding box of the transformed quad */
+		const float *mat = trans.getMatrix();
+		float minX = FLT_MAX, minY = FLT_MAX;
+		float maxX = -FLT_MAX, maxY = -FLT_MAX;
 
-		/* If sprite is zoomed/rotated, just opt out for now
-		 * for simplicity's sake */
-		const Vec2 &scale = trans.getScale();
-		if (scale.x != 1 || scale.y != 1 || trans.getRotation() != 0)
+		for (int i = 0; i < 4; ++i)
 		{
-			isVisible = true;
-			return;
+			const Vec2 &v = quad.vert[i].pos;
+			const float x = mat[0]*v.x + mat[4]*v.y + mat[12];
+			const float y = mat[1]*v.x + mat[5]*v.y + mat[13];
+
+			minX = std::min(minX, x);
+			minY = std::min(minY, y);
+			maxX = std::max(maxX, x);
+			maxY = std::max(maxY, y);
 		}
 
-		SDL_Rect self;
-		self.x = trans.getPosition().x - trans.getOrigin().x;
-		self.y = trans.getPosition().y - trans.getOrigin().y;
-		self.w = bitmap->width();
-		self.h = bitmap->height();
+		const int x = floorf(minX);
+		const int y = floorf(minY);
 
-		isVisible = SDL_HasIntersection(&self, &sceneRect);
+		self->setBounds(IntRect(x, y, ceilf(maxX) - x, ceilf(maxY) - y));
 	}
 
-	void emitWaveChunk(SVertex *&vert, float phase, int width,
-	                   float zoomY, int chunkY, int chunkLength)
+	/* The length of the sprite as it appears on screen */
+	int waveVisibleLength()
 	{
-		float wavePos = phase + (chunkY / (float) wave.length) * M_PI * 2;
-		float chunkX = sin(wavePos) * wave.amp;
+		return srcRect->height * trans.getScale().y;
+	}
 
-		FloatRect tex(0, chunkY / zoomY, width, chunkLength / zoomY);
-		FloatRect pos = tex;
-		pos.x = chunkX;
+	/* The strip is cut into 8 pixel chunks (on screen) aligned
+	 * to 8 pixel screen rows, so the first one can be shorter */
+	int waveFirstLength()
+	{
+		int first = ((int) trans.getPosition().y % 8 + 8) % 8;
 
-		Quad::setTexPosRect(vert, tex, pos);
-		vert += 4;
+		return first > 0 ? first : 8;
 	}
 
 	void updateWave()
@@ -219,8 +282,6 @@ struct SpritePrivate
 		wave.active = true;
 
 		int width = srcRect->width;
-		int height = srcRect->height;
-		float zoomY = trans.getScale().y;
 
 		if (wave.amp < -(width / 2))
 		{
@@ -246,33 +307,103 @@ struct SpritePrivate
 			return;
 		}
 
-		/* The length of the sprite as it appears on screen */
-		int visibleLength = height * zoomY;
+		/* The chunks themselves are placed and displaced by the
+		 * wave vertex shader; vertices only carry the index of
+		 * their chunk and of the chunk boundary they sit on, so
+		 * the strip only changes with the chunk count */
+		size_t chunks = waveVisibleLength() / 8 + 2;
+
+		if (wave.qArray.count() == chunks)
+			return;
+
+		wave.qArray.resize(chunks);
+
+		for (size_t i = 0; i < chunks; ++i)
+		{
+			FloatRect tex(i, 0, 0, 0);
+			FloatRect pos(0, i, 1, 1);
+
+			Quad::setTexPosRect(&wave.qArray.vertices[i*4], tex, pos);
+		}
+
+		wave.qArray.commit();
+	}
+
+	void setWaveUniforms(SpriteWaveShader &shader)
+	{
+		IntRect src = srcRect->toIntRect();
+		IntRect part = srcPart();
+
+		shader.setWaveSource(Vec2(src.x, src.y), trans.getScale().y);
+		shader.setWaveClip(Vec4(part.x - src.x, part.x - src.x + part.w,
+		                        part.y - src.y, part.y - src.y + part.h));
+		shader.setWaveParams(wave.amp, wave.length, (wave.phase * M_PI) / 180.f);
+		shader.setWaveStrip(waveFirstLength(), waveVisibleLength());
+	}
 
-		/* First chunk length (aligned to 8 pixel boundary */
-		int firstLength = ((int) trans.getPosition().y) % 8;
+	void updateMegaQuads()
+	{
+		mega.tiles.clear();
 
-		/* Amount of full 8 pixel chunks in the middle */
-		int chunks = (visibleLength - firstLength) / 8;
+		if (nullOrDisposed(bitmap))
+			return;
 
-		/* Final chunk length */
-		int lastLength = (visibleLength - firstLength) % 8;
+		IntRect src = srcRect->toIntRect();
+		std::vector<IntRect> parts;
 
-		wave.qArray.resize(!!firstLength + chunks + !!lastLength);
-		SVertex *vert = &wave.qArray.vertices[0];
+		for (int i = 0; i < bitmap->megaTileCount(); ++i)
+		{
+			IntRect tile = bitmap->megaTileRect(i);
+			IntRect part;
 
-		float phase = (wave.phase * M_PI) / 180.f;
+			if (!SDL_IntersectRect(&tile, &src, &part))
+				continue;
 
-		if (firstLength > 0)
-			emitWaveChunk(vert, phase, width, zoomY, 0, firstLength);
+			mega.tiles.push_back(i);
+			parts.push_back(part);
+		}
 
-		for (int i = 0; i < chunks; ++i)
-			emitWaveChunk(vert, phase, width, zoomY, firstLength + i * 8, 8);
+		mega.qArray.resize(parts.size());
 
-		if (lastLength > 0)
-			emitWaveChunk(vert, phase, width, zoomY, firstLength + chunks * 8, lastLength);
+		for (size_t i = 0; i < parts.size(); ++i)
+		{
+			const IntRect &part = parts[i];
+			IntRect tile = bitmap->megaTileRect(mega.tiles[i]);
 
-		wave.qArray.commit();
+			FloatRect tex(part.x - tile.x, part.y - tile.y, part.w, part.h);
+			FloatRect pos(part.x - src.x, part.y - src.y, part.w, part.h);
+
+			if (mirrored)
+			{
+				tex = tex.hFlipped();
+				pos.x = src.w - (pos.x + pos.w);
+			}
+
+			Quad::setTexPosRect(&mega.qArray.vertices[i*4], tex, pos);
+		}
+
+		mega.qArray.commit();
+	}
+
+	void drawMega(ShaderBase &shader, bool effect)
+	{
+		for (size_t i = 0; i < mega.tiles.size(); ++i)
+		{
+			int tile = mega.tiles[i];
+			Vec2i texSize = bitmap->bindMegaTile(tile, shader);
+
+			/* Bush depth is in normalized texture
+			 * coordinates, so rebase it per tile */
+			if (effect)
+			{
+				IntRect rect = bitmap->megaTileRect(tile);
+				float depth = (bushLine - rect.y) / texSize.y;
+
+				static_cast<SpriteShader&>(shader).setBushDepth(depth);
+			}
+
+			mega.qArray.draw(i, 1);
+		}
 	}
 
 	void prepare()
@@ -283,14 +414,22 @@ struct SpritePrivate
 			wave.dirty = false;
 		}
 
-		updateVisibility();
+		if (mega.dirty)
+		{
+			if (!nullOrDisposed(bitmap) && bitmap->megaTileCount() > 0)
+				updateMegaQuads();
+
+			mega.dirty = false;
+		}
+
+		updateVisibility(self);
 	}
 };
 
 Sprite::Sprite(Viewport *viewport)
     : ViewportElement(viewport)
 {
-	p = new SpritePrivate;
+	p = new SpritePrivate(this);
 	onGeometryChange(scene->getGeometry());
 }
 
@@ -335,13 +474,11 @@ void Sprite::setBitmap(Bitmap *bitmap)
 	if (nullOrDisposed(bitmap))
 		return;
 
-	bitmap->ensureNonMega();
-
 	*p->srcRect = bitmap->rect();
 	p->onSrcRectChange();
-	p->quad.setPosRect(p->srcRect->toFloatRect());
 
 	p->wave.dirty = true;
+	p->mega.dirty = true;
 }
 
 void Sprite::setX(int value)
@@ -364,10 +501,7 @@ void Sprite::setY(int value)
 	p->trans.setPosition(Vec2(getX(), value));
 
 	if (rgssVer >= 2)
-	{
-		p->wave.dirty = true;
 		setSpriteY(value);
-	}
 }
 
 void Sprite::setOX(int value)
@@ -499,7 +633,6 @@ void Sprite::update()
 	Flashable::update();
 
 	p->wave.phase += p->wave.speed / 180;
-	p->wave.dirty = true;
 }
 
 /* SceneElement */
@@ -519,9 +652,16 @@ void Sprite::draw()
 	                    flashing              ||
 	                    p->bushDepth != 0;
 
-	if (renderEffect)
+	/* Positive amplitudes displace the strip in the vertex
+	 * shader, which only comes with the full sprite effects */
+	bool waveStrip = p->wave.active && p->wave.amp > 0 &&
+	                 p->bitmap->megaTileCount() == 0;
+
+	if (renderEffect || waveStrip)
 	{
-		SpriteShader &shader = shState->shaders().sprite;
+		SpriteShader &shader = waveStrip ?
+			static_cast<SpriteShader&>(shState->shaders().spriteWave) :
+			shState->shaders().sprite;
 
 		shader.bind();
 		shader.applyViewportProj();
@@ -529,9 +669,12 @@ void Sprite::draw()
 
 		shader.setTone(p->tone->norm);
 		shader.setOpacity(p->opacity.norm);
-		shader.setBushDepth(p->efBushDepth);
 		shader.setBushOpacity(p->bushOpacity.norm);
 
+		/* Mega surfaces set it per tile */
+		if (p->bitmap->megaTileCount() == 0)
+			shader.setBushDepth(p->effectiveBushDepth());
+
 		/* When both flashing and effective color are set,
 		 * the one with higher alpha will be blended */
 		const Vec4 *blend = (flashing && flashColor.w > p->color->norm.w) ?
@@ -539,6 +682,9 @@ void Sprite::draw()
 
 		shader.setColor(*blend);
 
+		if (waveStrip)
+			p->setWaveUniforms(static_cast<SpriteWaveShader&>(shader));
+
 		base = &shader;
 	}
 	else
@@ -553,6 +699,15 @@ void Sprite::draw()
 
 	glState.blendMode.pushSet(p->blendType);
 
+	if (p->bitmap->megaTileCount() > 0)
+	{
+		/* Wave effects aren't applied to mega surfaces */
+		p->drawMega(*base, renderEffect);
+		glState.blendMode.pop();
+
+		return;
+	}
+
 	p->bitmap->bindTex(*base);
 
 	if (p->wave.active)
@@ -563,6 +718,83 @@ void Sprite::draw()
 	glState.blendMode.pop();
 }
 
+bool Sprite::batch(SpriteBatch &batch)
+{
+	if (!p->isVisible || emptyFlashFlag)
+		return true;
+
+	/* These take more than one quad */
+	if (p->wave.active || p->bitmap->megaTileCount() > 0)
+		return false;
+
+	/* Same parameters the sprite shader would get */
+	const Vec4 &color = (flashing && flashColor.w > p->color->norm.w) ?
+	                    flashColor : p->color->norm;
+
+	const Vec4 effect(p->opacity.norm, p->effectiveBushDepth(),
+	                  p->bushOpacity.norm, 0);
+
+	const float *mat = p->trans.getMatrix();
+	const Vec2i origin = p->bitmap->texOrigin();
+
+	/* The quad is a rectangle, and stays a parallelogram
+	 * under the transform, so three corners describe it */
+	Vec2 pos[4];
+
+	for (int i = 0; i < 4; ++i)
+	{
+		const Vec2 &v = p->quad.vert[i].pos;
+
+		pos[i] = Vec2(mat[0]*v.x + mat[4]*v.y + mat[12],
+		              mat[1]*v.x + mat[5]*v.y + mat[13]);
+	}
+
+	const Vertex *vert = p->quad.vert;
+
+	SpriteInstance inst;
+	inst.origin = pos[0];
+	inst.edges = Vec4(pos[1].x - pos[0].x, pos[1].y - pos[0].y,
+	                  pos[3].x - pos[0].x, pos[3].y - pos[0].y);
+	inst.texRect = Vec4(vert[0].texPos.x + origin.x, vert[0].texPos.y + origin.y,
+	                    vert[1].texPos.x - vert[0].texPos.x,
+	                    vert[3].texPos.y - vert[0].texPos.y);
+	inst.color = color;
+	inst.tone = p->tone->norm;
+	inst.effect = effect;
+
+	batch.append(*p->bitmap, p->blendType, inst);
+
+	return true;
+}
+
+bool Sprite::digest(FrameDigest &digest)
+{
+	digestBitmap(digest, p->bitmap);
+	digestFlash(digest);
+
+	digest.addBytes(p->trans.getMatrix(), sizeof(float) * 16);
+	digest.add(p->srcRect->x);
+	digest.add(p->srcRect->y);
+	digest.add(p->srcRect->width);
+	digest.add(p->srcRect->height);
+	digest.add(p->mirrored);
+	digest.add(p->bushDepth);
+	digest.add(p->bushOpacity.unNorm);
+	digest.add(p->opacity.unNorm);
+	digest.add(p->blendType);
+	digest.add(p->color->norm);
+	digest.add(p->tone->norm);
+
+	/* The strip's first chunk follows the Y position,
+	 * which is only part of the matrix in sum */
+	digest.add(p->trans.getPosition());
+	digest.add(p->wave.amp);
+	digest.add(p->wave.length);
+	digest.add(p->wave.phase);
+
+	return true;
+}
+
 void Sprite::onGeometryChange(const Scene::Geometry &geo)
 {
 	/* Offset at which the sprite will be drawn
@@ -571,9 +803,6 @@ void Sprite::onGeometryChange(const Scene::Geometry &geo)
 	int yOffset = geo.rect.y - geo.yOrigin;
 
 	p->trans.setGlobalOffset(xOffset, yOffset);
-
-	p->sceneRect.w = geo.rect.w;
-	p->sceneRect.h = geo.rect.h;
 }
 
 void Sprite::releaseResources()
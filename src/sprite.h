@@ -73,6 +73,8 @@ private:
 	SpritePrivate *p;
 
 	void draw();
+	bool batch(SpriteBatch &batch);
+	bool digest(FrameDigest &digest);
 	void onGeometryChange(const Scene::Geometry &);
 
 	void releaseResources();
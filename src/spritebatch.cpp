@@ -0,0 +1,261 @@
+/*
+** spritebatch.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "spritebatch.h"
+
+#include "bitmap.h"
+#include "quadarray.h"
+#include "sharedstate.h"
+#include "global-ibo.h"
+#include "glstate.h"
+#include "shader.h"
+
+#include <vector>
+#include <algorithm>
+
+/* Quads per draw call without instancing; the
+ * global IBO only holds 16 bit indices */
+#define MAX_FALLBACK_QUADS 8192
+
+#define HAVE_INSTANCING gl.DrawElementsInstanced
+#define HAVE_NATIVE_VAO gl.GenVertexArrays
+
+/* Unit square, in quad vertex order */
+static const float cornerU[] = { 0, 1, 1, 0 };
+static const float cornerV[] = { 0, 0, 1, 1 };
+
+static void expandInstance(const SpriteInstance &inst, SpriteVertex vert[4])
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		const float u = cornerU[i];
+		const float v = cornerV[i];
+
+		vert[i].pos = Vec2(inst.origin.x + u*inst.edges.x + v*inst.edges.z,
+		                   inst.origin.y + u*inst.edges.y + v*inst.edges.w);
+		vert[i].texPos = Vec2(inst.texRect.x + u*inst.texRect.z,
+		                      inst.texRect.y + v*inst.texRect.w);
+		vert[i].color = inst.color;
+		vert[i].tone = inst.tone;
+		vert[i].effect = inst.effect;
+	}
+}
+
+struct SpriteBatchPrivate
+{
+	std::vector<SpriteInstance> instances;
+
+	/* Bitmap of the first queued quad; all
+	 * others share its texture */
+	Bitmap *bitmap;
+	TEX::ID tex;
+	BlendType blendType;
+
+	/* Instanced path: unit square corners,
+	 * and the instance stream */
+	VBO::ID cornerVBO;
+	VBO::ID instVBO;
+	GLuint nativeVAO;
+
+	/* Fallback path */
+	QuadArray<SpriteVertex> qArray;
+
+	SpriteBatchPrivate()
+	    : bitmap(0),
+	      tex(0),
+	      blendType(BlendNormal),
+	      cornerVBO(0),
+	      instVBO(0),
+	      nativeVAO(0)
+	{
+		if (!HAVE_INSTANCING)
+			return;
+
+		Vec2 corners[4];
+
+		for (int i = 0; i < 4; ++i)
+			corners[i] = Vec2(cornerU[i], cornerV[i]);
+
+		cornerVBO = VBO::gen();
+		VBO::bind(cornerVBO);
+		VBO::uploadData(sizeof(corners), corners);
+		VBO::unbind();
+
+		instVBO = VBO::gen();
+
+		/* Every instance uses the first quad's indices */
+		shState->ensureQuadIBO(1);
+
+		if (HAVE_NATIVE_VAO)
+		{
+			gl.GenVertexArrays(1, &nativeVAO);
+			gl.BindVertexArray(nativeVAO);
+			bindInstanceAttribs();
+			gl.BindVertexArray(0);
+		}
+	}
+
+	~SpriteBatchPrivate()
+	{
+		if (!HAVE_INSTANCING)
+			return;
+
+		if (HAVE_NATIVE_VAO)
+			gl.DeleteVertexArrays(1, &nativeVAO);
+
+		VBO::del(instVBO);
+		VBO::del(cornerVBO);
+	}
+
+	void bindInstanceAttribs()
+	{
+		VBO::bind(cornerVBO);
+		gl.EnableVertexAttribArray(Shader::Position);
+		gl.VertexAttribPointer(Shader::Position, 2, GL_FLOAT, GL_FALSE, sizeof(Vec2), 0);
+
+		VBO::bind(instVBO);
+
+		for (GLsizei i = 0; i < VertexTraits<SpriteInstance>::attrCount; ++i)
+		{
+			const VertexAttribute &va = VertexTraits<SpriteInstance>::attr[i];
+
+			gl.EnableVertexAttribArray(va.index);
+			gl.VertexAttribPointer(va.index, va.size, va.type, GL_FALSE,
+			                       sizeof(SpriteInstance), va.offset);
+			gl.VertexAttribDivisor(va.index, 1);
+		}
+
+		IBO::bind(shState->globalIBO().ibo);
+	}
+
+	void unbindInstanceAttribs()
+	{
+		gl.DisableVertexAttribArray(Shader::Position);
+
+		/* Divisors are global state without a VAO,
+		 * and would break every other draw call */
+		for (GLsizei i = 0; i < VertexTraits<SpriteInstance>::attrCount; ++i)
+		{
+			const VertexAttribute &va = VertexTraits<SpriteInstance>::attr[i];
+
+			gl.VertexAttribDivisor(va.index, 0);
+			gl.DisableVertexAttribArray(va.index);
+		}
+
+		VBO::unbind();
+		IBO::unbind();
+	}
+
+	void drawInstanced()
+	{
+		VBO::bind(instVBO);
+		VBO::uploadData(instances.size() * sizeof(SpriteInstance),
+		                dataPtr(instances), GL_STREAM_DRAW);
+		VBO::unbind();
+
+		if (HAVE_NATIVE_VAO)
+			gl.BindVertexArray(nativeVAO);
+		else
+			bindInstanceAttribs();
+
+		gl.DrawElementsInstanced(GL_TRIANGLES, 6, _GL_INDEX_TYPE, 0, instances.size());
+
+		if (HAVE_NATIVE_VAO)
+			gl.BindVertexArray(0);
+		else
+			unbindInstanceAttribs();
+	}
+
+	void drawExpanded()
+	{
+		for (size_t i = 0; i < instances.size(); i += MAX_FALLBACK_QUADS)
+		{
+			size_t count = std::min<size_t>(instances.size() - i, MAX_FALLBACK_QUADS);
+			qArray.resize(count);
+
+			for (size_t j = 0; j < count; ++j)
+				expandInstance(instances[i+j], &qArray.vertices[j*4]);
+
+			qArray.commit();
+			qArray.draw();
+		}
+
+		qArray.clear();
+	}
+};
+
+SpriteBatch::SpriteBatch()
+{
+	p = new SpriteBatchPrivate;
+}
+
+SpriteBatch::~SpriteBatch()
+{
+	delete p;
+}
+
+void SpriteBatch::append(Bitmap &bitmap, BlendType blendType,
+                         const SpriteInstance &inst)
+{
+	TEX::ID tex = bitmap.texture().tex;
+
+	if (p->bitmap && (tex != p->tex || blendType != p->blendType))
+		flush();
+
+	if (!p->bitmap)
+	{
+		p->bitmap = &bitmap;
+		p->tex = tex;
+		p->blendType = blendType;
+	}
+
+	p->instances.push_back(inst);
+}
+
+void SpriteBatch::flush()
+{
+	if (!p->bitmap)
+		return;
+
+	ShaderSet &shaders = shState->shaders();
+	ShaderBase &shader = HAVE_INSTANCING ?
+		static_cast<ShaderBase&>(shaders.spriteInstanced) :
+		static_cast<ShaderBase&>(shaders.spriteBatch);
+
+	shader.bind();
+	shader.applyViewportProj();
+
+	/* Texture coordinates already include the
+	 * offset of the bitmap inside the texture */
+	p->bitmap->bindTex(shader);
+
+	glState.blendMode.pushSet(p->blendType);
+
+	if (HAVE_INSTANCING)
+		p->drawInstanced();
+	else
+		p->drawExpanded();
+
+	glState.blendMode.pop();
+
+	p->instances.clear();
+	p->bitmap = 0;
+}
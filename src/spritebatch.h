@@ -0,0 +1,57 @@
+/*
+** spritebatch.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPRITEBATCH_H
+#define SPRITEBATCH_H
+
+#include "etc.h"
+
+class Bitmap;
+struct SpriteInstance;
+struct SpriteBatchPrivate;
+
+/* Collects the quads of consecutively drawn sprites and draws
+ * them in one call. Since only consecutive quads are merged,
+ * draw order (and with it z order) is preserved as is.
+ * Quads are drawn as instances of a unit square where the
+ * context supports it, and expanded into vertices otherwise */
+class SpriteBatch
+{
+public:
+	SpriteBatch();
+	~SpriteBatch();
+
+	/* Queues a quad sampling from 'bitmap', with positions in
+	 * viewport space and texture coordinates relative to the
+	 * backing texture. Queued quads with a different texture or
+	 * blend type are flushed first */
+	void append(Bitmap &bitmap, BlendType blendType,
+	            const SpriteInstance &inst);
+
+	/* Draws all queued quads. Has to be called before
+	 * anything else is drawn, and at the end of a scene */
+	void flush();
+
+private:
+	SpriteBatchPrivate *p;
+};
+
+#endif // SPRITEBATCH_H
@@ -0,0 +1,258 @@
+/*
+** surface-ops.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "surface-ops.h"
+
+#include <pixman.h>
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+
+namespace SurfaceOps
+{
+
+static bool clipRect(const PixelBuffer &buf, const IntRect &rect, IntRect &out)
+{
+	int x1 = std::max(rect.x, 0);
+	int y1 = std::max(rect.y, 0);
+	int x2 = std::min(rect.x + rect.w, buf.width);
+	int y2 = std::min(rect.y + rect.h, buf.height);
+
+	if (x1 >= x2 || y1 >= y2)
+		return false;
+
+	out = IntRect(x1, y1, x2 - x1, y2 - y1);
+
+	return true;
+}
+
+static inline uint32_t *rowPtr(const PixelBuffer &buf, int x, int y)
+{
+	return (uint32_t*) ((uint8_t*) buf.pixels + y * buf.pitch) + x;
+}
+
+/* Our byte order (R, G, B, A) is what pixman calls
+ * a8b8g8r8 on little endian machines */
+static pixman_image_t *wrapBuffer(const PixelBuffer &buf)
+{
+	return pixman_image_create_bits(PIXMAN_a8b8g8r8, buf.width, buf.height,
+	                                buf.pixels, buf.pitch);
+}
+
+uint32_t packColor(const Vec4 &color)
+{
+	uint8_t bytes[4];
+	bytes[0] = clamp<float>(color.x, 0, 1) * 255.0f + 0.5f;
+	bytes[1] = clamp<float>(color.y, 0, 1) * 255.0f + 0.5f;
+	bytes[2] = clamp<float>(color.z, 0, 1) * 255.0f + 0.5f;
+	bytes[3] = clamp<float>(color.w, 0, 1) * 255.0f + 0.5f;
+
+	uint32_t pixel;
+	memcpy(&pixel, bytes, 4);
+
+	return pixel;
+}
+
+void fill(PixelBuffer &dst, const IntRect &rect, uint32_t pixel)
+{
+	IntRect clip;
+
+	if (!clipRect(dst, rect, clip))
+		return;
+
+	if (pixman_fill(dst.pixels, dst.pitch / 4, 32,
+	                clip.x, clip.y, clip.w, clip.h, pixel))
+		return;
+
+	for (int y = 0; y < clip.h; ++y)
+	{
+		uint32_t *row = rowPtr(dst, clip.x, clip.y + y);
+
+		for (int x = 0; x < clip.w; ++x)
+			row[x] = pixel;
+	}
+}
+
+void scaledCopy(const PixelBuffer &src, const IntRect &srcRect,
+                PixelBuffer &dst, const IntRect &dstRect)
+{
+	if (dstRect.w <= 0 || dstRect.h <= 0 || srcRect.w == 0 || srcRect.h == 0)
+		return;
+
+	IntRect clip;
+
+	if (!clipRect(dst, dstRect, clip))
+		return;
+
+	/* pixman doesn't handle overlapping source and destination,
+	 * so go through a scratch buffer for blits onto ourselves */
+	if (src.pixels == dst.pixels)
+	{
+		std::vector<uint32_t> scratch(clip.w * clip.h);
+		PixelBuffer tmp(&scratch[0], clip.w, clip.h, clip.w * 4);
+
+		scaledCopy(src, srcRect, tmp,
+		           IntRect(dstRect.x - clip.x, dstRect.y - clip.y, dstRect.w, dstRect.h));
+		scaledCopy(tmp, IntRect(0, 0, clip.w, clip.h), dst, clip);
+
+		return;
+	}
+
+	pixman_image_t *srcImg = wrapBuffer(src);
+	pixman_image_t *dstImg = wrapBuffer(dst);
+
+	/* Maps destination pixels (relative to 'dstRect')
+	 * to the source, same as the texture coordinates
+	 * of a blit quad would */
+	pixman_transform_t trans;
+	pixman_transform_init_scale(&trans,
+		pixman_double_to_fixed((double) srcRect.w / dstRect.w),
+		pixman_double_to_fixed((double) srcRect.h / dstRect.h));
+	pixman_transform_translate(&trans, 0,
+		pixman_int_to_fixed(srcRect.x), pixman_int_to_fixed(srcRect.y));
+
+	pixman_image_set_transform(srcImg, &trans);
+	pixman_image_set_filter(srcImg, PIXMAN_FILTER_NEAREST, 0, 0);
+
+	pixman_image_composite32(PIXMAN_OP_SRC, srcImg, 0, dstImg,
+	                         clip.x - dstRect.x, clip.y - dstRect.y, 0, 0,
+	                         clip.x, clip.y, clip.w, clip.h);
+
+	pixman_image_unref(dstImg);
+	pixman_image_unref(srcImg);
+}
+
+void blend(const PixelBuffer &src, const IntRect &srcRect,
+           PixelBuffer &dst, const IntRect &dstRect, int opacity)
+{
+	if (dstRect.w <= 0 || dstRect.h <= 0 || opacity <= 0)
+		return;
+
+	IntRect clip;
+
+	if (!clipRect(dst, dstRect, clip))
+		return;
+
+	/* Bring the visible part of the source to 1:1 first */
+	std::vector<uint32_t> scratch(clip.w * clip.h);
+	PixelBuffer tmp(&scratch[0], clip.w, clip.h, clip.w * 4);
+
+	scaledCopy(src, srcRect, tmp,
+	           IntRect(dstRect.x - clip.x, dstRect.y - clip.y, dstRect.w, dstRect.h));
+
+	/* Same math as bitmapBlit.frag, in 1/65025 fixed point.
+	 * pixman only knows premultiplied alpha, so it can't do
+	 * this part for us */
+	const uint32_t op = std::min(opacity, 255);
+
+	for (int y = 0; y < clip.h; ++y)
+	{
+		const uint8_t *s = (const uint8_t*) &scratch[y * clip.w];
+		uint8_t *d = (uint8_t*) rowPtr(dst, clip.x, clip.y + y);
+
+		for (int x = 0; x < clip.w; ++x, s += 4, d += 4)
+		{
+			const uint32_t co1 = s[3] * op;
+
+			if (co1 == 65025)
+			{
+				memcpy(d, s, 4);
+				continue;
+			}
+
+			const uint32_t co2 = (d[3] * (65025 - co1) + 127) / 255;
+			const uint32_t a = co1 + co2;
+
+			if (a == 0)
+			{
+				d[0] = s[0];
+				d[1] = s[1];
+				d[2] = s[2];
+				d[3] = 0;
+
+				continue;
+			}
+
+			for (int c = 0; c < 3; ++c)
+				d[c] = (co1 * s[c] + co2 * d[c] + a / 2) / a;
+
+			d[3] = (a + 127) / 255;
+		}
+	}
+}
+
+void hueChange(PixelBuffer &buf, int hue)
+{
+	static const float toY[] = { 0.299f,  0.587f,  0.114f };
+	static const float toI[] = { 0.596f, -0.275f, -0.321f };
+	static const float toQ[] = { 0.212f, -0.523f,  0.311f };
+
+	static const float fromYIQ[3][3] =
+	{
+		{ 1.0f,  0.956f,  0.621f },
+		{ 1.0f, -0.272f, -0.647f },
+		{ 1.0f, -1.107f,  1.704f }
+	};
+
+	/* hue.frag converts to polar IQ, offsets the angle and converts
+	 * back; that's just a rotation of the IQ plane, so the whole
+	 * thing collapses into one RGB -> RGB matrix */
+	const float adj = -((M_PI * 2) / 360) * hue;
+	const float cosA = cosf(adj);
+	const float sinA = sinf(adj);
+
+	float m[3][3];
+
+	for (int row = 0; row < 3; ++row)
+		for (int col = 0; col < 3; ++col)
+		{
+			float i = toI[col] * cosA - toQ[col] * sinA;
+			float q = toI[col] * sinA + toQ[col] * cosA;
+
+			m[row][col] = fromYIQ[row][0] * toY[col]
+			            + fromYIQ[row][1] * i
+			            + fromYIQ[row][2] * q;
+		}
+
+	for (int y = 0; y < buf.height; ++y)
+	{
+		uint8_t *p = (uint8_t*) rowPtr(buf, 0, y);
+
+		for (int x = 0; x < buf.width; ++x, p += 4)
+		{
+			const float r = p[0], g = p[1], b = p[2];
+
+			/* The shader leaves pixels without I alone */
+			if (596 * p[0] - 275 * p[1] - 321 * p[2] == 0)
+				continue;
+
+			for (int c = 0; c < 3; ++c)
+			{
+				float v = m[c][0] * r + m[c][1] * g + m[c][2] * b;
+				p[c] = clamp<float>(v + 0.5f, 0, 255);
+			}
+		}
+	}
+}
+
+}
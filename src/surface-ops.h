@@ -0,0 +1,76 @@
+/*
+** surface-ops.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SURFACEOPS_H
+#define SURFACEOPS_H
+
+#include "etc-internal.h"
+
+#include <SDL_surface.h>
+#include <stdint.h>
+
+/* CPU implementations of the Bitmap operations, for bitmaps
+ * too large to live in a texture (mega surfaces). All pixels
+ * are 32 bit RGBA in memory order, like the ones we upload */
+namespace SurfaceOps
+{
+
+struct PixelBuffer
+{
+	uint32_t *pixels;
+	int width;
+	int height;
+	/* In bytes */
+	int pitch;
+
+	PixelBuffer(uint32_t *pixels, int width, int height, int pitch)
+	    : pixels(pixels), width(width), height(height), pitch(pitch)
+	{}
+
+	PixelBuffer(SDL_Surface *surf)
+	    : pixels(static_cast<uint32_t*>(surf->pixels)),
+	      width(surf->w), height(surf->h), pitch(surf->pitch)
+	{}
+};
+
+/* Packs a normalized color into a pixel */
+uint32_t packColor(const Vec4 &color);
+
+/* Sets every pixel of 'rect' (clipped to 'dst') to 'pixel' */
+void fill(PixelBuffer &dst, const IntRect &rect, uint32_t pixel);
+
+/* Nearest neighbour scaled copy of 'srcRect' onto 'dstRect', which
+ * is clipped to 'dst'. Negative source extents flip the image, and
+ * samples from outside of 'src' come out fully transparent */
+void scaledCopy(const PixelBuffer &src, const IntRect &srcRect,
+                PixelBuffer &dst, const IntRect &dstRect);
+
+/* Same as scaledCopy(), but blends with the destination
+ * like the blt shader does. 'opacity' is 0 to 255 */
+void blend(const PixelBuffer &src, const IntRect &srcRect,
+           PixelBuffer &dst, const IntRect &dstRect, int opacity);
+
+/* Rotates the hue of every pixel by 'hue' degrees (0 to 359) */
+void hueChange(PixelBuffer &buf, int hue);
+
+}
+
+#endif // SURFACEOPS_H
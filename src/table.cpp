@@ -28,15 +28,22 @@
 #include "exception.h"
 #include "util.h"
 
+/* Cells recorded for changesSince() */
+#define MAX_RECORDED_CHANGES 256
+
 /* Init normally */
 Table::Table(int x, int y /*= 1*/, int z /*= 1*/)
     : xs(x), ys(y), zs(z),
-      data(x*y*z)
+      data(x*y*z),
+      stamp(0),
+      changesBase(0)
 {}
 
 Table::Table(const Table &other)
     : xs(other.xs), ys(other.ys), zs(other.zs),
-      data(other.data)
+      data(other.data),
+      stamp(0),
+      changesBase(0)
 {}
 
 int16_t Table::get(int x, int y, int z) const
@@ -55,6 +62,16 @@ void Table::set(int16_t value, int x, int y, int z)
 
 	data[xs*ys*z + xs*y + x] = value;
 
+	if (changes.size() == MAX_RECORDED_CHANGES)
+	{
+		changes.pop_front();
+		++changesBase;
+	}
+
+	Cell cell = { x, y, z };
+	changes.push_back(cell);
+	++stamp;
+
 	modified();
 }
 
@@ -76,6 +93,8 @@ void Table::resize(int x, int y, int z)
 	ys = y;
 	zs = z;
 
+	clearChanges();
+
 	return;
 }
 
@@ -89,6 +108,23 @@ void Table::resize(int x)
 	resize(x, ys, zs);
 }
 
+bool Table::changesSince(unsigned int since, std::vector<Cell> &out) const
+{
+	if (since < changesBase || since > stamp)
+		return false;
+
+	for (size_t i = since - changesBase; i < changes.size(); ++i)
+		out.push_back(changes[i]);
+
+	return true;
+}
+
+void Table::clearChanges()
+{
+	changes.clear();
+	changesBase = ++stamp;
+}
+
 /* Serializable */
 int Table::serialSize() const
 {
@@ -27,6 +27,7 @@
 #include <stdint.h>
 #include <sigc++/signal.h>
 #include <vector>
+#include <deque>
 
 class Table : public Serializable
 {
@@ -64,9 +65,31 @@ public:
 
 	sigc::signal<void> modified;
 
+	/* A cell changed through set() */
+	struct Cell
+	{
+		int x, y, z;
+	};
+
+	/* Counts changes to the table contents */
+	unsigned int changeStamp() const { return stamp; }
+
+	/* Appends the cells changed since 'since' was the current
+	 * stamp to 'out'. Only the most recent changes are kept;
+	 * returns false if some of them were dropped (or weren't
+	 * done through set()), in which case anything may differ */
+	bool changesSince(unsigned int since, std::vector<Cell> &out) const;
+
 private:
+	void clearChanges();
+
 	int xs, ys, zs;
 	std::vector<int16_t> data;
+
+	unsigned int stamp;
+	/* Stamp before the oldest recorded change */
+	unsigned int changesBase;
+	std::deque<Cell> changes;
 };
 
 #endif // TABLE_H
@@ -24,122 +24,206 @@
 #include "sharedstate.h"
 #include "glstate.h"
 #include "boost-hash.h"
+#include "intrulist.h"
 #include "debugwriter.h"
+#include "config.h"
+#include "util.h"
 
-#include <list>
 #include <utility>
+#include <algorithm>
 #include <assert.h>
 #include <string.h>
 
+/* NVX_gpu_memory_info */
+#ifndef GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX
+#define GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX 0x9047
+#endif
+
+/* ATI_meminfo */
+#ifndef GL_TEXTURE_FREE_MEMORY_ATI
+#define GL_TEXTURE_FREE_MEMORY_ATI 0x87FC
+#endif
+
 typedef std::pair<uint16_t, uint16_t> Size;
 
-static uint32_t byteCount(Size &s)
+static size_t byteCount(const Size &s)
+{
+	return (size_t) s.first * s.second * 4;
+}
+
+/* Rounds a texture dimension up to its size class. Classes are
+ * an eighth of the enclosing power of two apart (but at least
+ * 16 pixels), so no more than ~12% is wasted per dimension */
+static int sizeClass(int value)
+{
+	int pow2 = 16;
+
+	while (pow2 * 2 <= value)
+		pow2 *= 2;
+
+	int step = std::max(pow2 / 8, 16);
+
+	return ((value + step - 1) / step) * step;
+}
+
+/* In kilobytes, 0 if the driver won't tell */
+static int queryVideoMemory()
 {
-	return s.first * s.second * 4;
+	GLint values[4] = { 0, 0, 0, 0 };
+
+	if (gl.nvx_gpu_memory_info)
+		gl.GetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, values);
+	else if (gl.ati_meminfo)
+		/* Free, not total memory, but close enough at startup */
+		gl.GetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, values);
+
+	return values[0];
 }
 
 struct CacheNode
 {
 	TEXFBO obj;
-	std::list<TEXFBO>::iterator prioIter;
 
-	bool operator==(const CacheNode &o) const
-	{
-		return obj == o.obj;
-	}
+	/* All cached objects, most recently released first */
+	IntruListLink<CacheNode> lruLink;
+	/* Cached objects of the same size class */
+	IntruListLink<CacheNode> classLink;
+
+	CacheNode(const TEXFBO &obj)
+	    : obj(obj),
+	      lruLink(this),
+	      classLink(this)
+	{}
 };
 
-typedef std::list<CacheNode> CNodeList;
+typedef IntruList<CacheNode> CNodeList;
 
 struct TexPoolPrivate
 {
-	/* Contains all cached TexFBOs, grouped by size */
-	BoostHash<Size, CNodeList> poolHash;
+	/* Contains all cached TexFBOs, grouped by size class */
+	BoostHash<Size, CNodeList*> poolHash;
 
 	/* Contains all cached TexFBOs, sorted by release time */
-	std::list<TEXFBO> priorityQueue;
+	CNodeList priorityQueue;
 
 	/* Maximal allowed cache memory */
-	const uint32_t maxMemSize;
+	size_t maxMemSize;
 
 	/* Current amound of memory consumed by the cache */
-	uint32_t memSize;
-
-	/* Current amount of TexFBOs cached */
-	uint16_t objCount;
+	size_t memSize;
 
 	/* Has this pool been disabled? */
 	bool disabled;
 
-	TexPoolPrivate(uint32_t maxMemSize)
-	    : maxMemSize(maxMemSize),
+	TexPool::Stats stats;
+
+	TexPoolPrivate()
+	    : maxMemSize(0),
 	      memSize(0),
-	      objCount(0),
 	      disabled(false)
-	{}
+	{
+		memset(&stats, 0, sizeof(stats));
+	}
+
+	CNodeList &bucket(const Size &size)
+	{
+		CNodeList *&list = poolHash[size];
+
+		if (!list)
+			list = new CNodeList;
+
+		return *list;
+	}
+
+	/* Unlinks 'node' from both lists and frees it,
+	 * handing back the object it held */
+	TEXFBO take(CacheNode *node)
+	{
+		TEXFBO obj = node->obj;
+
+		priorityQueue.remove(node->lruLink);
+		bucket(Size(obj.width, obj.height)).remove(node->classLink);
+
+		memSize -= byteCount(Size(obj.width, obj.height));
+		delete node;
+
+		return obj;
+	}
 };
 
-TexPool::TexPool(uint32_t maxMemSize)
+TexPool::TexPool(const Config &conf)
 {
-	p = new TexPoolPrivate(maxMemSize);
+	p = new TexPoolPrivate;
+
+	if (conf.texPoolBudget > 0)
+	{
+		p->maxMemSize = (size_t) conf.texPoolBudget * 1024 * 1024;
+	}
+	else
+	{
+		/* Auto: a sixteenth of video memory, within sane bounds */
+		size_t vram = (size_t) queryVideoMemory() * 1024;
+		size_t lower = 20 * 1024 * 1024;
+		size_t upper = 512 * 1024 * 1024;
+
+		p->maxMemSize = vram ? clamp(vram / 16, lower, upper) : lower;
+	}
+
+	p->stats.budget = p->maxMemSize;
+
+	Debug() << "TexPool: Budget" << p->maxMemSize / (1024 * 1024) << "MB";
 }
 
 TexPool::~TexPool()
 {
-	std::list<TEXFBO>::iterator iter;
+	Debug() << "TexPool: Hits:" << p->stats.hits
+	        << "Misses:" << p->stats.misses
+	        << "Evictions:" << p->stats.evictions;
 
-	for (iter = p->priorityQueue.begin();
-	     iter != p->priorityQueue.end();
-	     ++iter)
+	while (!p->priorityQueue.isEmpty())
 	{
-		TEXFBO obj = *iter;
+		TEXFBO obj = p->take(p->priorityQueue.tail());
 		TEXFBO::fini(obj);
-		--p->objCount;
 	}
 
-	assert(p->objCount == 0);
+	BoostHash<Size, CNodeList*>::const_iterator iter;
+	for (iter = p->poolHash.cbegin(); iter != p->poolHash.cend(); ++iter)
+		delete iter->second;
 
 	delete p;
 }
 
 TEXFBO TexPool::request(int width, int height)
 {
-	CacheNode cnode;
-	Size size(width, height);
+	int maxSize = glState.caps.maxTexSize;
+	if (width > maxSize || height > maxSize)
+		throw Exception(Exception::MKXPError,
+		                "Texture dimensions [%d, %d] exceed hardware capabilities",
+		                width, height);
+
+	Size size(std::min(sizeClass(width),  maxSize),
+	          std::min(sizeClass(height), maxSize));
 
 	/* See if we can statisfy request from cache */
-	CNodeList &bucket = p->poolHash[size];
+	CNodeList &bucket = p->bucket(size);
 
-	if (!bucket.empty())
+	if (!bucket.isEmpty())
 	{
 		/* Found one! */
-		cnode = bucket.back();
-		bucket.pop_back();
-
-		p->priorityQueue.erase(cnode.prioIter);
-
-		p->memSize -= byteCount(size);
-		--p->objCount;
-
-//		Debug() << "TexPool: <?+> (" << width << height << ")";
+		++p->stats.hits;
 
-		return cnode.obj;
+		return p->take(bucket.begin()->data);
 	}
 
-	int maxSize = glState.caps.maxTexSize;
-	if (width > maxSize || height > maxSize)
-		throw Exception(Exception::MKXPError,
-		                "Texture dimensions [%d, %d] exceed hardware capabilities",
-		                width, height);
+	++p->stats.misses;
 
 	/* Nope, create it instead */
-	TEXFBO::init(cnode.obj);
-	TEXFBO::allocEmpty(cnode.obj, width, height);
-	TEXFBO::linkFBO(cnode.obj);
-
-//	Debug() << "TexPool: <?-> (" << width << height << ")";
+	TEXFBO obj;
+	TEXFBO::init(obj);
+	TEXFBO::allocEmpty(obj, size.first, size.second);
+	TEXFBO::linkFBO(obj);
 
-	return cnode.obj;
+	return obj;
 }
 
 void TexPool::release(TEXFBO &obj)
@@ -153,59 +237,36 @@ void TexPool::release(TEXFBO &obj)
 	if (p->disabled)
 	{
 		/* If we're disabled, delete without caching */
-//		Debug() << "TexPool: <!#> (" << obj.width << obj.height << ")";
 		TEXFBO::fini(obj);
 		return;
 	}
 
 	Size size(obj.width, obj.height);
+	size_t bytes = byteCount(size);
 
-	uint32_t newMemSize = p->memSize + byteCount(size);
+	/* Never going to fit */
+	if (bytes > p->maxMemSize)
+	{
+		TEXFBO::fini(obj);
+		return;
+	}
 
 	/* If caching this object would spill over the allowed memory budget,
 	 * delete least used objects until we're good again */
-	while (newMemSize > p->maxMemSize)
+	while (p->memSize + bytes > p->maxMemSize && !p->priorityQueue.isEmpty())
 	{
-		if (p->objCount == 0)
-			break;
-
-//		Debug() << "TexPool: <!~> Size:" << p->memSize;
-
-		/* Retrieve object with lowest priority for deletion */
-		CacheNode last;
-		last.obj = p->priorityQueue.back();
-		Size removedSize(last.obj.width, last.obj.height);
+		TEXFBO last = p->take(p->priorityQueue.tail());
+		TEXFBO::fini(last);
 
-		CNodeList &bucket = p->poolHash[removedSize];
-
-		std::list<CacheNode>::iterator toRemove =
-		        std::find(bucket.begin(), bucket.end(), last);
-		assert(toRemove != bucket.end());
-		bucket.erase(toRemove);
-
-		p->priorityQueue.pop_back();
-
-		TEXFBO::fini(last.obj);
-
-		newMemSize -= byteCount(removedSize);
-		--p->objCount;
-
-//		Debug() << "TexPool: <!-> (" << last.obj.width << last.obj.height << ")";
+		++p->stats.evictions;
 	}
 
-	p->memSize = newMemSize;
-
 	/* Retain object */
-	p->priorityQueue.push_front(obj);
-	CacheNode cnode;
-	cnode.obj = obj;
-	cnode.prioIter = p->priorityQueue.begin();
-	CNodeList &bucket = p->poolHash[size];
-	bucket.push_back(cnode);
-
-	++p->objCount;
+	CacheNode *node = new CacheNode(obj);
+	p->priorityQueue.prepend(node->lruLink);
+	p->bucket(size).prepend(node->classLink);
 
-//	Debug() << "TexPool: <!+> (" << obj.width << obj.height << ") Current size:" << p->memSize;
+	p->memSize += bytes;
 }
 
 void TexPool::disable()
@@ -213,4 +274,9 @@ void TexPool::disable()
 	p->disabled = true;
 }
 
+const TexPool::Stats &TexPool::getStats() const
+{
+	p->stats.residentBytes = p->memSize;
 
+	return p->stats;
+}
@@ -24,19 +24,39 @@
 
 #include "gl-util.h"
 
+#include <stddef.h>
+
+struct Config;
 struct TexPoolPrivate;
 
 class TexPool
 {
 public:
-	TexPool(uint32_t maxMemSize = 20000000 /* 20 MB */);
+	struct Stats
+	{
+		/* Requests served from / missing the cache */
+		size_t hits;
+		size_t misses;
+		/* Cached textures deleted to stay within budget */
+		size_t evictions;
+		/* Memory held by cached (unused) textures */
+		size_t residentBytes;
+		size_t budget;
+	};
+
+	TexPool(const Config &conf);
 	~TexPool();
 
+	/* Dimensions are rounded up to the next size class, so
+	 * the returned object can be larger than requested.
+	 * Callers keep track of the area they actually use */
 	TEXFBO request(int width, int height);
 	void release(TEXFBO &obj);
 
 	void disable();
 
+	const Stats &getStats() const;
+
 private:
 	TexPoolPrivate *p;
 };
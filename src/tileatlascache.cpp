@@ -0,0 +1,175 @@
+/*
+** tileatlascache.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tileatlascache.h"
+
+#include "bitmap.h"
+#include "disposable.h"
+#include "config.h"
+
+#include <list>
+#include <algorithm>
+
+void TileAtlasKey::add(const Bitmap *bitmap)
+{
+	if (nullOrDisposed(bitmap))
+	{
+		bitmaps.push_back(0);
+		stamps.push_back(0);
+
+		return;
+	}
+
+	bitmaps.push_back(bitmap);
+	stamps.push_back(bitmap->modStamp());
+}
+
+bool TileAtlasKey::sameBitmaps(const TileAtlasKey &o) const
+{
+	return bitmaps == o.bitmaps;
+}
+
+bool TileAtlasKey::empty() const
+{
+	return stamps.empty();
+}
+
+bool TileAtlasKey::operator==(const TileAtlasKey &o) const
+{
+	return stamps == o.stamps;
+}
+
+struct CachedAtlas
+{
+	TEXFBO obj;
+	TileAtlasKey key;
+};
+
+typedef std::list<CachedAtlas> AtlasList;
+
+struct TileAtlasCachePrivate
+{
+	/* Most recently released first */
+	AtlasList atlases;
+
+	/* Atlases are always retained up to this count, but
+	 * only matched by contents if 'keyed' is set */
+	size_t maxCount;
+	bool keyed;
+
+	TileAtlasCachePrivate(const Config &conf)
+	    : maxCount(std::max(conf.tilemapAtlasCache, 1)),
+	      keyed(conf.tilemapAtlasCache > 0)
+	{}
+
+	~TileAtlasCachePrivate()
+	{
+		for (AtlasList::iterator iter = atlases.begin();
+		     iter != atlases.end(); ++iter)
+			TEXFBO::fini(iter->obj);
+	}
+
+	TEXFBO take(AtlasList::iterator iter)
+	{
+		TEXFBO obj = iter->obj;
+		atlases.erase(iter);
+
+		return obj;
+	}
+};
+
+TileAtlasCache::TileAtlasCache(const Config &conf)
+{
+	p = new TileAtlasCachePrivate(conf);
+}
+
+TileAtlasCache::~TileAtlasCache()
+{
+	delete p;
+}
+
+TEXFBO TileAtlasCache::request(int width, int height)
+{
+	AtlasList::iterator match = p->atlases.end();
+
+	/* Prefer the least recently used atlas */
+	for (AtlasList::iterator iter = p->atlases.begin();
+	     iter != p->atlases.end(); ++iter)
+	{
+		if (iter->obj.width != width || iter->obj.height != height)
+			continue;
+
+		match = iter;
+
+		if (iter->key.empty())
+			break;
+	}
+
+	if (match != p->atlases.end())
+		return p->take(match);
+
+	TEXFBO obj;
+	TEXFBO::init(obj);
+	TEXFBO::allocEmpty(obj, width, height);
+	TEXFBO::linkFBO(obj);
+
+	return obj;
+}
+
+bool TileAtlasCache::request(const TileAtlasKey &key, TEXFBO &out)
+{
+	if (key.empty())
+		return false;
+
+	for (AtlasList::iterator iter = p->atlases.begin();
+	     iter != p->atlases.end(); ++iter)
+	{
+		if (!(iter->key == key))
+			continue;
+
+		out = p->take(iter);
+
+		return true;
+	}
+
+	return false;
+}
+
+void TileAtlasCache::release(TEXFBO &obj, const TileAtlasKey &key)
+{
+	/* No point in caching an invalid object */
+	if (obj.tex == TEX::ID(0))
+		return;
+
+	CachedAtlas atlas;
+	atlas.obj = obj;
+
+	if (p->keyed)
+		atlas.key = key;
+
+	p->atlases.push_front(atlas);
+
+	while (p->atlases.size() > p->maxCount)
+	{
+		TEXFBO::fini(p->atlases.back().obj);
+		p->atlases.pop_back();
+	}
+}
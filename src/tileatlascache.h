@@ -0,0 +1,80 @@
+/*
+** tileatlascache.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILEATLASCACHE_H
+#define TILEATLASCACHE_H
+
+#include "gl-util.h"
+
+#include <vector>
+#include <stdint.h>
+
+struct Config;
+struct TileAtlasCachePrivate;
+class Bitmap;
+
+/* Describes what a tilemap atlas was assembled from */
+struct TileAtlasKey
+{
+	std::vector<const Bitmap*> bitmaps;
+
+	/* Modification stamps of 'bitmaps'. These are never
+	 * reused, so equal stamps mean equal atlas contents */
+	std::vector<uint64_t> stamps;
+
+	/* Null and disposed bitmaps are recorded as such */
+	void add(const Bitmap *bitmap);
+
+	/* Whether 'o' was assembled from the same bitmaps,
+	 * possibly in different states of modification */
+	bool sameBitmaps(const TileAtlasKey &o) const;
+
+	bool empty() const;
+
+	bool operator==(const TileAtlasKey &o) const;
+};
+
+/* Keeps released tilemap atlases around (most recently used
+ * first), so a tilemap showing the same bitmaps again, eg.
+ * after a map transfer, can take one over without assembling
+ * it anew */
+class TileAtlasCache
+{
+public:
+	TileAtlasCache(const Config &conf);
+	~TileAtlasCache();
+
+	/* Returns an atlas of the requested size, with undefined
+	 * contents. Unkeyed atlases are handed out first */
+	TEXFBO request(int width, int height);
+
+	/* Returns true and fills 'out' if an atlas
+	 * assembled as described by 'key' is cached */
+	bool request(const TileAtlasKey &key, TEXFBO &out);
+
+	/* An empty 'key' means the contents are of no use */
+	void release(TEXFBO &obj, const TileAtlasKey &key);
+
+private:
+	TileAtlasCachePrivate *p;
+};
+
+#endif // TILEATLASCACHE_H
@@ -266,6 +266,11 @@ static void doBlit(Bitmap *bm, const IntRect &src, const Vec2i &dst)
 	if (!SDL_IntersectRect(&_src, &bmr, &_src))
 		return;
 
+	/* Atlased bitmaps are located inside a larger texture */
+	Vec2i orig = bm->texOrigin();
+	_src.x += orig.x;
+	_src.y += orig.y;
+
 	GLMeta::blitRectangle(_src, _dst);
 }
 
@@ -273,6 +278,11 @@ void build(TEXFBO &tf, Bitmap *bitmaps[BM_COUNT])
 {
 	assert(tf.width == ATLASVX_W && tf.height == ATLASVX_H);
 
+	/* Before any blit is set up */
+	for (size_t i = 0; i < BM_COUNT; ++i)
+		if (!nullOrDisposed(bitmaps[i]))
+			bitmaps[i]->flush();
+
 	GLMeta::blitBegin(tf);
 
 	glState.clearColor.pushSet(Vec4());
@@ -283,8 +293,8 @@ void build(TEXFBO &tf, Bitmap *bitmaps[BM_COUNT])
 	{
 		SDL_Surface *shadow = createShadowSet();
 		TEX::bind(tf.tex);
-		TEX::uploadSubImage(shadowArea.x*32, shadowArea.y*32,
-							shadow->w, shadow->h, shadow->pixels, GL_RGBA);
+		GLMeta::texSubImage(shadowArea.x*32, shadowArea.y*32,
+		                    shadow->w, shadow->h, shadow->pixels, shadow->pitch, GL_RGBA);
 		SDL_FreeSurface(shadow);
 	}
 
@@ -292,7 +302,7 @@ void build(TEXFBO &tf, Bitmap *bitmaps[BM_COUNT])
 #define EXEC_BLITS(part) \
 	if (!nullOrDisposed(bm = bitmaps[BM_##part])) \
 	{ \
-		GLMeta::blitSource(bm->getGLTypes()); \
+		GLMeta::blitSource(bm->texture()); \
 		for (size_t i = 0; i < blits##part##N; ++i) \
 		{\
 			const IntRect &src = blits##part[i].src; \
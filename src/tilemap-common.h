@@ -46,6 +46,13 @@ wrap(int value, int range)
 	return res < 0 ? res + range : res;
 }
 
+/* Division rounding towards negative infinity */
+static inline int
+floorDiv(int value, int divisor)
+{
+	return (value - wrap(value, divisor)) / divisor;
+}
+
 static inline int16_t
 tableGetWrapped(const Table &t, int x, int y, int z = 0)
 {
@@ -26,22 +26,28 @@
 #include "table.h"
 
 #include "sharedstate.h"
+#include "config.h"
 #include "glstate.h"
 #include "gl-util.h"
 #include "gl-meta.h"
 #include "global-ibo.h"
 #include "etc-internal.h"
+#include "util.h"
 #include "quadarray.h"
 #include "texpool.h"
 #include "quad.h"
 #include "vertex.h"
 #include "tileatlas.h"
+#include "tileatlascache.h"
 #include "tilemap-common.h"
+#include "frameprofiler.h"
+#include "workerpool.h"
 
 #include <sigc++/connection.h>
 
 #include <string.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <algorithm>
 #include <vector>
 
@@ -68,6 +74,20 @@ static const int viewpH = 16;
 
 static const size_t zlayersMax = viewpH + 5;
 
+/* Every map viewport cell gets room for one autotile (4 quads)
+ * in its layer, so edited cells can be rebuilt in place. Regular
+ * tiles only use the first quad, the rest stays degenerate */
+static const int cellQuads = 4;
+
+/* Past this many changed cells, a full rebuild is cheaper */
+static const size_t maxCellUpdates = 64;
+
+/* Chunk edge length (in tiles) in chunked mode */
+static const int chunkSize = 16;
+
+/* Zrows of a chunk (local row + priority) */
+static const int chunkZRows = chunkSize + 5;
+
 /* Vocabulary:
  *
  * Atlas: A texture containing both the tileset and all
@@ -148,8 +168,30 @@ static const size_t zlayersMax = viewpH + 5;
  *   This rectangle describes the subregion of the map that is
  *   actually translated to vertices and stored on the GPU ready
  *   for rendering. Whenever, ox/oy are modified, its position is
- *   adjusted if necessary and the data is regenerated. Its size
- *   is fixed. This is NOT related to the RGSS Viewport class!
+ *   adjusted if necessary. Its size is fixed. This is NOT related
+ *   to the RGSS Viewport class!
+ *   The ground layer is a toroidal ring buffer: map cell (x, y, z)
+ *   always lives in slot (x mod viewpW, y mod viewpH, z), and its
+ *   vertices are in absolute map coordinates. When the map viewport
+ *   moves, only the newly exposed row/column slots are regenerated,
+ *   the zlayers (which are usually sparse) are collected anew.
+ *
+ * Cell slots:
+ *   Each slot holds 'cellQuads' quads, which are left degenerate
+ *   in the ground layer if the tile is drawn in a zlayer instead.
+ *   When map data cells are changed with Table#[]=, only the
+ *   affected slots are rebuilt and uploaded in the same way.
+ *
+ * Chunks:
+ *   With the 'tilemapChunks' option, the map viewport isn't used.
+ *   Instead, the map is split into chunks of chunkSize^2 tiles,
+ *   each with its own buffer holding the ground tiles followed by
+ *   the prioritized tiles ordered by 'zrow' (local row + priority).
+ *   Chunks are built the first time they become visible and kept
+ *   around, so scrolling doesn't generate any vertices. Every
+ *   layer draws its range from all chunks intersecting the view
+ *   (repeated where the map wraps around), and the view itself
+ *   is sized to the scene instead of the fixed 21x16 tiles.
  *
  */
 
@@ -209,6 +251,9 @@ struct ZLayer : public ViewportElement
 	 * holds the element count of the entire batch */
 	GLsizei vboBatchCount;
 
+	/* Index of the last layer in the batch */
+	size_t batchLast;
+
 	ZLayer(TilemapPrivate *p, Viewport *viewport);
 
 	void setIndex(int value);
@@ -224,6 +269,73 @@ struct ZLayer : public ViewportElement
 	ABOUT_TO_ACCESS_NOOP
 };
 
+struct TileChunk
+{
+	GLMeta::VAO vao;
+	VBO::ID vbo;
+
+	/* Chunk position in the chunk grid */
+	Vec2i pos;
+
+	size_t groundQuads;
+
+	/* Base quad indices of each zrow in the buffer */
+	size_t zrowBases[chunkZRows+1];
+
+	bool dirty;
+
+	TileChunk(const Vec2i &pos)
+	    : pos(pos),
+	      groundQuads(0),
+	      dirty(true)
+	{
+		memset(zrowBases, 0, sizeof(zrowBases));
+
+		vbo = VBO::gen();
+
+		GLMeta::vaoFillInVertexData<SVertex>(vao);
+		vao.vbo = vbo;
+		vao.ibo = shState->globalIBO().ibo;
+
+		GLMeta::vaoInit(vao);
+	}
+
+	~TileChunk()
+	{
+		GLMeta::vaoFini(vao);
+		VBO::del(vbo);
+	}
+};
+
+/* Vertex data of a chunk, generated on the worker pool */
+struct ChunkBuild : WorkerPool::Job
+{
+	TilemapPrivate *p;
+	TileChunk *chunk;
+
+	SVVector groundVert;
+	SVVector zrowVert[chunkZRows];
+
+	ChunkBuild(TilemapPrivate *p)
+	    : p(p),
+	      chunk(0)
+	{}
+
+	void run();
+};
+
+/* A chunk intersecting the view */
+struct ChunkDraw
+{
+	TileChunk *chunk;
+
+	/* Offset of the map repetition it's drawn in */
+	Vec2i trans;
+
+	/* First (unwrapped) map row it covers */
+	int row;
+};
+
 struct TilemapPrivate
 {
 	Viewport *viewport;
@@ -237,7 +349,10 @@ struct TilemapPrivate
 	bool visible;
 	Vec2i offset;
 
+	/* Flash tiles are relative to the map viewport,
+	 * tile vertices are in absolute map coordinates */
 	Vec2i dispPos;
+	Vec2i tileDispPos;
 
 	/* Tile atlas */
 	struct {
@@ -255,14 +370,23 @@ struct TilemapPrivate
 
 		/* Indices of animated autotiles */
 		std::vector<uint8_t> animatedATs;
+
+		/* What 'gl' was assembled from */
+		TileAtlasKey key;
 	} atlas;
 
 	/* Map viewport position */
 	Vec2i viewpPos;
 
-	/* Ground layer vertices */
+	/* Ground layer vertices, a ring buffer
+	 * of 'cellQuads' slots (see 'Map viewport') */
 	SVVector groundVert;
 
+	/* Vertices and priority of every map viewport
+	 * cell, in the same ring buffer layout */
+	SVVector cellVert;
+	std::vector<int8_t> cellPrio;
+
 	/* ZLayer vertices */
 	SVVector zlayerVert[zlayersMax];
 
@@ -270,6 +394,28 @@ struct TilemapPrivate
 	 * in the shared buffer */
 	size_t zlayerBases[zlayersMax+1];
 
+	/* Chunked mode state (see 'Chunks') */
+	bool chunked;
+
+	struct
+	{
+		/* Indexed by chunk position, null until first visible */
+		std::vector<TileChunk*> grid;
+		Vec2i gridSize;
+
+		std::vector<ChunkDraw> visible;
+
+		/* Visible area in tiles */
+		Vec2i viewSize;
+
+		/* One per chunk built in the same frame */
+		std::vector<ChunkBuild*> builds;
+	} chunks;
+
+	/* Map data change stamp the buffers are based on */
+	unsigned int mapDataStamp;
+	std::vector<Table::Cell> changedCells;
+
 	/* Shared buffers for all tiles */
 	struct
 	{
@@ -289,7 +435,8 @@ struct TilemapPrivate
 	struct
 	{
 		GroundLayer *ground;
-		ZLayer* zlayers[zlayersMax];
+		/* 'zlayersMax', or more in chunked mode */
+		std::vector<ZLayer*> zlayers;
 		/* Used layers out of 'zlayers' (rest is hidden) */
 		size_t activeLayers;
 		Scene::Geometry sceneGeo;
@@ -298,10 +445,14 @@ struct TilemapPrivate
 
 	/* Affected by: autotiles, tileset */
 	bool atlasSizeDirty;
-	/* Affected by: autotiles(.changed), tileset(.changed), allocateAtlas */
+	/* Affected by: autotiles(.changed), tileset(.changed), resizeAtlas */
 	bool atlasDirty;
-	/* Affected by: mapData(.changed), priorities(.changed) */
+	/* Affected by: mapData, priorities(.changed) */
 	bool buffersDirty;
+	/* Affected by: mapData(.changed) */
+	bool cellsDirty;
+	/* Affected by: mapData(.changed), ox, oy */
+	bool zlayersDirty;
 	/* Affected by: ox, oy */
 	bool mapViewportDirty;
 	/* Affected by: oy */
@@ -328,10 +479,14 @@ struct TilemapPrivate
 	      mapData(0),
 	      priorities(0),
 	      visible(true),
+	      chunked(shState->config().tilemapChunks),
+	      mapDataStamp(0),
 	      flashAlphaIdx(0),
 	      atlasSizeDirty(false),
 	      atlasDirty(false),
 	      buffersDirty(false),
+	      cellsDirty(false),
+	      zlayersDirty(false),
 	      mapViewportDirty(false),
 	      zOrderDirty(false),
 	      tilemapReady(false)
@@ -357,7 +512,7 @@ struct TilemapPrivate
 		elem.ground = new GroundLayer(this, viewport);
 
 		for (size_t i = 0; i < zlayersMax; ++i)
-			elem.zlayers[i] = new ZLayer(this, viewport);
+			elem.zlayers.push_back(new ZLayer(this, viewport));
 
 		prepareCon = shState->prepareDraw.connect
 		        (sigc::mem_fun(this, &TilemapPrivate::prepare));
@@ -369,10 +524,15 @@ struct TilemapPrivate
 	{
 		/* Destroy elements */
 		delete elem.ground;
-		for (size_t i = 0; i < zlayersMax; ++i)
+		for (size_t i = 0; i < elem.zlayers.size(); ++i)
 			delete elem.zlayers[i];
 
-		shState->releaseAtlasTex(atlas.gl);
+		clearChunks();
+
+		for (size_t i = 0; i < chunks.builds.size(); ++i)
+			delete chunks.builds[i];
+
+		shState->releaseAtlasTex(atlas.gl, atlas.key);
 
 		/* Destroy tile buffers */
 		GLMeta::vaoFini(tiles.vao);
@@ -393,7 +553,11 @@ struct TilemapPrivate
 
 	void updateFlashMapViewport()
 	{
-		flashMap.setViewport(IntRect(viewpPos.x, viewpPos.y, viewpW, viewpH));
+		if (chunked)
+			flashMap.setViewport(IntRect(viewpPos.x, viewpPos.y,
+			                             chunks.viewSize.x, chunks.viewSize.y));
+		else
+			flashMap.setViewport(IntRect(viewpPos.x, viewpPos.y, viewpW, viewpH));
 	}
 
 	void updateAtlasInfo()
@@ -444,12 +608,19 @@ struct TilemapPrivate
 		elem.sceneOffset.x = geo.rect.x - geo.xOrigin;
 		elem.sceneOffset.y = geo.rect.y - geo.yOrigin;
 		elem.sceneGeo = geo;
+
+		/* The chunked view is sized to the scene */
+		if (chunked)
+			mapViewportDirty = true;
 	}
 
 	void updatePosition()
 	{
 		dispPos.x = -(offset.x - viewpPos.x * 32) + elem.sceneOffset.x;
 		dispPos.y = -(offset.y - viewpPos.y * 32) + elem.sceneOffset.y;
+
+		tileDispPos.x = -offset.x + elem.sceneOffset.x;
+		tileDispPos.y = -offset.y + elem.sceneOffset.y;
 	}
 
 	void invalidateAtlasSize()
@@ -467,6 +638,11 @@ struct TilemapPrivate
 		buffersDirty = true;
 	}
 
+	void invalidateCells()
+	{
+		cellsDirty = true;
+	}
+
 	/* Checks for the minimum amount of data needed to display */
 	bool verifyResources()
 	{
@@ -479,25 +655,68 @@ struct TilemapPrivate
 		return true;
 	}
 
-	/* Allocates correctly sized TexFBO for atlas */
-	void allocateAtlas()
+	/* The atlas texture itself is acquired
+	 * along with its contents */
+	void resizeAtlas()
 	{
 		updateAtlasInfo();
 
-		/* Aquire atlas tex */
-		shState->releaseAtlasTex(atlas.gl);
-		shState->requestAtlasTex(atlas.size.x, atlas.size.y, atlas.gl);
-
 		atlasDirty = true;
+
+		/* Tileset texture coordinates depend on the atlas size */
+		buffersDirty = true;
 	}
 
-	/* Assembles atlas from tileset and autotile bitmaps */
-	void buildAtlas()
+	/* Takes over a cached atlas assembled from the current
+	 * bitmaps if there is one, and builds it otherwise */
+	void acquireAtlas()
 	{
 		updateAutotileInfo();
 
+		TileAtlasKey key;
+		key.add(tileset);
+
+		for (int i = 0; i < autotileCount; ++i)
+			key.add(autotiles[i]);
+
+		if (key == atlas.key)
+			return;
+
+		TEXFBO cached;
+
+		if (shState->requestAtlasTex(key, cached))
+		{
+			shState->releaseAtlasTex(atlas.gl, atlas.key);
+			atlas.gl = cached;
+			atlas.key = key;
+
+			return;
+		}
+
+		const bool sameBitmaps = key.sameBitmaps(atlas.key);
+
+		if (!sameBitmaps || atlas.gl.width != atlas.size.x || atlas.gl.height != atlas.size.y)
+		{
+			/* Modified bitmaps never get their old contents
+			 * back, so only keep atlases of other bitmaps */
+			shState->releaseAtlasTex(atlas.gl, sameBitmaps ? TileAtlasKey() : atlas.key);
+			shState->requestAtlasTex(atlas.size.x, atlas.size.y, atlas.gl);
+		}
+
+		buildAtlas();
+		atlas.key = key;
+	}
+
+	/* Assembles atlas from tileset and autotile bitmaps */
+	void buildAtlas()
+	{
 		TileAtlas::BlitVec blits = TileAtlas::calcBlits(atlas.efTilesetH, atlas.size);
 
+		for (size_t i = 0; i < atlas.usableATs.size(); ++i)
+			autotiles[atlas.usableATs[i]]->flush();
+
+		tileset->flush();
+
 		/* Clear atlas */
 		FBO::bind(atlas.gl.fbo);
 		glState.clearColor.pushSet(Vec4());
@@ -519,20 +738,22 @@ struct TilemapPrivate
 			int blitW = std::min(autotile->width(), atAreaW);
 			int blitH = std::min(autotile->height(), atAreaH);
 
-			GLMeta::blitSource(autotile->getGLTypes());
+			/* Read only, so atlased autotiles can stay where they are */
+			Vec2i orig = autotile->texOrigin();
+			IntRect src(orig.x, orig.y, blitW, blitH);
+
+			GLMeta::blitSource(autotile->texture());
 
 			if (blitW <= autotileW && tiles.animated)
 			{
 				/* Static autotile */
 				for (int j = 0; j < 4; ++j)
-					GLMeta::blitRectangle(IntRect(0, 0, blitW, blitH),
-					                      Vec2i(autotileW*j, atInd*autotileH));
+					GLMeta::blitRectangle(src, Vec2i(autotileW*j, atInd*autotileH));
 			}
 			else
 			{
 				/* Animated autotile */
-				GLMeta::blitRectangle(IntRect(0, 0, blitW, blitH),
-				                      Vec2i(0, atInd*autotileH));
+				GLMeta::blitRectangle(src, Vec2i(0, atInd*autotileH));
 			}
 		}
 
@@ -559,14 +780,17 @@ struct TilemapPrivate
 		else
 		{
 			/* Regular tileset */
+			Vec2i orig = tileset->texOrigin();
+
 			GLMeta::blitBegin(atlas.gl);
-			GLMeta::blitSource(tileset->getGLTypes());
+			GLMeta::blitSource(tileset->texture());
 
 			for (size_t i = 0; i < blits.size(); ++i)
 			{
 				const TileAtlas::Blit &blitOp = blits[i];
 
-				GLMeta::blitRectangle(IntRect(blitOp.src.x, blitOp.src.y, tsLaneW, blitOp.h),
+				GLMeta::blitRectangle(IntRect(orig.x + blitOp.src.x, orig.y + blitOp.src.y,
+				                              tsLaneW, blitOp.h),
 				                      blitOp.dst);
 			}
 
@@ -590,7 +814,7 @@ struct TilemapPrivate
 		return value;
 	}
 
-	void handleAutotile(int x, int y, int tileInd, SVVector *array)
+	void handleAutotile(int x, int y, int tileInd, SVertex *vert)
 	{
 		/* Which autotile [0-7] */
 		int atInd = tileInd / 48 - 1;
@@ -610,47 +834,29 @@ struct TilemapPrivate
 			/* Adjust to atlas coordinates */
 			texRect.y += atInd * autotileH;
 
-			SVertex v[4];
-			Quad::setTexPosRect(v, texRect, posRect);
-
-			/* Iterate over 4 vertices */
-			for (size_t i = 0; i < 4; ++i)
-				array->push_back(v[i]);
+			Quad::setTexPosRect(&vert[i*4], texRect, posRect);
 		}
 	}
 
-	void handleTile(int x, int y, int z)
+	/* Writes the 'cellQuads' quads of a tile at
+	 * map position 'x, y' to 'vert' */
+	void buildCell(int x, int y, int tileInd, SVertex *vert)
 	{
-		int tileInd =
-			tableGetWrapped(*mapData, x + viewpPos.x, y + viewpPos.y, z);
+		for (int i = 0; i < cellQuads*4; ++i)
+			vert[i] = SVertex();
 
 		/* Check for empty space */
 		if (tileInd < 48)
 			return;
 
-		int prio = samplePriority(tileInd);
-
 		/* Check for faulty data */
-		if (prio == -1)
+		if (samplePriority(tileInd) == -1)
 			return;
 
-		SVVector *targetArray;
-
-		/* Prio 0 tiles are all part of the same ground layer */
-		if (prio == 0)
-		{
-			targetArray = &groundVert;
-		}
-		else
-		{
-			int layerInd = y + prio;
-			targetArray = &zlayerVert[layerInd];
-		}
-
 		/* Check for autotile */
 		if (tileInd < 48*8)
 		{
-			handleAutotile(x, y, tileInd, targetArray);
+			handleAutotile(x, y, tileInd, vert);
 			return;
 		}
 
@@ -662,29 +868,190 @@ struct TilemapPrivate
 		FloatRect texRect((float) texPos.x+.5, (float) texPos.y+.5, 31, 31);
 		FloatRect posRect(x*32, y*32, 32, 32);
 
-		SVertex v[4];
-		Quad::setTexPosRect(v, texRect, posRect);
+		Quad::setTexPosRect(vert, texRect, posRect);
+	}
 
-		for (size_t i = 0; i < 4; ++i)
-			targetArray->push_back(v[i]);
+	/* Priority a tile is drawn with, 0 meaning the ground layer
+	 * (which also takes empty space and faulty data) */
+	int cellPriority(int tileInd)
+	{
+		if (tileInd < 48)
+			return 0;
+
+		return std::max(samplePriority(tileInd), 0);
 	}
 
-	void clearQuadArrays()
+	/* Ring buffer slot of the cell at (unwrapped) map position 'x, y' */
+	size_t ringSlot(int x, int y, int z)
 	{
-		groundVert.clear();
+		return (z * viewpH + wrap(y, viewpH)) * viewpW + wrap(x, viewpW);
+	}
 
-		for (size_t i = 0; i < zlayersMax; ++i)
-			zlayerVert[i].clear();
+	bool ringValid()
+	{
+		return cellPrio.size() == (size_t) (viewpW * viewpH * mapData->zSize());
+	}
+
+	/* Regenerates the slot of the cell at map position 'x, y, z'.
+	 * Returns true if the cell was or now is part of a zlayer */
+	bool readCell(int x, int y, int z)
+	{
+		int tileInd = tableGetWrapped(*mapData, x, y, z);
+		size_t slot = ringSlot(x, y, z);
+
+		SVertex *vert = &cellVert[slot*cellQuads*4];
+		SVertex *ground = &groundVert[slot*cellQuads*4];
+
+		int oldPrio = cellPrio[slot];
+		int prio = cellPriority(tileInd);
+		cellPrio[slot] = prio;
+
+		buildCell(x, y, tileInd, vert);
+
+		for (int i = 0; i < cellQuads*4; ++i)
+			ground[i] = (prio == 0) ? vert[i] : SVertex();
+
+		return oldPrio > 0 || prio > 0;
+	}
+
+	void uploadGroundSlot(size_t slot)
+	{
+		VBO::uploadSubData(quadDataSize(slot*cellQuads), quadDataSize(cellQuads),
+		                   &groundVert[slot*cellQuads*4]);
 	}
 
 	void buildQuadArray()
 	{
-		clearQuadArrays();
+		size_t slots = viewpW * viewpH * mapData->zSize();
+
+		cellVert.resize(slots*cellQuads*4);
+		groundVert.resize(slots*cellQuads*4);
+		cellPrio.assign(slots, 0);
 
 		for (int x = 0; x < viewpW; ++x)
 			for (int y = 0; y < viewpH; ++y)
 				for (int z = 0; z < mapData->zSize(); ++z)
-					handleTile(x, y, z);
+					readCell(x + viewpPos.x, y + viewpPos.y, z);
+
+		buildZLayers();
+
+		mapDataStamp = mapData->changeStamp();
+	}
+
+	/* Collects the cells drawn above ground into their zlayers.
+	 * Zlayers are relative to the map viewport rows, so unlike
+	 * the ground layer, they're regenerated when it moves */
+	void buildZLayers()
+	{
+		for (size_t i = 0; i < zlayersMax; ++i)
+			zlayerVert[i].clear();
+
+		for (int y = 0; y < viewpH; ++y)
+			for (int x = 0; x < viewpW; ++x)
+				for (int z = 0; z < mapData->zSize(); ++z)
+				{
+					size_t slot = ringSlot(x + viewpPos.x, y + viewpPos.y, z);
+					int prio = cellPrio[slot];
+
+					if (prio == 0)
+						continue;
+
+					const SVertex *vert = &cellVert[slot*cellQuads*4];
+					SVVector &array = zlayerVert[y + prio];
+					array.insert(array.end(), vert, vert + cellQuads*4);
+				}
+	}
+
+	/* Regenerates the cells that entered the map viewport
+	 * since it was at 'oldPos'. Thanks to the ring buffer
+	 * layout, all other ground slots stay where they are */
+	void streamMapViewport(const Vec2i &oldPos)
+	{
+		int dx = viewpPos.x - oldPos.x;
+		int dy = viewpPos.y - oldPos.y;
+
+		if (!ringValid() || abs(dx) >= viewpW || abs(dy) >= viewpH)
+		{
+			buffersDirty = true;
+			return;
+		}
+
+		bool zlayersChanged = (dy != 0);
+
+		VBO::bind(tiles.vbo);
+
+		for (int y = 0; y < viewpH; ++y)
+			for (int x = 0; x < viewpW; ++x)
+			{
+				int mapX = x + viewpPos.x;
+				int mapY = y + viewpPos.y;
+
+				/* Already buffered */
+				if (mapX >= oldPos.x && mapX < oldPos.x + viewpW &&
+				    mapY >= oldPos.y && mapY < oldPos.y + viewpH)
+					continue;
+
+				for (int z = 0; z < mapData->zSize(); ++z)
+				{
+					zlayersChanged |= readCell(mapX, mapY, z);
+					uploadGroundSlot(ringSlot(mapX, mapY, z));
+				}
+			}
+
+		VBO::unbind();
+
+		if (zlayersChanged)
+			zlayersDirty = true;
+	}
+
+	/* Rebuilds the slots showing map data 'cell'
+	 * (there may be more than one if the map wraps around) */
+	void updateCell(const Table::Cell &cell)
+	{
+		for (int y = 0; y < viewpH; ++y)
+		{
+			int mapY = y + viewpPos.y;
+
+			if (wrap(mapY, mapData->ySize()) != cell.y)
+				continue;
+
+			for (int x = 0; x < viewpW; ++x)
+			{
+				int mapX = x + viewpPos.x;
+
+				if (wrap(mapX, mapData->xSize()) != cell.x)
+					continue;
+
+				if (readCell(mapX, mapY, cell.z))
+					zlayersDirty = true;
+
+				uploadGroundSlot(ringSlot(mapX, mapY, cell.z));
+			}
+		}
+	}
+
+	/* Updates the cells changed since the last build in place,
+	 * or falls back to a full rebuild if that isn't possible */
+	void updateCells()
+	{
+		changedCells.clear();
+
+		if (!ringValid()
+		||  !mapData->changesSince(mapDataStamp, changedCells)
+		||  changedCells.size() > maxCellUpdates)
+		{
+			buffersDirty = true;
+			return;
+		}
+
+		mapDataStamp = mapData->changeStamp();
+
+		VBO::bind(tiles.vbo);
+
+		for (size_t i = 0; i < changedCells.size(); ++i)
+			updateCell(changedCells[i]);
+
+		VBO::unbind();
 	}
 
 	static size_t quadDataSize(size_t quadCount)
@@ -697,11 +1064,10 @@ struct TilemapPrivate
 		return zlayerBases[index+1] - zlayerBases[index];
 	}
 
-	void uploadBuffers()
+	/* Places the zlayers right after the ground layer */
+	void uploadZLayers()
 	{
-		/* Calculate total quad count */
-		size_t groundQuadCount = groundVert.size() / 4;
-		size_t quadCount = groundQuadCount;
+		size_t quadCount = groundVert.size() / 4;
 
 		for (size_t i = 0; i < zlayersMax; ++i)
 		{
@@ -711,11 +1077,6 @@ struct TilemapPrivate
 
 		zlayerBases[zlayersMax] = quadCount;
 
-		VBO::bind(tiles.vbo);
-		VBO::allocEmpty(quadDataSize(quadCount));
-
-		VBO::uploadSubData(0, quadDataSize(groundQuadCount), dataPtr(groundVert));
-
 		for (size_t i = 0; i < zlayersMax; ++i)
 		{
 			if (zlayerVert[i].empty())
@@ -725,12 +1086,37 @@ struct TilemapPrivate
 			                   quadDataSize(zlayerSize(i)), dataPtr(zlayerVert[i]));
 		}
 
-		VBO::unbind();
-
 		/* Ensure global IBO size */
 		shState->ensureQuadIBO(quadCount);
 	}
 
+	void uploadBuffers()
+	{
+		size_t groundQuadCount = groundVert.size() / 4;
+
+		VBO::bind(tiles.vbo);
+
+		/* Every cell is either on the ground or in one zlayer,
+		 * so the zlayers can never outgrow the ground layer */
+		VBO::allocEmpty(quadDataSize(groundQuadCount*2));
+		VBO::uploadSubData(0, quadDataSize(groundQuadCount), dataPtr(groundVert));
+
+		uploadZLayers();
+
+		VBO::unbind();
+	}
+
+	void updateZLayers()
+	{
+		buildZLayers();
+
+		VBO::bind(tiles.vbo);
+		uploadZLayers();
+		VBO::unbind();
+
+		updateSceneElements();
+	}
+
 	void bindShader(ShaderBase *&shaderVar)
 	{
 		if (tiles.animated)
@@ -759,7 +1145,7 @@ struct TilemapPrivate
 	{
 		elem.ground->updateVboCount();
 
-		for (size_t i = 0; i < zlayersMax; ++i)
+		for (size_t i = 0; i < elem.zlayers.size(); ++i)
 		{
 			if (i < zlayerInd.size())
 			{
@@ -793,7 +1179,7 @@ struct TilemapPrivate
 	{
 		elem.ground->setVisible(false);
 
-		for (size_t i = 0; i < zlayersMax; ++i)
+		for (size_t i = 0; i < elem.zlayers.size(); ++i)
 			elem.zlayers[i]->setVisible(false);
 	}
 
@@ -827,7 +1213,7 @@ struct TilemapPrivate
 	 * single sized batches are possible. */
 	void prepareZLayerBatches()
 	{
-		ZLayer *const *zlayers = elem.zlayers;
+		ZLayer *const *zlayers = &elem.zlayers[0];
 
 		for (size_t i = 0; i < elem.activeLayers; ++i)
 		{
@@ -853,24 +1239,36 @@ struct TilemapPrivate
 			}
 
 			batchHead->vboBatchCount = vboBatchCount;
+			batchHead->batchLast = zlayers[i-1]->index;
 			--i;
 		}
 	}
 
-	void updateMapViewport()
+	/* Map tile at the top left of the view */
+	Vec2i tileOffset() const
 	{
-		int tileOX, tileOY;
+		Vec2i tileO;
 
 		if (offset.x >= 0)
-			tileOX = offset.x / 32;
+			tileO.x = offset.x / 32;
 		else
-			tileOX = -(-(offset.x-31) / 32);
+			tileO.x = -(-(offset.x-31) / 32);
 
 		if (offset.y >= 0)
-			tileOY = offset.y / 32;
+			tileO.y = offset.y / 32;
 		else
-			tileOY = -(-(offset.y-31) / 32);
+			tileO.y = -(-(offset.y-31) / 32);
 
+		return tileO;
+	}
+
+	void updateMapViewport()
+	{
+		const Vec2i tileO = tileOffset();
+		const int tileOX = tileO.x;
+		const int tileOY = tileO.y;
+
+		const Vec2i oldPos = viewpPos;
 		bool dirty = false;
 
 		if (tileOX < viewpPos.x || tileOX + 21 > viewpPos.x + viewpW)
@@ -887,14 +1285,391 @@ struct TilemapPrivate
 
 		if (dirty)
 		{
-			buffersDirty = true;
+			if (!buffersDirty)
+				streamMapViewport(oldPos);
+
 			updateFlashMapViewport();
 			updatePosition();
 		}
 	}
 
+	void prepareBuffers()
+	{
+		if (mapViewportDirty)
+		{
+			updateMapViewport();
+			mapViewportDirty = false;
+		}
+
+		if (cellsDirty)
+		{
+			if (!buffersDirty)
+				updateCells();
+
+			cellsDirty = false;
+		}
+
+		if (zlayersDirty)
+		{
+			if (!buffersDirty)
+				updateZLayers();
+
+			zlayersDirty = false;
+		}
+
+		if (buffersDirty)
+		{
+			buildQuadArray();
+			uploadBuffers();
+			updateSceneElements();
+			buffersDirty = false;
+		}
+	}
+
+	/* Quads a tile actually uses out of those written by buildCell */
+	int tileQuadCount(int tileInd)
+	{
+		if (tileInd < 48 || samplePriority(tileInd) == -1)
+			return 0;
+
+		return (tileInd < 48*8) ? 4 : 1;
+	}
+
+	void clearChunks()
+	{
+		for (size_t i = 0; i < chunks.grid.size(); ++i)
+			delete chunks.grid[i];
+
+		chunks.grid.clear();
+		chunks.visible.clear();
+	}
+
+	TileChunk *chunkAt(int x, int y)
+	{
+		TileChunk *&chunk = chunks.grid[y * chunks.gridSize.x + x];
+
+		if (!chunk)
+			chunk = new TileChunk(Vec2i(x, y));
+
+		return chunk;
+	}
+
+	/* Only reads map data and tilemap state, so
+	 * several chunks can be generated in parallel */
+	void generateChunk(ChunkBuild &build)
+	{
+		const TileChunk &chunk = *build.chunk;
+
+		SVVector &ground = build.groundVert;
+		SVVector *zrows = build.zrowVert;
+
+		ground.clear();
+
+		for (int i = 0; i < chunkZRows; ++i)
+			zrows[i].clear();
+
+		const int x0 = chunk.pos.x * chunkSize;
+		const int y0 = chunk.pos.y * chunkSize;
+		const int x1 = std::min(x0 + chunkSize, mapData->xSize());
+		const int y1 = std::min(y0 + chunkSize, mapData->ySize());
+
+		SVertex vert[cellQuads*4];
+
+		for (int y = y0; y < y1; ++y)
+			for (int x = x0; x < x1; ++x)
+				for (int z = 0; z < mapData->zSize(); ++z)
+				{
+					int tileInd = mapData->at(x, y, z);
+					int quads = tileQuadCount(tileInd);
+
+					if (quads == 0)
+						continue;
+
+					buildCell(x, y, tileInd, vert);
+
+					int prio = cellPriority(tileInd);
+					SVVector &array = (prio == 0) ? ground : zrows[y - y0 + prio];
+					array.insert(array.end(), vert, vert + quads*4);
+				}
+	}
+
+	void uploadChunk(ChunkBuild &build)
+	{
+		TileChunk &chunk = *build.chunk;
+
+		const SVVector &ground = build.groundVert;
+		const SVVector *zrows = build.zrowVert;
+
+		size_t quadCount = ground.size() / 4;
+		chunk.groundQuads = quadCount;
+
+		for (int i = 0; i < chunkZRows; ++i)
+		{
+			chunk.zrowBases[i] = quadCount;
+			quadCount += zrows[i].size() / 4;
+		}
+
+		chunk.zrowBases[chunkZRows] = quadCount;
+
+		VBO::bind(chunk.vbo);
+		VBO::allocEmpty(quadDataSize(quadCount));
+		VBO::uploadSubData(0, quadDataSize(chunk.groundQuads), dataPtr(ground));
+
+		for (int i = 0; i < chunkZRows; ++i)
+		{
+			if (zrows[i].empty())
+				continue;
+
+			VBO::uploadSubData(quadDataSize(chunk.zrowBases[i]),
+			                   quadDataSize(zrows[i].size() / 4), dataPtr(zrows[i]));
+		}
+
+		VBO::unbind();
+
+		shState->ensureQuadIBO(quadCount);
+	}
+
+	/* Generates all dirty visible chunks on the worker
+	 * pool, then uploads them here (GL isn't threaded) */
+	void buildVisibleChunks()
+	{
+		size_t count = 0;
+
+		for (size_t i = 0; i < chunks.visible.size(); ++i)
+		{
+			TileChunk *chunk = chunks.visible[i].chunk;
+
+			/* Chunks repeat when the map wraps around */
+			if (!chunk->dirty)
+				continue;
+
+			chunk->dirty = false;
+
+			if (count == chunks.builds.size())
+				chunks.builds.push_back(new ChunkBuild(this));
+
+			chunks.builds[count++]->chunk = chunk;
+		}
+
+		if (count == 0)
+			return;
+
+		std::vector<WorkerPool::Job*> jobs(chunks.builds.begin(),
+		                                   chunks.builds.begin() + count);
+		shState->workerPool().run(&jobs[0], count);
+
+		for (size_t i = 0; i < count; ++i)
+			uploadChunk(*chunks.builds[i]);
+	}
+
+	/* Marks the chunks containing changed cells for rebuilding */
+	void invalidateChangedChunks()
+	{
+		changedCells.clear();
+
+		if (!mapData->changesSince(mapDataStamp, changedCells))
+		{
+			buffersDirty = true;
+			return;
+		}
+
+		mapDataStamp = mapData->changeStamp();
+
+		for (size_t i = 0; i < changedCells.size(); ++i)
+		{
+			const Table::Cell &cell = changedCells[i];
+			TileChunk *chunk = chunks.grid[(cell.y / chunkSize) * chunks.gridSize.x
+			                               + cell.x / chunkSize];
+
+			if (chunk && !chunk->dirty)
+			{
+				chunk->dirty = true;
+				zlayersDirty = true;
+			}
+		}
+	}
+
+	/* Collects the chunks intersecting the view, in every
+	 * repetition of the map that is visible. Doesn't touch
+	 * any vertex data. Returns false if nothing changed */
+	bool updateChunkView(bool force)
+	{
+		const IntRect &rect = elem.sceneGeo.rect;
+		Vec2i viewSize((rect.w / 32) + !!(rect.w % 32) + 1,
+		               (rect.h / 32) + !!(rect.h % 32) + 1);
+
+		Vec2i tileO = tileOffset();
+
+		if (!force && tileO == viewpPos && viewSize == chunks.viewSize)
+			return false;
+
+		viewpPos = tileO;
+		chunks.viewSize = viewSize;
+		chunks.visible.clear();
+
+		updateFlashMapViewport();
+		updatePosition();
+
+		const int mapW = mapData->xSize();
+		const int mapH = mapData->ySize();
+
+		if (mapW == 0 || mapH == 0)
+			return true;
+
+		const int x0 = viewpPos.x, x1 = viewpPos.x + viewSize.x;
+		const int y0 = viewpPos.y, y1 = viewpPos.y + viewSize.y;
+
+		for (int ky = floorDiv(y0, mapH); ky <= floorDiv(y1-1, mapH); ++ky)
+			for (int kx = floorDiv(x0, mapW); kx <= floorDiv(x1-1, mapW); ++kx)
+			{
+				/* Visible part of this repetition, in map tiles */
+				int lx0 = std::max(x0 - kx*mapW, 0);
+				int lx1 = std::min(x1 - kx*mapW, mapW);
+				int ly0 = std::max(y0 - ky*mapH, 0);
+				int ly1 = std::min(y1 - ky*mapH, mapH);
+
+				for (int cy = ly0 / chunkSize; cy <= (ly1-1) / chunkSize; ++cy)
+					for (int cx = lx0 / chunkSize; cx <= (lx1-1) / chunkSize; ++cx)
+					{
+						ChunkDraw draw;
+						draw.chunk = chunkAt(cx, cy);
+						draw.trans = Vec2i(kx*mapW*32, ky*mapH*32);
+						draw.row = ky*mapH + cy*chunkSize;
+
+						chunks.visible.push_back(draw);
+					}
+			}
+
+		return true;
+	}
+
+	/* Whether any visible chunk has tiles in the zlayer
+	 * at 'index' (relative to the top of the view) */
+	bool chunkZLayerUsed(int index)
+	{
+		for (size_t i = 0; i < chunks.visible.size(); ++i)
+		{
+			const ChunkDraw &draw = chunks.visible[i];
+			int zrow = viewpPos.y + index - draw.row;
+
+			if (zrow < 0 || zrow >= chunkZRows)
+				continue;
+
+			if (draw.chunk->zrowBases[zrow+1] > draw.chunk->zrowBases[zrow])
+				return true;
+		}
+
+		return false;
+	}
+
+	void updateChunkElements()
+	{
+		std::vector<int> zlayerInd;
+		const int layers = chunks.viewSize.y + 5;
+
+		for (int i = 0; i < layers; ++i)
+			if (chunkZLayerUsed(i))
+				zlayerInd.push_back(i);
+
+		while (elem.zlayers.size() < zlayerInd.size())
+			elem.zlayers.push_back(new ZLayer(this, viewport));
+
+		updateActiveElements(zlayerInd);
+		elem.activeLayers = zlayerInd.size();
+		zOrderDirty = false;
+	}
+
+	void prepareChunks()
+	{
+		const Vec2i gridSize((mapData->xSize() + chunkSize - 1) / chunkSize,
+		                     (mapData->ySize() + chunkSize - 1) / chunkSize);
+
+		/* Table#resize doesn't emit 'modified' */
+		if (!(gridSize == chunks.gridSize))
+			buffersDirty = true;
+
+		if (cellsDirty)
+		{
+			if (!buffersDirty)
+				invalidateChangedChunks();
+
+			cellsDirty = false;
+		}
+
+		bool viewDirty = mapViewportDirty;
+
+		if (buffersDirty)
+		{
+			clearChunks();
+
+			chunks.gridSize = gridSize;
+			chunks.grid.assign(gridSize.x * gridSize.y, 0);
+
+			mapDataStamp = mapData->changeStamp();
+			viewDirty = true;
+			buffersDirty = false;
+		}
+
+		if (viewDirty)
+		{
+			if (updateChunkView(chunks.visible.empty()))
+				zlayersDirty = true;
+
+			mapViewportDirty = false;
+		}
+
+		buildVisibleChunks();
+
+		if (zlayersDirty)
+		{
+			updateChunkElements();
+			zlayersDirty = false;
+		}
+	}
+
+	void drawChunkRange(ShaderBase &shader, const ChunkDraw &draw,
+	                    size_t first, size_t last)
+	{
+		if (first == last)
+			return;
+
+		shader.setTranslation(Vec2i(tileDispPos.x + draw.trans.x,
+		                            tileDispPos.y + draw.trans.y));
+
+		GLMeta::vaoBind(draw.chunk->vao);
+
+		gl.DrawElements(GL_TRIANGLES, (last - first) * 6, _GL_INDEX_TYPE,
+		                (GLvoid*) (first * 6 * sizeof(index_t)));
+
+		GLMeta::vaoUnbind(draw.chunk->vao);
+	}
+
+	void drawChunksGround(ShaderBase &shader)
+	{
+		for (size_t i = 0; i < chunks.visible.size(); ++i)
+			drawChunkRange(shader, chunks.visible[i], 0, chunks.visible[i].chunk->groundQuads);
+	}
+
+	/* Draws the tiles of zlayers 'first' to 'last' (relative to the
+	 * top of the view), which are consecutive in every chunk */
+	void drawChunksZLayers(ShaderBase &shader, int first, int last)
+	{
+		for (size_t i = 0; i < chunks.visible.size(); ++i)
+		{
+			const ChunkDraw &draw = chunks.visible[i];
+
+			int zrow0 = clamp(viewpPos.y + first - draw.row, 0, chunkZRows);
+			int zrow1 = clamp(viewpPos.y + last + 1 - draw.row, 0, chunkZRows);
+
+			drawChunkRange(shader, draw, draw.chunk->zrowBases[zrow0],
+			               draw.chunk->zrowBases[zrow1]);
+		}
+	}
+
 	void prepare()
 	{
+		FrameProfiler::Scope scope(shState->profiler(), FrameProfiler::TilemapPrepare);
+
 		if (!verifyResources())
 		{
 			if (tilemapReady)
@@ -906,29 +1681,20 @@ struct TilemapPrivate
 
 		if (atlasSizeDirty)
 		{
-			allocateAtlas();
+			resizeAtlas();
 			atlasSizeDirty = false;
 		}
 
 		if (atlasDirty)
 		{
-			buildAtlas();
+			acquireAtlas();
 			atlasDirty = false;
 		}
 
-		if (mapViewportDirty)
-		{
-			updateMapViewport();
-			mapViewportDirty = false;
-		}
-
-		if (buffersDirty)
-		{
-			buildQuadArray();
-			uploadBuffers();
-			updateSceneElements();
-			buffersDirty = false;
-		}
+		if (chunked)
+			prepareChunks();
+		else
+			prepareBuffers();
 
 		flashMap.prepare();
 
@@ -944,6 +1710,11 @@ struct TilemapPrivate
 	}
 };
 
+void ChunkBuild::run()
+{
+	p->generateChunk(*this);
+}
+
 GroundLayer::GroundLayer(TilemapPrivate *p, Viewport *viewport)
     : ViewportElement(viewport, 0),
       vboCount(0),
@@ -964,12 +1735,19 @@ void GroundLayer::draw()
 	p->bindShader(shader);
 	p->bindAtlas(*shader);
 
-	GLMeta::vaoBind(p->tiles.vao);
+	if (p->chunked)
+	{
+		p->drawChunksGround(*shader);
+	}
+	else
+	{
+		GLMeta::vaoBind(p->tiles.vao);
 
-	shader->setTranslation(p->dispPos);
-	drawInt();
+		shader->setTranslation(p->tileDispPos);
+		drawInt();
 
-	GLMeta::vaoUnbind(p->tiles.vao);
+		GLMeta::vaoUnbind(p->tiles.vao);
+	}
 
 	p->flashMap.draw(flashAlpha[p->flashAlphaIdx] / 255.f, p->dispPos);
 }
@@ -991,7 +1769,8 @@ ZLayer::ZLayer(TilemapPrivate *p, Viewport *viewport)
       vboOffset(0),
       vboCount(0),
       p(p),
-      vboBatchCount(0)
+      vboBatchCount(0),
+      batchLast(0)
 {}
 
 void ZLayer::setIndex(int value)
@@ -1001,6 +1780,10 @@ void ZLayer::setIndex(int value)
 	z = calculateZ(p, index);
 	scene->reinsert(*this);
 
+	/* Chunks keep their own buffers */
+	if (p->chunked)
+		return;
+
 	vboOffset = p->zlayerBases[index] * sizeof(index_t) * 6;
 	vboCount = p->zlayerSize(index) * 6;
 }
@@ -1015,9 +1798,15 @@ void ZLayer::draw()
 	p->bindShader(shader);
 	p->bindAtlas(*shader);
 
+	if (p->chunked)
+	{
+		p->drawChunksZLayers(*shader, index, batchLast);
+		return;
+	}
+
 	GLMeta::vaoBind(p->tiles.vao);
 
-	shader->setTranslation(p->dispPos);
+	shader->setTranslation(p->tileDispPos);
 	drawInt();
 
 	GLMeta::vaoUnbind(p->tiles.vao);
@@ -1168,7 +1957,7 @@ void Tilemap::setMapData(Table *value)
 	p->invalidateBuffers();
 	p->mapDataCon.disconnect();
 	p->mapDataCon = value->modified.connect
-	        (sigc::mem_fun(p, &TilemapPrivate::invalidateBuffers));
+	        (sigc::mem_fun(p, &TilemapPrivate::invalidateCells));
 }
 
 void Tilemap::setFlashData(Table *value)
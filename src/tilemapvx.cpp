@@ -22,6 +22,7 @@
 #include "tilemapvx.h"
 
 #include "tileatlasvx.h"
+#include "tileatlascache.h"
 #include "etc-internal.h"
 #include "bitmap.h"
 #include "table.h"
@@ -34,8 +35,13 @@
 #include "quadarray.h"
 #include "shader.h"
 #include "tilemap-common.h"
+#include "global-ibo.h"
+#include "frameprofiler.h"
+#include "workerpool.h"
 
 #include <vector>
+#include <algorithm>
+#include <stdlib.h>
 #include <sigc++/connection.h>
 
 /* Flash tiles pulsing opacity */
@@ -51,7 +57,84 @@ static const uint8_t flashAlpha[] =
 
 static elementsN(flashAlpha);
 
-struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
+/* Largest quad count the global IBO can index */
+static const size_t maxQuads = (INDEX_T_MAX - 1) / 6;
+
+/* Reads single map cells into lists of ground and above quads */
+struct CellReader : TileAtlasVX::Reader
+{
+	std::vector<SVertex> ground;
+	std::vector<SVertex> above;
+	Vec2 origin;
+
+	/* Quads of neighbouring cells never overlap, so reading cell by
+	 * cell (instead of layer by layer) doesn't change the result */
+	void read(const Table &mapData, const Table *flags, int x, int y)
+	{
+		ground.clear();
+		above.clear();
+
+		origin = Vec2(x*32, y*32);
+		TileAtlasVX::readTiles(*this, mapData, flags, x, y, 1, 1);
+	}
+
+	SVertex *allocVert(std::vector<SVertex> &vec, size_t count)
+	{
+		size_t size = vec.size();
+		vec.resize(size + count);
+
+		return &vec[size];
+	}
+
+	/* TileAtlasVX::Reader */
+	void onQuads(const FloatRect *t, const FloatRect *p,
+	              size_t n, bool overPlayer)
+	{
+		SVertex *vert = allocVert(overPlayer ? above : ground, n*4);
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			FloatRect pos = p[i];
+			pos.x += origin.x;
+			pos.y += origin.y;
+
+			Quad::setTexPosRect(&vert[i*4], t[i], pos);
+		}
+	}
+};
+
+struct TilemapVXPrivate;
+
+/* A band of map viewport rows, read on the worker pool */
+struct RowBand : WorkerPool::Job
+{
+	TilemapVXPrivate *p;
+	int y0, y1;
+
+	/* Whether to collect the quads in 'ground' and 'above'
+	 * (noting the largest cell), instead of writing them
+	 * into the ring buffer slots directly */
+	bool packed;
+
+	CellReader reader;
+	std::vector<SVertex> ground;
+	std::vector<SVertex> above;
+	size_t maxGround;
+	size_t maxAbove;
+
+	RowBand(TilemapVXPrivate *p)
+	    : p(p),
+	      y0(0),
+	      y1(0),
+	      packed(false),
+	      maxGround(0),
+	      maxAbove(0)
+	{}
+
+	void run();
+};
+
+struct TilemapVXPrivate : public ViewportElement
 {
 	Bitmap *bitmaps[BM_COUNT];
 
@@ -59,7 +142,10 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	Table *flags;
 	Vec2i offset;
 
+	/* Flash tiles are relative to the map viewport,
+	 * tile vertices are in absolute map coordinates */
 	Vec2i dispPos;
+	Vec2i tileDispPos;
 	/* Map viewport position */
 	IntRect mapViewp;
 	Vec2i sceneOffset;
@@ -68,7 +154,24 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	std::vector<SVertex> groundVert;
 	std::vector<SVertex> aboveVert;
 
+	/* Unless 'ringLayout' is false (which means the quads are
+	 * simply packed), every map viewport cell owns a fixed slot
+	 * of quads in both layers: map cell (x, y) lives in slot
+	 * (x mod w, y mod h). When the map viewport moves, only
+	 * the newly exposed cells have to be read and uploaded */
+	bool ringLayout;
+	size_t cellGroundQuads;
+	size_t cellAboveQuads;
+
+	/* For streaming */
+	CellReader reader;
+
+	/* For full rebuilds */
+	std::vector<RowBand*> bands;
+
 	TEXFBO atlas;
+	/* What 'atlas' was assembled from */
+	TileAtlasKey atlasKey;
 	VBO::ID vbo;
 	GLMeta::VAO vao;
 
@@ -118,6 +221,9 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	    : ViewportElement(viewport),
 	      mapData(0),
 	      flags(0),
+	      ringLayout(false),
+	      cellGroundQuads(0),
+	      cellAboveQuads(0),
 	      allocQuads(0),
 	      groundQuads(0),
 	      aboveQuads(0),
@@ -130,8 +236,6 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	{
 		memset(bitmaps, 0, sizeof(bitmaps));
 
-		shState->requestAtlasTex(ATLASVX_W, ATLASVX_H, atlas);
-
 		vbo = VBO::gen();
 
 		GLMeta::vaoFillInVertexData<SVertex>(vao);
@@ -150,7 +254,10 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		GLMeta::vaoFini(vao);
 		VBO::del(vbo);
 
-		shState->releaseAtlasTex(atlas);
+		shState->releaseAtlasTex(atlas, atlasKey);
+
+		for (size_t i = 0; i < bands.size(); ++i)
+			delete bands[i];
 
 		prepareCon.disconnect();
 
@@ -174,15 +281,50 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		buffersDirty = true;
 	}
 
+	/* Takes over a cached atlas assembled from the current
+	 * bitmaps if there is one, and builds it otherwise */
 	void rebuildAtlas()
 	{
+		TileAtlasKey key;
+
+		for (size_t i = 0; i < BM_COUNT; ++i)
+			key.add(bitmaps[i]);
+
+		if (key == atlasKey)
+			return;
+
+		TEXFBO cached;
+
+		if (shState->requestAtlasTex(key, cached))
+		{
+			shState->releaseAtlasTex(atlas, atlasKey);
+			atlas = cached;
+			atlasKey = key;
+
+			return;
+		}
+
+		const bool sameBitmaps = key.sameBitmaps(atlasKey);
+
+		if (!sameBitmaps || atlas.tex == TEX::ID(0))
+		{
+			/* Modified bitmaps never get their old contents
+			 * back, so only keep atlases of other bitmaps */
+			shState->releaseAtlasTex(atlas, sameBitmaps ? TileAtlasKey() : atlasKey);
+			shState->requestAtlasTex(ATLASVX_W, ATLASVX_H, atlas);
+		}
+
 		TileAtlasVX::build(atlas, bitmaps);
+		atlasKey = key;
 	}
 
 	void updatePosition()
 	{
 		dispPos.x = -(offset.x - mapViewp.x * 32) + sceneOffset.x;
 		dispPos.y = -(offset.y - mapViewp.y * 32) + sceneOffset.y;
+
+		tileDispPos.x = -offset.x + sceneOffset.x;
+		tileDispPos.y = -offset.y + sceneOffset.y;
 	}
 
 	void updateMapViewport()
@@ -201,6 +343,7 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		else
 			tileOY = -(-(offs.y-31) / 32);
 
+		const Vec2i oldPos(mapViewp.x, mapViewp.y);
 		bool dirty = false;
 
 		if (tileOX < mapViewp.x || tileOX > mapViewp.x)
@@ -215,9 +358,10 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 			dirty = true;
 		}
 
-		if (dirty)
+		if (dirty && !buffersDirty)
 		{
-			buffersDirty = true;
+			if (!streamMapViewport(oldPos))
+				buffersDirty = true;
 		}
 
 		updatePosition();
@@ -229,16 +373,191 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		return quads * 4 * sizeof(SVertex);
 	}
 
+	size_t ringSlot(int x, int y)
+	{
+		return wrap(y, mapViewp.h) * mapViewp.w + wrap(x, mapViewp.w);
+	}
+
+	static void writeSlot(std::vector<SVertex> &vec, size_t slot, size_t slotQuads,
+	                      const std::vector<SVertex> &cell)
+	{
+		SVertex *vert = &vec[slot*slotQuads*4];
+
+		for (size_t i = 0; i < slotQuads*4; ++i)
+			vert[i] = (i < cell.size()) ? cell[i] : SVertex();
+	}
+
+	/* Moves the quads of 'cell' into 'slot'. Returns false if
+	 * they don't fit. Slots are disjoint, so different cells
+	 * can be written in parallel */
+	bool writeCell(size_t slot, const CellReader &cell)
+	{
+		if (cell.ground.size() > cellGroundQuads*4 ||
+		    cell.above.size() > cellAboveQuads*4)
+			return false;
+
+		writeSlot(groundVert, slot, cellGroundQuads, cell.ground);
+		writeSlot(aboveVert, slot, cellAboveQuads, cell.above);
+
+		return true;
+	}
+
+	void uploadCell(size_t slot)
+	{
+		VBO::uploadSubData(quadBytes(slot*cellGroundQuads), quadBytes(cellGroundQuads),
+		                   &groundVert[slot*cellGroundQuads*4]);
+
+		if (cellAboveQuads == 0)
+			return;
+
+		VBO::uploadSubData(quadBytes(groundQuads + slot*cellAboveQuads), quadBytes(cellAboveQuads),
+		                   &aboveVert[slot*cellAboveQuads*4]);
+	}
+
+	/* Reads and uploads the cells that entered the map viewport
+	 * since it was at 'oldPos'. Returns false if the buffers
+	 * have to be rebuilt instead */
+	bool streamMapViewport(const Vec2i &oldPos)
+	{
+		if (!ringLayout || !mapData)
+			return false;
+
+		if (abs(mapViewp.x - oldPos.x) >= mapViewp.w ||
+		    abs(mapViewp.y - oldPos.y) >= mapViewp.h)
+			return false;
+
+		bool fits = true;
+
+		VBO::bind(vbo);
+
+		for (int y = 0; y < mapViewp.h && fits; ++y)
+			for (int x = 0; x < mapViewp.w && fits; ++x)
+			{
+				int mapX = x + mapViewp.x;
+				int mapY = y + mapViewp.y;
+
+				/* Already buffered */
+				if (mapX >= oldPos.x && mapX < oldPos.x + mapViewp.w &&
+				    mapY >= oldPos.y && mapY < oldPos.y + mapViewp.h)
+					continue;
+
+				reader.read(*mapData, flags, mapX, mapY);
+
+				size_t slot = ringSlot(mapX, mapY);
+				fits = writeCell(slot, reader);
+
+				if (fits)
+					uploadCell(slot);
+			}
+
+		VBO::unbind();
+
+		return fits;
+	}
+
+	void readBand(RowBand &band)
+	{
+		CellReader &cell = band.reader;
+
+		band.ground.clear();
+		band.above.clear();
+		band.maxGround = 0;
+		band.maxAbove = 0;
+
+		for (int y = band.y0; y < band.y1; ++y)
+			for (int x = 0; x < mapViewp.w; ++x)
+			{
+				int mapX = x + mapViewp.x;
+				int mapY = y + mapViewp.y;
+
+				cell.read(*mapData, flags, mapX, mapY);
+
+				if (!band.packed)
+				{
+					writeCell(ringSlot(mapX, mapY), cell);
+					continue;
+				}
+
+				band.maxGround = std::max(band.maxGround, cell.ground.size() / 4);
+				band.maxAbove = std::max(band.maxAbove, cell.above.size() / 4);
+
+				band.ground.insert(band.ground.end(), cell.ground.begin(), cell.ground.end());
+				band.above.insert(band.above.end(), cell.above.begin(), cell.above.end());
+			}
+	}
+
+	/* Reads the map viewport in row bands on the worker
+	 * pool. Returns the number of bands used */
+	size_t readBands(bool packed)
+	{
+		WorkerPool &pool = shState->workerPool();
+		const int count = std::min(pool.concurrency(), mapViewp.h);
+
+		while (bands.size() < (size_t) count)
+			bands.push_back(new RowBand(this));
+
+		for (int i = 0; i < count; ++i)
+		{
+			bands[i]->y0 = mapViewp.h * i / count;
+			bands[i]->y1 = mapViewp.h * (i+1) / count;
+			bands[i]->packed = packed;
+		}
+
+		std::vector<WorkerPool::Job*> jobs(bands.begin(), bands.begin() + count);
+		pool.run(&jobs[0], count);
+
+		return count;
+	}
+
 	void rebuildBuffers()
 	{
 		if (!mapData)
 			return;
 
+		const size_t cells = mapViewp.w * mapViewp.h;
+		size_t maxGround = 0, maxAbove = 0;
+
 		groundVert.clear();
 		aboveVert.clear();
 
-		TileAtlasVX::readTiles(*this, *mapData, flags,
-		                       mapViewp.x, mapViewp.y, mapViewp.w, mapViewp.h);
+		/* Read everything packed first, noting the largest cells */
+		size_t bandCount = readBands(true);
+
+		for (size_t i = 0; i < bandCount; ++i)
+		{
+			const RowBand &band = *bands[i];
+
+			maxGround = std::max(maxGround, band.maxGround);
+			maxAbove = std::max(maxAbove, band.maxAbove);
+
+			groundVert.insert(groundVert.end(), band.ground.begin(), band.ground.end());
+			aboveVert.insert(aboveVert.end(), band.above.begin(), band.above.end());
+		}
+
+		/* Slots don't shrink again, so scrolling back and forth
+		 * over busy areas doesn't keep rebuilding. With very large
+		 * viewports they might not fit into the index range at all,
+		 * in which case we stay packed */
+		size_t groundCap = std::max(cellGroundQuads, maxGround);
+		size_t aboveCap = std::max(cellAboveQuads, maxAbove);
+
+		if (cells * (groundCap + aboveCap) > maxQuads)
+		{
+			groundCap = maxGround;
+			aboveCap = maxAbove;
+		}
+
+		ringLayout = cells * (groundCap + aboveCap) <= maxQuads;
+		cellGroundQuads = ringLayout ? groundCap : 0;
+		cellAboveQuads = ringLayout ? aboveCap : 0;
+
+		if (ringLayout)
+		{
+			groundVert.resize(cells*cellGroundQuads*4);
+			aboveVert.resize(cells*cellAboveQuads*4);
+
+			readBands(false);
+		}
 
 		groundQuads = groundVert.size() / 4;
 		aboveQuads = aboveVert.size() / 4;
@@ -262,6 +581,8 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 
 	void prepare()
 	{
+		FrameProfiler::Scope scope(shState->profiler(), FrameProfiler::TilemapPrepare);
+
 		if (!mapData)
 			return;
 
@@ -286,14 +607,6 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		flashMap.prepare();
 	}
 
-	SVertex *allocVert(std::vector<SVertex> &vec, size_t count)
-	{
-		size_t size = vec.size();
-		vec.resize(size + count);
-
-		return &vec[size];
-	}
-
 	/* SceneElement */
 	void draw()
 	{
@@ -326,7 +639,7 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 
 		shader->setTexSize(Vec2i(atlas.width, atlas.height));
 		shader->applyViewportProj();
-		shader->setTranslation(dispPos);
+		shader->setTranslation(tileDispPos);
 
 		TEX::bind(atlas.tex);
 		GLMeta::vaoBind(vao);
@@ -345,7 +658,7 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		shader.bind();
 		shader.setTexSize(Vec2i(atlas.width, atlas.height));
 		shader.applyViewportProj();
-		shader.setTranslation(dispPos);
+		shader.setTranslation(tileDispPos);
 
 		TEX::bind(atlas.tex);
 		GLMeta::vaoBind(vao);
@@ -378,18 +691,13 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	}
 
 	ABOUT_TO_ACCESS_NOOP
-
-	/* TileAtlasVX::Reader */
-	void onQuads(const FloatRect *t, const FloatRect *p,
-	              size_t n, bool overPlayer)
-	{
-		SVertex *vert = allocVert(overPlayer ? aboveVert : groundVert, n*4);
-
-		for (size_t i = 0; i < n; ++i)
-			Quad::setTexPosRect(&vert[i*4], t[i], p[i]);
-	}
 };
 
+void RowBand::run()
+{
+	p->readBand(*this);
+}
+
 void TilemapVX::BitmapArray::set(int i, Bitmap *bitmap)
 {
 	if (!p)
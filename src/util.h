@@ -23,6 +23,7 @@
 #define UTIL_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string>
 #include <algorithm>
 #include <vector>
@@ -95,6 +96,61 @@ inline void strReplace(std::string &str,
 			str[i] = after;
 }
 
+/* Decodes the UTF-8 sequence at 'str' and advances it past it.
+ * Returns 0 for invalid sequences and characters outside the
+ * BMP (SDL_ttf can't handle those) */
+inline uint16_t utf8NextUCS2(const char *&str)
+{
+	const unsigned char *in = reinterpret_cast<const unsigned char*>(str);
+
+	if (in[0] < 0x80)
+	{
+		str += 1;
+		return in[0];
+	}
+
+	if ((in[0] & 0xF0) == 0xF0)
+	{
+		int i = 1;
+		while (i < 4 && in[i] != 0)
+			++i;
+
+		str += i;
+		return 0;
+	}
+
+	if ((in[0] & 0xE0) == 0xE0)
+	{
+		if (in[1] == 0 || in[2] == 0)
+		{
+			str += (in[1] == 0) ? 1 : 2;
+			return 0;
+		}
+
+		str += 3;
+		return (in[0] & 0x0F)<<12 |
+		       (in[1] & 0x3F)<<6  |
+		       (in[2] & 0x3F);
+	}
+
+	if ((in[0] & 0xC0) == 0xC0)
+	{
+		if (in[1] == 0)
+		{
+			str += 1;
+			return 0;
+		}
+
+		str += 2;
+		return (in[0] & 0x1F)<<6  |
+		       (in[1] & 0x3F);
+	}
+
+	/* Stray continuation byte */
+	str += 1;
+	return 0;
+}
+
 /* Check if [C]ontainer contains [V]alue */
 template<typename C, typename V>
 inline bool contains(const C &c, const V &v)
@@ -53,6 +53,25 @@ static const VertexAttribute VertexAttribs[] =
 	{ Shader::TexCoord, 2, GL_FLOAT, o(Vertex, texPos) }
 };
 
+static const VertexAttribute SpriteVertexAttribs[] =
+{
+	{ Shader::Color,    4, GL_FLOAT, o(SpriteVertex, color)  },
+	{ Shader::Position, 2, GL_FLOAT, o(SpriteVertex, pos)    },
+	{ Shader::TexCoord, 2, GL_FLOAT, o(SpriteVertex, texPos) },
+	{ Shader::Tone,     4, GL_FLOAT, o(SpriteVertex, tone)   },
+	{ Shader::Effect,   4, GL_FLOAT, o(SpriteVertex, effect) }
+};
+
+static const VertexAttribute SpriteInstanceAttribs[] =
+{
+	{ Shader::Origin,   2, GL_FLOAT, o(SpriteInstance, origin)  },
+	{ Shader::Edges,    4, GL_FLOAT, o(SpriteInstance, edges)   },
+	{ Shader::TexCoord, 4, GL_FLOAT, o(SpriteInstance, texRect) },
+	{ Shader::Color,    4, GL_FLOAT, o(SpriteInstance, color)   },
+	{ Shader::Tone,     4, GL_FLOAT, o(SpriteInstance, tone)    },
+	{ Shader::Effect,   4, GL_FLOAT, o(SpriteInstance, effect)  }
+};
+
 #define DEF_TRAITS(VertType) \
 	template<> \
 	const VertexAttribute *VertexTraits<VertType>::attr = VertType##Attribs; \
@@ -62,3 +81,5 @@ static const VertexAttribute VertexAttribs[] =
 DEF_TRAITS(SVertex);
 DEF_TRAITS(CVertex);
 DEF_TRAITS(Vertex);
+DEF_TRAITS(SpriteVertex);
+DEF_TRAITS(SpriteInstance);
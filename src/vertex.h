@@ -51,6 +51,35 @@ struct Vertex
 	Vertex();
 };
 
+/* Sprite vertex carrying all per sprite effect
+ * parameters, so many sprites can be drawn at once */
+struct SpriteVertex
+{
+	Vec2 pos;
+	Vec2 texPos;
+	Vec4 color;
+	Vec4 tone;
+	/* Opacity, bush depth, bush opacity, unused */
+	Vec4 effect;
+};
+
+/* One sprite quad for instanced drawing, expanded
+ * from a unit square in the vertex shader */
+struct SpriteInstance
+{
+	/* Corner at the texRect origin; the other corners
+	 * are offset from it by edgeU, edgeV or both */
+	Vec2 origin;
+	/* edgeU (xy), edgeV (zw) */
+	Vec4 edges;
+	/* x, y, width, height in texels; the
+	 * width is negative when mirrored */
+	Vec4 texRect;
+	Vec4 color;
+	Vec4 tone;
+	Vec4 effect;
+};
+
 struct VertexAttribute
 {
 	Shader::Attribute index;
@@ -67,6 +67,7 @@ struct ViewportPrivate
 	void onRectChange()
 	{
 		self->geometry.rect = rect->toIntRect();
+		self->setBounds(self->geometry.rect);
 		self->notifyGeometryChange();
 		recomputeOnScreen();
 	}
@@ -127,6 +128,7 @@ void Viewport::initViewport(int x, int y, int width, int height)
 
 	/* Set our own geometry */
 	geometry.rect = IntRect(x, y, width, height);
+	setBounds(geometry.rect);
 
 	/* Handle parent geometry */
 	onGeometryChange(scene->getGeometry());
@@ -215,6 +217,17 @@ void Viewport::draw()
 	composite();
 }
 
+bool Viewport::digest(FrameDigest &digest)
+{
+	digestFlash(digest);
+
+	digest.add(p->color->norm);
+	digest.add(p->tone->norm);
+
+	/* Our rect and origin are part of our geometry */
+	return digestElements(digest);
+}
+
 void Viewport::onGeometryChange(const Geometry &geo)
 {
 	p->screenRect = geo.rect;
@@ -33,6 +33,7 @@
 #include "quadarray.h"
 #include "texpool.h"
 #include "glstate.h"
+#include "frameprofiler.h"
 
 #include <sigc++/connection.h>
 
@@ -220,6 +221,13 @@ struct WindowPrivate
 			p->drawControls();
 		}
 
+		bool digest(FrameDigest &digest)
+		{
+			p->digest(digest);
+
+			return true;
+		}
+
 		void release()
 		{
 			unlink();
@@ -511,6 +519,8 @@ struct WindowPrivate
 
 	void prepare()
 	{
+		FrameProfiler::Scope scope(shState->profiler(), FrameProfiler::WindowPrepare);
+
 		if (size.x <= 0 || size.y <= 0)
 			return;
 
@@ -682,6 +692,41 @@ struct WindowPrivate
 		if (++pauseAniQuadIdx == pauseAniQuadN)
 			pauseAniQuadIdx = 0;
 	}
+
+	/* Shared by the base and the controls element. The animation
+	 * steps only count while they're actually visible, otherwise
+	 * idle windows would never let a frame go static */
+	void digest(FrameDigest &digest)
+	{
+		SceneElement::digestBitmap(digest, windowskin);
+		SceneElement::digestBitmap(digest, contents);
+
+		digest.add(bgStretch);
+		digest.add(cursorRect->x);
+		digest.add(cursorRect->y);
+		digest.add(cursorRect->width);
+		digest.add(cursorRect->height);
+		digest.add(active);
+		digest.add(pause);
+
+		digest.add(sceneOffset);
+		digest.add(position);
+		digest.add(size);
+		digest.add(contentsOffset);
+
+		digest.add(opacity.unNorm);
+		digest.add(backOpacity.unNorm);
+		digest.add(contentsOpacity.unNorm);
+
+		if (active && !cursorRect->isEmpty())
+			digest.add(cursorAniAlphaIdx);
+
+		if (pause)
+		{
+			digest.add(pauseAniAlphaIdx);
+			digest.add(pauseAniQuadIdx);
+		}
+	}
 };
 
 Window::Window(Viewport *viewport)
@@ -704,10 +749,11 @@ void Window::update()
 	p->stepAnimations();
 }
 
-DEF_ATTR_SIMPLE(Window, X,          int,     p->position.x)
-DEF_ATTR_SIMPLE(Window, Y,          int,     p->position.y)
 DEF_ATTR_SIMPLE(Window, CursorRect, Rect&,  *p->cursorRect)
 
+DEF_ATTR_RD_SIMPLE(Window, X,               int,     p->position.x)
+DEF_ATTR_RD_SIMPLE(Window, Y,               int,     p->position.y)
+
 DEF_ATTR_RD_SIMPLE(Window, Windowskin,      Bitmap*, p->windowskin)
 DEF_ATTR_RD_SIMPLE(Window, Contents,        Bitmap*, p->contents)
 DEF_ATTR_RD_SIMPLE(Window, Stretch,         bool,    p->bgStretch)
@@ -785,6 +831,22 @@ void Window::setPause(bool value)
 	p->controlsVertDirty = true;
 }
 
+void Window::setX(int value)
+{
+	guardDisposed();
+
+	p->position.x = value;
+	updateBounds();
+}
+
+void Window::setY(int value)
+{
+	guardDisposed();
+
+	p->position.y = value;
+	updateBounds();
+}
+
 void Window::setWidth(int value)
 {
 	guardDisposed();
@@ -794,6 +856,7 @@ void Window::setWidth(int value)
 
 	p->size.x = value;
 	p->baseVertDirty = true;
+	updateBounds();
 }
 
 void Window::setHeight(int value)
@@ -805,6 +868,7 @@ void Window::setHeight(int value)
 
 	p->size.y = value;
 	p->baseVertDirty = true;
+	updateBounds();
 }
 
 void Window::setOX(int value)
@@ -874,10 +938,30 @@ void Window::draw()
 	p->drawBase();
 }
 
+bool Window::digest(FrameDigest &digest)
+{
+	p->digest(digest);
+
+	return true;
+}
+
 void Window::onGeometryChange(const Scene::Geometry &geo)
 {
 	p->sceneOffset.x = geo.rect.x - geo.xOrigin;
 	p->sceneOffset.y = geo.rect.y - geo.yOrigin;
+
+	updateBounds();
+}
+
+void Window::updateBounds()
+{
+	/* Base and controls are both clipped to the window rect */
+	IntRect rect(p->position.x + p->sceneOffset.x,
+	             p->position.y + p->sceneOffset.y,
+	             p->size.x, p->size.y);
+
+	setBounds(rect);
+	p->controlsElement.setBounds(rect);
 }
 
 void Window::setZ(int value)
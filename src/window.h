@@ -62,7 +62,9 @@ private:
 	WindowPrivate *p;
 
 	void draw();
+	bool digest(FrameDigest &digest);
 	void onGeometryChange(const Scene::Geometry &);
+	void updateBounds();
 	void setZ(int value);
 	void setVisible(bool value);
 
@@ -31,6 +31,7 @@
 #include "tilequad.h"
 #include "glstate.h"
 #include "shader.h"
+#include "frameprofiler.h"
 
 #include <limits>
 #include <algorithm>
@@ -667,8 +668,43 @@ struct WindowVXPrivate
 		}
 	}
 
+	void digest(FrameDigest &digest)
+	{
+		SceneElement::digestBitmap(digest, windowskin);
+		SceneElement::digestBitmap(digest, contents);
+
+		digest.add(cursorRect->x);
+		digest.add(cursorRect->y);
+		digest.add(cursorRect->width);
+		digest.add(cursorRect->height);
+		digest.add(active);
+		digest.add(arrowsVisible);
+		digest.add(pause);
+
+		digest.add(geo);
+		digest.add(contentsOff);
+		digest.add(sceneOffset);
+		digest.add(padding);
+		digest.add(paddingBottom);
+
+		digest.add(opacity.unNorm);
+		digest.add(backOpacity.unNorm);
+		digest.add(contentsOpacity.unNorm);
+		digest.add(openness.unNorm);
+		digest.add(tone->norm);
+
+		/* Idle steps of an invisible cursor don't change anything */
+		if (active && !cursorRect->isEmpty())
+			digest.add(cursorAlphaIdx);
+
+		digest.add(pauseAlphaIdx);
+		digest.add(pauseQuadIdx);
+	}
+
 	void prepare()
 	{
+		FrameProfiler::Scope scope(shState->profiler(), FrameProfiler::WindowPrepare);
+
 		if (base.vertDirty)
 		{
 			rebuildBaseVert();
@@ -864,6 +900,8 @@ void WindowVX::move(int x, int y, int width, int height)
 
 	p->geo = IntRect(x, y, size.x, size.y);
 	p->updateBaseQuad();
+
+	updateBounds();
 }
 
 bool WindowVX::isOpen() const
@@ -880,11 +918,11 @@ bool WindowVX::isClosed() const
 	return p->openness == 0;
 }
 
-DEF_ATTR_SIMPLE(WindowVX, X,          int,     p->geo.x)
-DEF_ATTR_SIMPLE(WindowVX, Y,          int,     p->geo.y)
 DEF_ATTR_SIMPLE(WindowVX, CursorRect, Rect&,  *p->cursorRect)
 DEF_ATTR_SIMPLE(WindowVX, Tone,       Tone&,  *p->tone)
 
+DEF_ATTR_RD_SIMPLE(WindowVX, X,               int,     p->geo.x)
+DEF_ATTR_RD_SIMPLE(WindowVX, Y,               int,     p->geo.y)
 DEF_ATTR_RD_SIMPLE(WindowVX, Windowskin,      Bitmap*, p->windowskin)
 DEF_ATTR_RD_SIMPLE(WindowVX, Contents,        Bitmap*, p->contents)
 DEF_ATTR_RD_SIMPLE(WindowVX, Active,          bool,    p->active)
@@ -965,6 +1003,22 @@ void WindowVX::setPause(bool value)
 	p->ctrlVertDirty = true;
 }
 
+void WindowVX::setX(int value)
+{
+	guardDisposed();
+
+	p->geo.x = value;
+	updateBounds();
+}
+
+void WindowVX::setY(int value)
+{
+	guardDisposed();
+
+	p->geo.y = value;
+	updateBounds();
+}
+
 void WindowVX::setWidth(int value)
 {
 	guardDisposed();
@@ -979,6 +1033,8 @@ void WindowVX::setWidth(int value)
 	p->clipRectDirty = true;
 	p->ctrlVertDirty = true;
 	p->updateBaseQuad();
+
+	updateBounds();
 }
 
 void WindowVX::setHeight(int value)
@@ -995,6 +1051,8 @@ void WindowVX::setHeight(int value)
 	p->clipRectDirty = true;
 	p->ctrlVertDirty = true;
 	p->updateBaseQuad();
+
+	updateBounds();
 }
 
 void WindowVX::setOX(int value)
@@ -1103,10 +1161,26 @@ void WindowVX::draw()
 	p->draw();
 }
 
+bool WindowVX::digest(FrameDigest &digest)
+{
+	p->digest(digest);
+
+	return true;
+}
+
 void WindowVX::onGeometryChange(const Scene::Geometry &geo)
 {
 	p->sceneOffset.x = geo.rect.x - geo.xOrigin;
 	p->sceneOffset.y = geo.rect.y - geo.yOrigin;
+
+	updateBounds();
+}
+
+void WindowVX::updateBounds()
+{
+	setBounds(IntRect(p->geo.x + p->sceneOffset.x,
+	                  p->geo.y + p->sceneOffset.y,
+	                  p->geo.w, p->geo.h));
 }
 
 void WindowVX::releaseResources()
@@ -72,7 +72,9 @@ private:
 	WindowVXPrivate *p;
 
 	void draw();
+	bool digest(FrameDigest &digest);
 	void onGeometryChange(const Scene::Geometry &);
+	void updateBounds();
 
 	void releaseResources();
 	const char *klassName() const { return "window"; }
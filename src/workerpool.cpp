@@ -0,0 +1,167 @@
+/*
+** workerpool.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "workerpool.h"
+
+#include "sdl-util.h"
+
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+
+#include <vector>
+
+struct WorkerPoolPrivate
+{
+	std::vector<SDL_Thread*> workers;
+
+	SDL_mutex *mutex;
+	/* Signaled when a batch is started */
+	SDL_cond *jobCond;
+	/* Signaled when the last job of a batch finishes */
+	SDL_cond *doneCond;
+
+	/* Current batch */
+	WorkerPool::Job *const *jobs;
+	size_t jobCount;
+	size_t nextJob;
+	/* Jobs not finished yet */
+	size_t pending;
+
+	bool quit;
+
+	WorkerPoolPrivate()
+	    : jobs(0),
+	      jobCount(0),
+	      nextJob(0),
+	      pending(0),
+	      quit(false)
+	{
+		mutex = SDL_CreateMutex();
+		jobCond = SDL_CreateCond();
+		doneCond = SDL_CreateCond();
+	}
+
+	~WorkerPoolPrivate()
+	{
+		SDL_DestroyCond(doneCond);
+		SDL_DestroyCond(jobCond);
+		SDL_DestroyMutex(mutex);
+	}
+
+	/* Works on the current batch until no jobs are
+	 * left to be taken. Requires 'mutex' */
+	void runJobs()
+	{
+		while (nextJob < jobCount)
+		{
+			WorkerPool::Job *job = jobs[nextJob++];
+
+			SDL_UnlockMutex(mutex);
+			job->run();
+			SDL_LockMutex(mutex);
+
+			if (--pending == 0)
+				SDL_CondBroadcast(doneCond);
+		}
+	}
+
+	void worker()
+	{
+		SDL_LockMutex(mutex);
+
+		while (true)
+		{
+			while (nextJob == jobCount && !quit)
+				SDL_CondWait(jobCond, mutex);
+
+			if (quit)
+				break;
+
+			runJobs();
+		}
+
+		SDL_UnlockMutex(mutex);
+	}
+};
+
+WorkerPool::WorkerPool(int threadCount)
+{
+	p = new WorkerPoolPrivate;
+
+	for (int i = 0; i < threadCount; ++i)
+	{
+		SDL_Thread *thread = createSDLThread
+			<WorkerPoolPrivate, &WorkerPoolPrivate::worker>(p, "worker");
+
+		if (thread)
+			p->workers.push_back(thread);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	SDL_LockMutex(p->mutex);
+	p->quit = true;
+	SDL_CondBroadcast(p->jobCond);
+	SDL_UnlockMutex(p->mutex);
+
+	for (size_t i = 0; i < p->workers.size(); ++i)
+		SDL_WaitThread(p->workers[i], 0);
+
+	delete p;
+}
+
+int WorkerPool::concurrency() const
+{
+	return p->workers.size() + 1;
+}
+
+void WorkerPool::run(Job *const *jobs, size_t count)
+{
+	/* Not worth waking anyone up */
+	if (p->workers.empty() || count < 2)
+	{
+		for (size_t i = 0; i < count; ++i)
+			jobs[i]->run();
+
+		return;
+	}
+
+	SDL_LockMutex(p->mutex);
+
+	p->jobs = jobs;
+	p->jobCount = count;
+	p->nextJob = 0;
+	p->pending = count;
+
+	SDL_CondBroadcast(p->jobCond);
+
+	p->runJobs();
+
+	while (p->pending > 0)
+		SDL_CondWait(p->doneCond, p->mutex);
+
+	p->jobs = 0;
+	p->jobCount = 0;
+	p->nextJob = 0;
+
+	SDL_UnlockMutex(p->mutex);
+}
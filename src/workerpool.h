@@ -0,0 +1,56 @@
+/*
+** workerpool.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 Jonas Kulla <Nyocurio@gmail.com>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <stddef.h>
+
+struct WorkerPoolPrivate;
+
+/* Runs batches of independent, CPU bound jobs (eg. vertex
+ * generation) on a few worker threads. The calling thread
+ * works on the batch as well and returns once it's done */
+class WorkerPool
+{
+public:
+	struct Job
+	{
+		virtual ~Job() {}
+
+		/* Must not throw */
+		virtual void run() = 0;
+	};
+
+	WorkerPool(int threadCount);
+	~WorkerPool();
+
+	/* Number of threads that work on a batch,
+	 * including the calling one */
+	int concurrency() const;
+
+	void run(Job *const *jobs, size_t count);
+
+private:
+	WorkerPoolPrivate *p;
+};
+
+#endif // WORKERPOOL_H